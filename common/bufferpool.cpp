@@ -0,0 +1,253 @@
+/*
+
+    OpenPnp-Capture: a video capture subsystem.
+
+    Library-wide pool of aligned frame buffers.
+
+    Copyright (c) 2017 Jason von Nieda, Niels Moseley.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+*/
+
+#include <memory.h>
+#include <new>
+#ifdef _WIN32
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#endif
+#include "bufferpool.h"
+#include "logging.h"
+
+// transparent huge pages on x86-64 and arm64
+static const size_t c_hugePageBytes = 2*1024*1024;
+
+// buffers of a page or more start on a page boundary,
+// so a driver can capture into them (V4L2_MEMORY_USERPTR)
+static const size_t c_pageBytes = 4096;
+
+// enough for a few streams to be re-opened without
+// going back to the system
+static const uint64_t c_defaultMaxCachedBytes = 256*1024*1024;
+
+// **********************************************************************
+//   BufferPool
+// **********************************************************************
+
+BufferPool& BufferPool::instance()
+{
+    // deliberately leaked, see header
+    static BufferPool *pool = new BufferPool();
+    return *pool;
+}
+
+BufferPool::BufferPool() :
+    m_flags(0),
+    m_maxCachedBytes(c_defaultMaxCachedBytes),
+    m_inUseBytes(0),
+    m_cachedBytes(0),
+    m_highWaterMark(0),
+    m_allocations(0),
+    m_reuses(0)
+{
+}
+
+size_t BufferPool::getSizeClass(size_t bytes)
+{
+    if (bytes <= 4096)
+    {
+        return ((bytes + c_alignment - 1) / c_alignment) * c_alignment;
+    }
+
+    // four classes per power of two
+    size_t base = 4096;
+    while((base*2) < bytes)
+    {
+        base *= 2;
+    }
+    const size_t step = base / 4;
+    return ((bytes + step - 1) / step) * step;
+}
+
+void* BufferPool::acquire(size_t bytes, size_t &capacity)
+{
+    capacity = getSizeClass(bytes);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto iter = m_free.find(capacity);
+    if ((iter != m_free.end()) && (!iter->second.empty()))
+    {
+        void *ptr = iter->second.back();
+        iter->second.pop_back();
+        m_cachedBytes -= capacity;
+        m_inUseBytes  += capacity;
+        m_reuses++;
+        return ptr;
+    }
+
+    void *ptr = allocateAligned(capacity);
+    if (ptr == nullptr)
+    {
+        LOG(LOG_ERR, "BufferPool: could not allocate %d bytes\n", capacity);
+        capacity = 0;
+        return nullptr;
+    }
+
+    m_allocations++;
+    m_inUseBytes += capacity;
+    if ((m_inUseBytes + m_cachedBytes) > m_highWaterMark)
+    {
+        m_highWaterMark = m_inUseBytes + m_cachedBytes;
+    }
+    return ptr;
+}
+
+void BufferPool::release(void *ptr, size_t capacity)
+{
+    if (ptr == nullptr)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_inUseBytes -= capacity;
+    if ((m_cachedBytes + capacity) > m_maxCachedBytes)
+    {
+        // make room by dropping other cached buffers first,
+        // the one being released is the most likely to be
+        // requested again.
+        trim((capacity < m_maxCachedBytes) ? m_maxCachedBytes - capacity : 0);
+    }
+
+    if ((m_cachedBytes + capacity) > m_maxCachedBytes)
+    {
+        freeAligned(ptr);
+        return;
+    }
+
+    m_free[capacity].push_back(ptr);
+    m_cachedBytes += capacity;
+}
+
+void BufferPool::configure(uint32_t flags, uint64_t maxCachedBytes)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_flags = flags;
+    m_maxCachedBytes = maxCachedBytes;
+    trim(maxCachedBytes);
+}
+
+void BufferPool::getStats(CapBufferPoolStats *stats)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    stats->bytesInUse    = m_inUseBytes;
+    stats->bytesCached   = m_cachedBytes;
+    stats->highWaterMark = m_highWaterMark;
+    stats->allocations   = m_allocations;
+    stats->reuses        = m_reuses;
+}
+
+void BufferPool::trim(uint64_t maxBytes)
+{
+    // free the largest buffers first
+    auto iter = m_free.rbegin();
+    while((m_cachedBytes > maxBytes) && (iter != m_free.rend()))
+    {
+        while((m_cachedBytes > maxBytes) && (!iter->second.empty()))
+        {
+            freeAligned(iter->second.back());
+            iter->second.pop_back();
+            m_cachedBytes -= iter->first;
+        }
+        iter++;
+    }
+}
+
+void* BufferPool::allocateAligned(size_t bytes)
+{
+    const size_t alignment = (bytes >= c_pageBytes) ? c_pageBytes : c_alignment;
+#ifdef _WIN32
+    return _aligned_malloc(bytes, alignment);
+#else
+    const bool huge = ((m_flags & CAPPOOL_HUGEPAGES) != 0) && (bytes >= c_hugePageBytes);
+    void *ptr = nullptr;
+    if (posix_memalign(&ptr, huge ? c_hugePageBytes : alignment, bytes) != 0)
+    {
+        return nullptr;
+    }
+
+    #ifdef MADV_HUGEPAGE
+    if (huge)
+    {
+        // only a hint: the kernel may not have huge pages enabled
+        madvise(ptr, bytes, MADV_HUGEPAGE);
+    }
+    #endif
+    return ptr;
+#endif
+}
+
+void BufferPool::freeAligned(void *ptr)
+{
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+// **********************************************************************
+//   FrameBuffer
+// **********************************************************************
+
+void FrameBuffer::resize(size_t bytes)
+{
+    if (bytes <= m_capacity)
+    {
+        m_size = bytes;
+        return;
+    }
+
+    size_t capacity = 0;
+    uint8_t *data = static_cast<uint8_t*>(BufferPool::instance().acquire(bytes, capacity));
+    if (data == nullptr)
+    {
+        // behave like std::vector
+        throw std::bad_alloc();
+    }
+
+    if (m_size != 0)
+    {
+        memcpy(data, m_data, m_size);
+    }
+    BufferPool::instance().release(m_data, m_capacity);
+
+    m_data = data;
+    m_size = bytes;
+    m_capacity = capacity;
+}
+
+void FrameBuffer::clear()
+{
+    BufferPool::instance().release(m_data, m_capacity);
+    m_data = nullptr;
+    m_size = 0;
+    m_capacity = 0;
+}
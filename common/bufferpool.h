@@ -0,0 +1,168 @@
+/*
+
+    OpenPnp-Capture: a video capture subsystem.
+
+    Library-wide pool of aligned frame buffers.
+
+    Copyright (c) 2017 Jason von Nieda, Niels Moseley.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#ifndef bufferpool_h
+#define bufferpool_h
+
+#include <stdint.h>
+#include <stdlib.h> // size_t
+#include <map>
+#include <vector>
+#include <mutex>
+#include "openpnp-capture.h"
+
+/** The BufferPool hands out frame buffers that are aligned
+    to a cache line (c_alignment bytes), or to a page if they
+    are a page or larger, and keeps released buffers for 
+    re-use, so re-opening a stream does not return tens of
+    megabytes to the system only to request them again.
+
+    Buffers are rounded up to a size class: a power of two
+    or 1.25, 1.5 or 1.75 times a power of two. A request is
+    served from the released buffers of its size class, if
+    there are any. Released buffers are freed when the
+    cached total would exceed the configured limit.
+
+    With CAPPOOL_HUGEPAGES, large buffers are aligned to 2MB
+    and Linux is asked to back them with transparent huge
+    pages.
+
+    All functions are thread-safe.
+*/
+class BufferPool
+{
+public:
+    /** Return the library-wide pool. It is never destroyed,
+        so buffers can be released during program exit. */
+    static BufferPool& instance();
+
+    /** Get a buffer of at least 'bytes' bytes. The usable size
+        is returned in 'capacity'. Returns nullptr if the system
+        is out of memory. */
+    void* acquire(size_t bytes, size_t &capacity);
+
+    /** Return a buffer obtained by acquire to the pool */
+    void release(void *ptr, size_t capacity);
+
+    /** Set the CAPPOOL_xxx flags and the maximum number of bytes
+        kept in released buffers. Excess buffers are freed. */
+    void configure(uint32_t flags, uint64_t maxCachedBytes);
+
+    /** Fill in the statistics of the pool */
+    void getStats(CapBufferPoolStats *stats);
+
+    /** Return the size class of a request of 'bytes' bytes */
+    static size_t getSizeClass(size_t bytes);
+
+    static const size_t c_alignment = 64;   ///< alignment of all buffers
+
+protected:
+    BufferPool();
+
+    /** Allocate a buffer from the system */
+    void* allocateAligned(size_t bytes);
+
+    /** Return a buffer to the system */
+    static void freeAligned(void *ptr);
+
+    /** Free released buffers until at most 'maxBytes' are cached.
+        m_mutex must be held. */
+    void trim(uint64_t maxBytes);
+
+    std::mutex  m_mutex;            ///< protects all members below
+    std::map<size_t, std::vector<void*> > m_free;   ///< released buffers by size class
+    uint32_t    m_flags;            ///< CAPPOOL_xxx
+    uint64_t    m_maxCachedBytes;   ///< limit of m_cachedBytes
+    uint64_t    m_inUseBytes;       ///< bytes in buffers handed out
+    uint64_t    m_cachedBytes;      ///< bytes in released buffers
+    uint64_t    m_highWaterMark;    ///< maximum of m_inUseBytes + m_cachedBytes
+    uint32_t    m_allocations;      ///< number of buffers allocated from the system
+    uint32_t    m_reuses;           ///< number of requests served from m_free
+};
+
+/** A frame buffer backed by the BufferPool, with the
+    subset of the std::vector<uint8_t> interface the
+    library uses. Unlike std::vector, new bytes are
+    not initialized. */
+class FrameBuffer
+{
+public:
+    FrameBuffer() : m_data(nullptr), m_size(0), m_capacity(0) {}
+
+    ~FrameBuffer()
+    {
+        clear();
+    }
+
+    /** Change the size of the buffer, keeping its contents.
+        A new buffer is only obtained from the pool when
+        the capacity is too small. */
+    void resize(size_t bytes);
+
+    /** Return the buffer to the pool */
+    void clear();
+
+    size_t size() const
+    {
+        return m_size;
+    }
+
+    bool empty() const
+    {
+        return m_size == 0;
+    }
+
+    uint8_t* data()
+    {
+        return m_data;
+    }
+
+    const uint8_t* data() const
+    {
+        return m_data;
+    }
+
+    uint8_t& operator[](size_t index)
+    {
+        return m_data[index];
+    }
+
+    const uint8_t& operator[](size_t index) const
+    {
+        return m_data[index];
+    }
+
+private:
+    FrameBuffer(const FrameBuffer&);            // not copyable
+    FrameBuffer& operator=(const FrameBuffer&);
+
+    uint8_t*    m_data;         ///< pool buffer or nullptr
+    size_t      m_size;         ///< number of bytes in use
+    size_t      m_capacity;     ///< size of the pool buffer
+};
+
+#endif
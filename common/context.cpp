@@ -39,12 +39,11 @@ Context::Context() :
 
 Context::~Context()
 {
-    // delete stream objects
-    auto iter = m_streams.begin();
-    while(iter != m_streams.end())
+    // delete stream objects, some of which
+    // may be shared by several stream IDs
+    while(!m_streams.empty())
     {
-        delete iter->second;
-        iter++;
+        removeStream(m_streams.begin()->first);
     }
 
     //delete capture devices
@@ -57,6 +56,39 @@ Context::~Context()
     LOG(LOG_DEBUG, "Context destroyed\n");
 }
 
+CapResult Context::setReactorThreads(uint32_t threads)
+{
+    if (threads == 0)
+    {
+        return CAPRESULT_OK;
+    }
+
+    LOG(LOG_ERR, "setReactorThreads: not supported on this platform\n");
+    return CAPRESULT_FORMATNOTSUPPORTED;
+}
+
+CapResult Context::setDecodeThreads(uint32_t threads)
+{
+    if (threads == 0)
+    {
+        return CAPRESULT_OK;
+    }
+
+    LOG(LOG_ERR, "setDecodeThreads: not supported on this platform\n");
+    return CAPRESULT_FORMATNOTSUPPORTED;
+}
+
+CapResult Context::setDefaultThreadPolicy(uint32_t policy, int32_t priority, uint64_t cpuMask)
+{
+    if ((policy == CAPTHREAD_NORMAL) && (cpuMask == 0))
+    {
+        return CAPRESULT_OK;
+    }
+
+    LOG(LOG_ERR, "setDefaultThreadPolicy: not supported on this platform\n");
+    return CAPRESULT_FORMATNOTSUPPORTED;
+}
+
 const char* Context::getDeviceName(CapDeviceID id) const
 {
     if (id >= m_devices.size())
@@ -154,6 +186,26 @@ int32_t Context::openStream(CapDeviceID id, CapFormatID formatID)
         return -1;        
     }
 
+    // a device can only be opened once, so hand
+    // out another ID on the stream that is open.
+    {
+        std::lock_guard<std::mutex> lock(m_streamMutex);
+        int32_t sharedID = findDeviceStream(id);
+        if (sharedID >= 0)
+        {
+            if (m_handles[sharedID].format != formatID)
+            {
+                LOG(LOG_ERR, "openStream: device %s is already open with format %d\n", 
+                    device->m_name.c_str(), m_handles[sharedID].format);
+                return -1;
+            }
+
+            LOG(LOG_INFO, "openStream: sharing the open stream %d of device %s\n", 
+                sharedID, device->m_name.c_str());
+            return storeStream(m_streams[sharedID], id, formatID);
+        }
+    }
+
     Stream *s = createPlatformStream();
 
     if (!s->open(this, device, device->m_formats[formatID].width,
@@ -176,7 +228,8 @@ int32_t Context::openStream(CapDeviceID id, CapFormatID formatID)
         printf("\n");
     }
 
-    int32_t streamID = storeStream(s);
+    std::lock_guard<std::mutex> lock(m_streamMutex);
+    int32_t streamID = storeStream(s, id, formatID);
     return streamID;
 }
 
@@ -205,16 +258,17 @@ uint32_t Context::isOpenStream(int32_t streamID)
         return 0;
     }    
 
-    if (static_cast<uint32_t>(streamID) >= m_streams.size())
+    Stream *stream = lookupStream(streamID);
+    if (stream == nullptr)
     {
-        LOG(LOG_ERR, "isOpenStream was called with an out-of-bounds stream ID\n");
+        LOG(LOG_ERR, "isOpenStream was called with an unknown stream ID\n");
         return 0;        
     }
 
-    return m_streams[streamID]->isOpen() ? 1 : 0;
+    return stream->isOpen() ? 1 : 0;
 }
 
-bool Context::captureFrame(int32_t streamID, uint8_t *RGBbufferPtr, size_t RGBbufferBytes)
+bool Context::captureFrame(int32_t streamID, uint8_t *RGBbufferPtr, size_t RGBbufferBytes, uint32_t stride, CapFrameInfo *info)
 {
     if (streamID < 0)
     {
@@ -222,14 +276,470 @@ bool Context::captureFrame(int32_t streamID, uint8_t *RGBbufferPtr, size_t RGBbu
         return false;
     }    
 
-    Stream *stream = m_streams[streamID];
+    uint32_t *cursor = nullptr;
+    Stream *stream = lookupStream(streamID, &cursor);
     if (stream == nullptr)
     {
         LOG(LOG_ERR, "hasNewFrame was called with an unknown stream ID\n");
         return false; 
     }
     
-    return m_streams[streamID]->captureFrame(RGBbufferPtr, RGBbufferBytes);
+    return stream->captureFrame(RGBbufferPtr, RGBbufferBytes, stride, info, cursor);
+}
+
+CapResult Context::captureFrameROI(int32_t streamID, const CapROI *rois, uint32_t count, CapFrameInfo *info)
+{
+    if (streamID < 0)
+    {
+        LOG(LOG_ERR, "captureFrameROI was called with a negative stream ID\n");
+        return CAPRESULT_ERR;
+    }    
+
+    uint32_t *cursor = nullptr;
+    Stream *stream = lookupStream(streamID, &cursor);
+    if (stream == nullptr)
+    {
+        LOG(LOG_ERR, "captureFrameROI was called with an unknown stream ID\n");
+        return CAPRESULT_ERR; 
+    }
+
+    return stream->captureFrameROI(rois, count, info, cursor);
+}
+
+CapResult Context::captureRawFrame(int32_t streamID, uint8_t *buffer, uint32_t bufferBytes, 
+    uint32_t *payloadBytes, uint32_t *fourCC, CapFrameInfo *info)
+{
+    if (streamID < 0)
+    {
+        LOG(LOG_ERR, "captureRawFrame was called with a negative stream ID\n");
+        return CAPRESULT_ERR;
+    }    
+
+    uint32_t *cursor = nullptr;
+    Stream *stream = lookupStream(streamID, &cursor);
+    if (stream == nullptr)
+    {
+        LOG(LOG_ERR, "captureRawFrame was called with an unknown stream ID\n");
+        return CAPRESULT_ERR; 
+    }
+
+    return stream->captureRawFrame(buffer, bufferBytes, payloadBytes, fourCC, info, 
+        cursor);
+}
+
+CapResult Context::acquireFrame(int32_t streamID, CapFrameLease *lease)
+{
+    if (streamID < 0)
+    {
+        LOG(LOG_ERR, "acquireFrame was called with a negative stream ID\n");
+        return CAPRESULT_ERR;
+    }    
+
+    uint32_t *cursor = nullptr;
+    Stream *stream = lookupStream(streamID, &cursor);
+    if (stream == nullptr)
+    {
+        LOG(LOG_ERR, "acquireFrame was called with an unknown stream ID\n");
+        return CAPRESULT_ERR; 
+    }
+
+    if (lease == nullptr)
+    {
+        LOG(LOG_ERR, "acquireFrame was called with lease=NULL\n");
+        return CAPRESULT_ERR; 
+    }
+
+    return stream->acquireFrame(lease, cursor) ? CAPRESULT_OK : CAPRESULT_NOFRAME;
+}
+
+bool Context::releaseFrame(int32_t streamID, const CapFrameLease *lease)
+{
+    if (streamID < 0)
+    {
+        LOG(LOG_ERR, "releaseFrame was called with a negative stream ID\n");
+        return false;
+    }    
+
+    Stream *stream = lookupStream(streamID);
+    if (stream == nullptr)
+    {
+        LOG(LOG_ERR, "releaseFrame was called with an unknown stream ID\n");
+        return false; 
+    }
+
+    return stream->releaseFrame(lease);
+}
+
+bool Context::setFrameCallback(int32_t streamID, CapFrameCallback callback, void *user)
+{
+    if (streamID < 0)
+    {
+        LOG(LOG_ERR, "setFrameCallback was called with a negative stream ID\n");
+        return false;
+    }    
+
+    Stream *stream = lookupStream(streamID);
+    if (stream == nullptr)
+    {
+        LOG(LOG_ERR, "setFrameCallback was called with an unknown stream ID\n");
+        return false; 
+    }
+
+    stream->setFrameCallback(callback, user);
+    return true;
+}
+
+bool Context::setDeliveryMode(int32_t streamID, uint32_t mode, uint32_t depth, uint32_t overflowPolicy)
+{
+    if (streamID < 0)
+    {
+        LOG(LOG_ERR, "setDeliveryMode was called with a negative stream ID\n");
+        return false;
+    }    
+
+    Stream *stream = lookupStream(streamID);
+    if (stream == nullptr)
+    {
+        LOG(LOG_ERR, "setDeliveryMode was called with an unknown stream ID\n");
+        return false; 
+    }
+
+    return stream->setDeliveryMode(mode, depth, overflowPolicy);
+}
+
+CapResult Context::setOutputFormat(int32_t streamID, uint32_t format)
+{
+    if (streamID < 0)
+    {
+        LOG(LOG_ERR, "setOutputFormat was called with a negative stream ID\n");
+        return CAPRESULT_ERR;
+    }    
+
+    Stream *stream = lookupStream(streamID);
+    if (stream == nullptr)
+    {
+        LOG(LOG_ERR, "setOutputFormat was called with an unknown stream ID\n");
+        return CAPRESULT_ERR; 
+    }
+
+    return stream->setOutputFormat(format);
+}
+
+uint32_t Context::getOutputFrameBytes(int32_t streamID)
+{
+    if (streamID < 0)
+    {
+        LOG(LOG_ERR, "getOutputFrameBytes was called with a negative stream ID\n");
+        return 0;
+    }    
+
+    Stream *stream = lookupStream(streamID);
+    if (stream == nullptr)
+    {
+        LOG(LOG_ERR, "getOutputFrameBytes was called with an unknown stream ID\n");
+        return 0; 
+    }
+
+    return stream->getOutputFrameBytes();
+}
+
+CapResult Context::setOutputScale(int32_t streamID, uint32_t denom)
+{
+    if (streamID < 0)
+    {
+        LOG(LOG_ERR, "setOutputScale was called with a negative stream ID\n");
+        return CAPRESULT_ERR;
+    }    
+
+    Stream *stream = lookupStream(streamID);
+    if (stream == nullptr)
+    {
+        LOG(LOG_ERR, "setOutputScale was called with an unknown stream ID\n");
+        return CAPRESULT_ERR; 
+    }
+
+    return stream->setOutputScale(denom);
+}
+
+bool Context::getOutputFrameSize(int32_t streamID, uint32_t *width, uint32_t *height)
+{
+    if (streamID < 0)
+    {
+        LOG(LOG_ERR, "getOutputFrameSize was called with a negative stream ID\n");
+        return false;
+    }    
+
+    Stream *stream = lookupStream(streamID);
+    if (stream == nullptr)
+    {
+        LOG(LOG_ERR, "getOutputFrameSize was called with an unknown stream ID\n");
+        return false; 
+    }
+
+    if ((width == nullptr) || (height == nullptr) || (!stream->isOpen()))
+    {
+        return false;
+    }
+
+    *width  = stream->getOutputWidth();
+    *height = stream->getOutputHeight();
+    return true;
+}
+
+bool Context::setDecodeMode(int32_t streamID, uint32_t mode)
+{
+    if (streamID < 0)
+    {
+        LOG(LOG_ERR, "setDecodeMode was called with a negative stream ID\n");
+        return false;
+    }    
+
+    Stream *stream = lookupStream(streamID);
+    if (stream == nullptr)
+    {
+        LOG(LOG_ERR, "setDecodeMode was called with an unknown stream ID\n");
+        return false; 
+    }
+
+    return stream->setDecodeMode(mode);
+}
+
+bool Context::setOutputDecimation(int32_t streamID, uint32_t n)
+{
+    if (streamID < 0)
+    {
+        LOG(LOG_ERR, "setOutputDecimation was called with a negative stream ID\n");
+        return false;
+    }    
+
+    Stream *stream = lookupStream(streamID);
+    if (stream == nullptr)
+    {
+        LOG(LOG_ERR, "setOutputDecimation was called with an unknown stream ID\n");
+        return false; 
+    }
+
+    stream->setOutputDecimation(n);
+    return true;
+}
+
+bool Context::setMaxOutputFrameRate(int32_t streamID, uint32_t fps)
+{
+    if (streamID < 0)
+    {
+        LOG(LOG_ERR, "setMaxOutputFrameRate was called with a negative stream ID\n");
+        return false;
+    }    
+
+    Stream *stream = lookupStream(streamID);
+    if (stream == nullptr)
+    {
+        LOG(LOG_ERR, "setMaxOutputFrameRate was called with an unknown stream ID\n");
+        return false; 
+    }
+
+    stream->setMaxOutputFrameRate(fps);
+    return true;
+}
+
+CapResult Context::setDmaBufExport(int32_t streamID, bool enable)
+{
+    if (streamID < 0)
+    {
+        LOG(LOG_ERR, "setDmaBufExport was called with a negative stream ID\n");
+        return CAPRESULT_ERR;
+    }    
+
+    Stream *stream = lookupStream(streamID);
+    if (stream == nullptr)
+    {
+        LOG(LOG_ERR, "setDmaBufExport was called with an unknown stream ID\n");
+        return CAPRESULT_ERR; 
+    }
+
+    return stream->setDmaBufExport(enable);
+}
+
+CapResult Context::acquireDmaBuf(int32_t streamID, CapDmaBufLease *lease)
+{
+    if (streamID < 0)
+    {
+        LOG(LOG_ERR, "acquireDmaBuf was called with a negative stream ID\n");
+        return CAPRESULT_ERR;
+    }    
+
+    Stream *stream = lookupStream(streamID);
+    if (stream == nullptr)
+    {
+        LOG(LOG_ERR, "acquireDmaBuf was called with an unknown stream ID\n");
+        return CAPRESULT_ERR; 
+    }
+
+    return stream->acquireDmaBuf(lease);
+}
+
+bool Context::releaseDmaBuf(int32_t streamID, const CapDmaBufLease *lease)
+{
+    if (streamID < 0)
+    {
+        LOG(LOG_ERR, "releaseDmaBuf was called with a negative stream ID\n");
+        return false;
+    }    
+
+    Stream *stream = lookupStream(streamID);
+    if (stream == nullptr)
+    {
+        LOG(LOG_ERR, "releaseDmaBuf was called with an unknown stream ID\n");
+        return false; 
+    }
+
+    return stream->releaseDmaBuf(lease);
+}
+
+bool Context::setSharedMemoryExport(int32_t streamID, const char *name, uint32_t slots)
+{
+    if (streamID < 0)
+    {
+        LOG(LOG_ERR, "setSharedMemoryExport was called with a negative stream ID\n");
+        return false;
+    }    
+
+    Stream *stream = lookupStream(streamID);
+    if (stream == nullptr)
+    {
+        LOG(LOG_ERR, "setSharedMemoryExport was called with an unknown stream ID\n");
+        return false; 
+    }
+
+    return stream->setSharedMemoryExport(name, slots);
+}
+
+CapResult Context::setIOMode(int32_t streamID, uint32_t mode)
+{
+    if (streamID < 0)
+    {
+        LOG(LOG_ERR, "setIOMode was called with a negative stream ID\n");
+        return CAPRESULT_ERR;
+    }    
+
+    Stream *stream = lookupStream(streamID);
+    if (stream == nullptr)
+    {
+        LOG(LOG_ERR, "setIOMode was called with an unknown stream ID\n");
+        return CAPRESULT_ERR; 
+    }
+
+    return stream->setIOMode(mode);
+}
+
+uint32_t Context::getIOMode(int32_t streamID)
+{
+    if (streamID < 0)
+    {
+        LOG(LOG_ERR, "getIOMode was called with a negative stream ID\n");
+        return CAPIO_MMAP;
+    }    
+
+    Stream *stream = lookupStream(streamID);
+    if (stream == nullptr)
+    {
+        LOG(LOG_ERR, "getIOMode was called with an unknown stream ID\n");
+        return CAPIO_MMAP; 
+    }
+
+    return stream->getIOMode();
+}
+
+CapResult Context::setCaptureQueue(int32_t streamID, uint32_t bufferCount, uint32_t policy)
+{
+    if (streamID < 0)
+    {
+        LOG(LOG_ERR, "setCaptureQueue was called with a negative stream ID\n");
+        return CAPRESULT_ERR;
+    }    
+
+    Stream *stream = lookupStream(streamID);
+    if (stream == nullptr)
+    {
+        LOG(LOG_ERR, "setCaptureQueue was called with an unknown stream ID\n");
+        return CAPRESULT_ERR; 
+    }
+
+    return stream->setCaptureQueue(bufferCount, policy);
+}
+
+bool Context::getLatencyStats(int32_t streamID, CapLatencyStats *stats)
+{
+    if (streamID < 0)
+    {
+        LOG(LOG_ERR, "getLatencyStats was called with a negative stream ID\n");
+        return false;
+    }    
+
+    Stream *stream = lookupStream(streamID);
+    if (stream == nullptr)
+    {
+        LOG(LOG_ERR, "getLatencyStats was called with an unknown stream ID\n");
+        return false; 
+    }
+
+    stream->getLatencyStats(stats);
+    return true;
+}
+
+bool Context::resetLatencyStats(int32_t streamID)
+{
+    if (streamID < 0)
+    {
+        LOG(LOG_ERR, "resetLatencyStats was called with a negative stream ID\n");
+        return false;
+    }    
+
+    Stream *stream = lookupStream(streamID);
+    if (stream == nullptr)
+    {
+        LOG(LOG_ERR, "resetLatencyStats was called with an unknown stream ID\n");
+        return false; 
+    }
+
+    stream->resetLatencyStats();
+    return true;
+}
+
+CapResult Context::setThreadPolicy(int32_t streamID, uint32_t policy, int32_t priority, uint64_t cpuMask)
+{
+    if (streamID < 0)
+    {
+        LOG(LOG_ERR, "setThreadPolicy was called with a negative stream ID\n");
+        return CAPRESULT_ERR;
+    }    
+
+    Stream *stream = lookupStream(streamID);
+    if (stream == nullptr)
+    {
+        LOG(LOG_ERR, "setThreadPolicy was called with an unknown stream ID\n");
+        return CAPRESULT_ERR; 
+    }
+
+    return stream->setThreadPolicy(policy, priority, cpuMask);
+}
+
+uint32_t Context::getStreamOverflowCount(int32_t streamID)
+{
+    if (streamID < 0)
+    {
+        LOG(LOG_ERR, "getStreamOverflowCount was called with a negative stream ID\n");
+        return 0;
+    }    
+
+    Stream *stream = lookupStream(streamID);
+    if (stream == nullptr)
+    {
+        LOG(LOG_ERR, "getStreamOverflowCount was called with an unknown stream ID\n");
+        return 0; 
+    }
+
+    return stream->getOverflowCount();
 }
 
 bool Context::hasNewFrame(int32_t streamID)
@@ -240,14 +750,47 @@ bool Context::hasNewFrame(int32_t streamID)
         return false;
     }    
 
-    Stream *stream = m_streams[streamID];
+    uint32_t *cursor = nullptr;
+    Stream *stream = lookupStream(streamID, &cursor);
     if (stream == nullptr)
     {
         LOG(LOG_ERR, "hasNewFrame was called with an unknown stream ID\n");
         return false; 
     }
 
-    return stream->hasNewFrame();
+    return stream->hasNewFrame(*cursor);
+}
+
+CapResult Context::waitForNewFrame(int32_t streamID, uint32_t timeoutMs)
+{
+    if (streamID < 0)
+    {
+        LOG(LOG_ERR, "waitForNewFrame was called with a negative stream ID\n");
+        return CAPRESULT_ERR;
+    }    
+
+    // register the waiter while the stream cannot be removed,
+    // so removeStream either wakes it up or it finds no stream.
+    Stream *stream = nullptr;
+    uint32_t cursor = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_streamMutex);
+        auto it = m_streams.find(streamID);
+        if ((it == m_streams.end()) || (it->second == nullptr))
+        {
+            LOG(LOG_ERR, "waitForNewFrame was called with an unknown stream ID\n");
+            return CAPRESULT_ERR; 
+        }
+
+        stream = it->second;
+        cursor = m_handles[streamID].cursor;
+        if (!stream->addWaiter(streamID))
+        {
+            return CAPRESULT_ERR;
+        }
+    }
+
+    return stream->waitRegistered(timeoutMs, cursor, streamID);
 }
 
 uint32_t Context::getStreamFrameCount(int32_t streamID)
@@ -258,7 +801,7 @@ uint32_t Context::getStreamFrameCount(int32_t streamID)
         return 0;
     }    
 
-    Stream *stream = m_streams[streamID];
+    Stream *stream = lookupStream(streamID);
     if (stream == nullptr)
     {
         LOG(LOG_ERR, "hasNewFrame was called with an unknown stream ID\n");
@@ -276,7 +819,7 @@ bool Context::setStreamFrameRate(int32_t streamID, uint32_t fps)
         return 0;
     }    
 
-    Stream *stream = m_streams[streamID];
+    Stream *stream = lookupStream(streamID);
     if (stream == nullptr)
     {
         LOG(LOG_ERR, "setStreamFrameRate was called with an unknown stream ID\n");
@@ -286,39 +829,91 @@ bool Context::setStreamFrameRate(int32_t streamID, uint32_t fps)
     return stream->setFrameRate(fps);
 }
 
-#if 0
 /** Lookup a stream by ID and return a pointer
     to it if it exists. If it doesnt exist, 
     return NULL */
-Stream* Context::lookupStreamByID(int32_t ID)
+Stream* Context::lookupStream(int32_t ID, uint32_t **cursor)
 {
+    std::lock_guard<std::mutex> lock(m_streamMutex);
     auto it = m_streams.find(ID);
-    if (it != m_streams.end())
+    if (it == m_streams.end())
     {
-        return it->second;
+        return nullptr;
     }
-    return nullptr;
+
+    if (cursor != nullptr)
+    {
+        *cursor = &m_handles[ID].cursor;
+    }
+    return it->second;
 }
-#endif
 
 /** Store a stream pointer in the m_streams map
     and return its unique ID */
-int32_t Context::storeStream(Stream *stream)
+int32_t Context::storeStream(Stream *stream, CapDeviceID device, CapFormatID format)
 {   
     int32_t ID = m_streamCounter++; 
     m_streams.insert(std::pair<int32_t,Stream*>(ID, stream));    
+
+    StreamHandle handle;
+    handle.device = device;
+    handle.format = format;
+    handle.cursor = 0;
+    m_handles.insert(std::pair<int32_t,StreamHandle>(ID, handle));
     return ID;
 }
 
+int32_t Context::findDeviceStream(CapDeviceID id) const
+{
+    for(auto iter = m_handles.begin(); iter != m_handles.end(); iter++)
+    {
+        if (iter->second.device == id)
+        {
+            auto stream = m_streams.find(iter->first);
+            if ((stream != m_streams.end()) && (stream->second != nullptr))
+            {
+                return iter->first;
+            }
+        }
+    }
+    return -1;
+}
+
 /** Remove a stream from the m_streams map.
     Return true if this was successful */
 bool Context::removeStream(int32_t ID)
 {
+    std::unique_lock<std::mutex> lock(m_streamMutex);
     auto it = m_streams.find(ID);
     if (it != m_streams.end())
     {
-        delete it->second;
+        Stream *stream = it->second;
         m_streams.erase(it);
+        m_handles.erase(ID);
+
+        if (stream == nullptr)
+        {
+            return true;
+        }
+
+        // keep the stream while other IDs use it, but
+        // wake up threads waiting through this ID. The
+        // lock keeps the other IDs from deleting it.
+        for(auto iter = m_streams.begin(); iter != m_streams.end(); iter++)
+        {
+            if (iter->second == stream)
+            {
+                stream->cancelHandleWaiters(ID);
+                return true;
+            }
+        }
+
+        // no ID refers to the stream anymore, so no new
+        // waiter can register. Wake up the threads blocked
+        // in waitForNewFrame before the stream disappears.
+        lock.unlock();
+        stream->cancelWaiters();
+        delete stream;
         return true;
     }
     return false;
@@ -327,21 +922,21 @@ bool Context::removeStream(int32_t ID)
 bool Context::getStreamPropertyLimits(int32_t streamID, uint32_t propertyID, 
         int32_t *min, int32_t *max, int32_t *dValue)
 {
-    Stream* stream = m_streams[streamID];
+    Stream* stream = lookupStream(streamID);
     if (stream == nullptr) return false;
     return stream->getPropertyLimits(propertyID, min, max, dValue);
 }
 
 bool Context::setStreamAutoProperty(int32_t streamID, uint32_t propertyID, bool enable)
 {
-    Stream* stream = m_streams[streamID];
+    Stream* stream = lookupStream(streamID);
     if (stream == nullptr) return false;
     return stream->setAutoProperty(propertyID, enable);
 }
 
 bool Context::setStreamProperty(int32_t streamID, uint32_t propertyID, int32_t value)
 {
-    Stream* stream = m_streams[streamID];
+    Stream* stream = lookupStream(streamID);
     if (stream == nullptr) return false;
     return stream->setProperty(propertyID, value);
 }
@@ -349,7 +944,7 @@ bool Context::setStreamProperty(int32_t streamID, uint32_t propertyID, int32_t v
 
 bool Context::getStreamProperty(int32_t streamID, uint32_t propertyID, int32_t &outValue)
 {
-    Stream* stream = m_streams[streamID];
+    Stream* stream = lookupStream(streamID);
     if (stream == nullptr) return false;
     return stream->getProperty(propertyID, outValue);
 }
@@ -357,7 +952,7 @@ bool Context::getStreamProperty(int32_t streamID, uint32_t propertyID, int32_t &
 
 bool Context::getStreamAutoProperty(int32_t streamID, uint32_t propertyID, bool &enable)
 {
-    Stream* stream = m_streams[streamID];
+    Stream* stream = lookupStream(streamID);
     if (stream == nullptr) return false;
     return stream->getAutoProperty(propertyID, enable);
 }
@@ -31,6 +31,7 @@
 #include <vector>
 #include <string>
 #include <map>
+#include <mutex>
 #include <stdint.h>
 
 #include "openpnp-capture.h"
@@ -60,6 +61,23 @@ public:
     Context();
     virtual ~Context();
 
+    /** Select the threads that service the devices of streams
+        opened from now on, see Cap_setReactorThreads. The default
+        implementation only supports one thread per stream (0). */
+    virtual CapResult setReactorThreads(uint32_t threads);
+
+    /** Select the threads that decode the frames of streams
+        opened from now on, see Cap_setDecodeThreads. The default
+        implementation only supports decoding on the thread that
+        receives a frame (0). */
+    virtual CapResult setDecodeThreads(uint32_t threads);
+
+    /** Set the thread policy of streams opened from now on and of
+        the shared capture threads, see Cap_setDefaultThreadPolicy.
+        The default implementation only supports CAPTHREAD_NORMAL 
+        without CPU affinity. */
+    virtual CapResult setDefaultThreadPolicy(uint32_t policy, int32_t priority, uint64_t cpuMask);
+
     /** Get the UTF-8 device name of a device with index/ID id */
     const char* getDeviceName(CapDeviceID id) const;
 
@@ -100,8 +118,11 @@ public:
         If the stream is succesfully opnened, capturing starts automatically
         until the stream (or its associated context) is closed with closeStream.
 
-        Note: for now, only one stream per device is supported but opening more
-              streams might or might not work.
+        If the device is already open in this context with the same format,
+        no new platform stream is created: the returned ID shares the
+        capture and decoding of the open stream but has its own new-frame
+        cursor. The device is closed when the last of its IDs is closed.
+        Opening an open device with a different format fails.
     */
     int32_t openStream(CapDeviceID id, CapFormatID formatID);
 
@@ -111,12 +132,106 @@ public:
     /** returns 1 if the stream is open and capturing, else 0 */
     uint32_t isOpenStream(int32_t streamID);
 
-    /** returns true if succeeds, else false */
-    bool captureFrame(int32_t streamID, uint8_t *RGBbufferPtr, size_t RGBbufferBytes);
+    /** returns true if succeeds, else false.
+        if info is not NULL, it receives the frame metadata. */
+    bool captureFrame(int32_t streamID, uint8_t *RGBbufferPtr, size_t RGBbufferBytes, uint32_t stride, CapFrameInfo *info);
+
+    /** copy regions of the most recent frame.
+        returns CAPRESULT_OK, CAPRESULT_NOFRAME or CAPRESULT_ERR */
+    CapResult captureFrameROI(int32_t streamID, const CapROI *rois, uint32_t count, CapFrameInfo *info);
+
+    /** copy the undecoded camera payload of the most recent frame.
+        returns CAPRESULT_OK, CAPRESULT_NOFRAME, CAPRESULT_FORMATNOTSUPPORTED
+        or CAPRESULT_ERR */
+    CapResult captureRawFrame(int32_t streamID, uint8_t *buffer, uint32_t bufferBytes, uint32_t *payloadBytes,
+        uint32_t *fourCC, CapFrameInfo *info);
+
+    /** lease the most recent frame without copying.
+        returns CAPRESULT_OK, CAPRESULT_NOFRAME or CAPRESULT_ERR */
+    CapResult acquireFrame(int32_t streamID, CapFrameLease *lease);
+
+    /** return a frame leased by acquireFrame. returns true if succeeds */
+    bool releaseFrame(int32_t streamID, const CapFrameLease *lease);
+
+    /** install a frame callback on a stream. returns true if succeeds */
+    bool setFrameCallback(int32_t streamID, CapFrameCallback callback, void *user);
+
+    /** select the frame delivery mode of a stream. returns true if succeeds */
+    bool setDeliveryMode(int32_t streamID, uint32_t mode, uint32_t depth, uint32_t overflowPolicy);
+
+    /** select the output pixel format of a stream.
+        returns CAPRESULT_OK, CAPRESULT_FORMATNOTSUPPORTED or CAPRESULT_ERR */
+    CapResult setOutputFormat(int32_t streamID, uint32_t format);
+
+    /** returns the size of a frame in the output format of a stream */
+    uint32_t getOutputFrameBytes(int32_t streamID);
+
+    /** select the output scale of a stream.
+        returns CAPRESULT_OK, CAPRESULT_FORMATNOTSUPPORTED or CAPRESULT_ERR */
+    CapResult setOutputScale(int32_t streamID, uint32_t denom);
+
+    /** get the frame size of a stream at the current output scale.
+        returns true if succeeds */
+    bool getOutputFrameSize(int32_t streamID, uint32_t *width, uint32_t *height);
+
+    /** export the frames of a stream to shared memory, or stop
+        exporting if name is NULL. returns true if succeeds */
+    bool setSharedMemoryExport(int32_t streamID, const char *name, uint32_t slots);
+
+    /** export the camera buffers of a stream as DMABUFs.
+        returns CAPRESULT_OK, CAPRESULT_FORMATNOTSUPPORTED or CAPRESULT_ERR */
+    CapResult setDmaBufExport(int32_t streamID, bool enable);
+
+    /** lease the camera buffer of the most recent frame as a DMABUF.
+        returns CAPRESULT_OK, CAPRESULT_NOFRAME or CAPRESULT_ERR */
+    CapResult acquireDmaBuf(int32_t streamID, CapDmaBufLease *lease);
+
+    /** return a DMABUF leased by acquireDmaBuf. returns true if succeeds */
+    bool releaseDmaBuf(int32_t streamID, const CapDmaBufLease *lease);
+
+    /** select the frame decode mode of a stream. returns true if succeeds */
+    bool setDecodeMode(int32_t streamID, uint32_t mode);
+
+    /** only publish every n-th frame of a stream. returns true if succeeds */
+    bool setOutputDecimation(int32_t streamID, uint32_t n);
+
+    /** limit the number of frames per second a stream publishes.
+        returns true if succeeds */
+    bool setMaxOutputFrameRate(int32_t streamID, uint32_t fps);
+
+    /** select how the driver hands frames to the library.
+        returns CAPRESULT_OK, CAPRESULT_FORMATNOTSUPPORTED or CAPRESULT_ERR */
+    CapResult setIOMode(int32_t streamID, uint32_t mode);
+
+    /** returns the I/O mode a stream uses */
+    uint32_t getIOMode(int32_t streamID);
+
+    /** set the number of driver buffers and the queue policy of a stream.
+        returns CAPRESULT_OK, CAPRESULT_FORMATNOTSUPPORTED or CAPRESULT_ERR */
+    CapResult setCaptureQueue(int32_t streamID, uint32_t bufferCount, uint32_t policy);
+
+    /** get the frame age statistics of a stream.
+        returns true if succeeds */
+    bool getLatencyStats(int32_t streamID, CapLatencyStats *stats);
+
+    /** reset the frame age statistics of a stream.
+        returns true if succeeds */
+    bool resetLatencyStats(int32_t streamID);
+
+    /** set the scheduling policy and CPU affinity of the capture thread of a stream.
+        returns CAPRESULT_OK, CAPRESULT_FORMATNOTSUPPORTED or CAPRESULT_ERR */
+    CapResult setThreadPolicy(int32_t streamID, uint32_t policy, int32_t priority, uint64_t cpuMask);
+
+    /** returns the number of FIFO overflows of a stream */
+    uint32_t getStreamOverflowCount(int32_t streamID);
 
     /** returns true if the stream has a new frame, false otherwise */
     bool hasNewFrame(int32_t streamID);
 
+    /** wait for a new frame to arrive, at most timeoutMs milliseconds.
+        returns CAPRESULT_OK, CAPRESULT_TIMEOUT or CAPRESULT_ERR */
+    CapResult waitForNewFrame(int32_t streamID, uint32_t timeoutMs);
+
     /** returns the number of frames captured during the lifetime of the stream */
     uint32_t getStreamFrameCount(int32_t streamID);
 
@@ -185,16 +300,37 @@ protected:
     virtual bool enumerateDevices() = 0;
 
     /** Store a stream pointer in the m_streams map
-        and return its unique ID */
-    int32_t storeStream(Stream *stream);
+        and return its unique ID. m_streamMutex must be held. */
+    int32_t storeStream(Stream *stream, CapDeviceID device, CapFormatID format);
 
-    /** Remove a stream from the m_streams map
-        and call delete on the object.
+    /** Return the stream of a stream ID, or nullptr if the ID is
+        unknown or closed. If 'cursor' is not NULL, it receives a
+        pointer to the read cursor of the ID, see StreamHandle.
+        Unlike m_streams[ID], this does not add an entry. */
+    Stream* lookupStream(int32_t ID, uint32_t **cursor = nullptr);
+
+    /** Remove a stream from the m_streams map and call
+        delete on the object, unless other stream IDs share it.
         Return true if this was successful */
     bool removeStream(int32_t ID);
 
+    /** Return the ID of an open stream on device 'id', or -1.
+        m_streamMutex must be held. */
+    int32_t findDeviceStream(CapDeviceID id) const;
+
+    /** Per stream ID state. Several stream IDs can share one 
+        Stream object, see openStream. */
+    struct StreamHandle
+    {
+        CapDeviceID device;     ///< index of the device the stream was opened on
+        CapFormatID format;     ///< index of the format the stream was opened with
+        uint32_t    cursor;     ///< sequence number of the last frame read through this ID
+    };
+
     std::vector<deviceInfo*>    m_devices;          ///< list of enumerated devices
     std::map<int32_t, Stream*>  m_streams;          ///< collection of streams
+    std::map<int32_t, StreamHandle> m_handles;      ///< per stream ID state, same keys as m_streams
+    std::mutex                  m_streamMutex;      ///< protects m_streams and m_handles
     int32_t                     m_streamCounter;    ///< counter to generate stream IDs
 };
 
@@ -0,0 +1,218 @@
+/*
+
+    OpenPnp-Capture: a video capture subsystem.
+
+    Ring of decoded frame buffers shared between the
+    capture thread and the consumers of a stream.
+
+    Copyright (c) 2017 Jason von Nieda, Niels Moseley.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+*/
+
+#include "framering.h"
+#include "logging.h"
+
+FrameRing::FrameRing() :
+    m_count(0),
+    m_slotBytes(0),
+    m_latest(-1),
+    m_nextWrite(0)
+{
+}
+
+FrameRing::~FrameRing()
+{
+    clear();
+}
+
+void FrameRing::allocate(uint32_t slots, size_t bytesPerSlot, uint32_t maxSlots)
+{
+    clear();
+
+    // the pointer array never changes size while the ring
+    // is in use, so readers can index it without locking.
+    m_slots.resize(maxSlots, nullptr);
+    m_slotBytes = bytesPerSlot;
+    grow(slots);
+
+    LOG(LOG_DEBUG, "FrameRing: allocated %d slots of %d bytes\n", slots, bytesPerSlot);
+}
+
+bool FrameRing::grow(uint32_t slots)
+{
+    if (slots > m_slots.size())
+    {
+        LOG(LOG_ERR, "FrameRing: cannot grow to %d slots (max %d)\n", slots, m_slots.size());
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_growMutex);
+    for(uint32_t i=m_count; i<slots; i++)
+    {
+        FrameSlot *slot = new FrameSlot();
+        slot->m_index = i;
+        slot->m_data.resize(m_slotBytes);
+        m_slots[i] = slot;
+        m_count.store(i+1, std::memory_order_release);
+    }
+    return true;
+}
+
+void FrameRing::clear()
+{
+    for(uint32_t i=0; i<m_count; i++)
+    {
+        if (m_slots[i]->m_state.load() != 0)
+        {
+            LOG(LOG_WARNING, "FrameRing: slot %d deleted while still in use!\n", i);
+        }
+        delete m_slots[i];
+    }
+    m_slots.clear();
+    m_count = 0;
+    m_slotBytes = 0;
+    m_latest = -1;
+    m_nextWrite = 0;
+}
+
+FrameSlot* FrameRing::acquireWrite()
+{
+    const uint32_t N = m_count.load(std::memory_order_acquire);
+    if (N == 0)
+    {
+        return nullptr;
+    }
+    const uint32_t start = m_nextWrite.load(std::memory_order_relaxed);
+    for(uint32_t i=0; i<N; i++)
+    {
+        uint32_t idx = (start + i) % N;
+        if (static_cast<int32_t>(idx) == m_latest.load(std::memory_order_acquire))
+        {
+            continue;
+        }
+
+        int32_t expected = 0;
+        FrameSlot *slot = m_slots[idx];
+        if (slot->m_state.compare_exchange_strong(expected, FrameSlot::c_slotWriting,
+            std::memory_order_acquire))
+        {
+            // another producer may have published this slot between
+            // the check above and the claim. Once we own it, it can
+            // no longer become the latest, so one re-check suffices.
+            if (static_cast<int32_t>(idx) == m_latest.load(std::memory_order_acquire))
+            {
+                slot->m_state.store(0, std::memory_order_release);
+                continue;
+            }
+            m_nextWrite.store((idx + 1) % N, std::memory_order_relaxed);
+            return slot;
+        }
+    }
+    return nullptr;
+}
+
+void FrameRing::publish(FrameSlot *slot)
+{
+    // make the slot the latest one while it is still marked as
+    // being written, so no other producer can claim it. Readers
+    // that see it in this short window retry until the state
+    // below is released.
+    m_latest.exchange(slot->m_index, std::memory_order_acq_rel);
+    slot->m_state.store(0, std::memory_order_release);
+}
+
+void FrameRing::cancelWrite(FrameSlot *slot)
+{
+    slot->m_state.store(0, std::memory_order_release);
+}
+
+FrameSlot* FrameRing::acquireRead()
+{
+    while(true)
+    {
+        int32_t latest = m_latest.load(std::memory_order_acquire);
+        if (latest < 0)
+        {
+            return nullptr;
+        }
+
+        FrameSlot *slot = m_slots[latest];
+        int32_t state = slot->m_state.load(std::memory_order_acquire);
+
+        // if a producer has claimed the slot since we read m_latest,
+        // a newer frame has been published: try again.
+        if ((state >= 0) && slot->m_state.compare_exchange_weak(state, state+1,
+            std::memory_order_acquire))
+        {
+            // the slot may have been claimed and given back with
+            // cancelWrite in between, holding a partly written
+            // frame. A slot only becomes the latest again through
+            // publish, so it is safe while it still is the latest.
+            if (m_latest.load(std::memory_order_acquire) == latest)
+            {
+                return slot;
+            }
+            slot->m_state.fetch_sub(1, std::memory_order_release);
+        }
+    }
+}
+
+bool FrameRing::pin(FrameSlot *slot, uint32_t sequence)
+{
+    int32_t state = slot->m_state.load(std::memory_order_acquire);
+    do
+    {
+        if (state < 0)
+        {
+            return false;
+        }
+    } while(!slot->m_state.compare_exchange_weak(state, state+1,
+        std::memory_order_acquire));
+
+    // the slot might have been re-used for a newer frame
+    if (slot->m_sequence != sequence)
+    {
+        slot->m_state.fetch_sub(1, std::memory_order_release);
+        return false;
+    }
+    return true;
+}
+
+bool FrameRing::releaseRead(uint32_t index, uint32_t sequence)
+{
+    if (index >= m_count.load(std::memory_order_acquire))
+    {
+        return false;
+    }
+
+    FrameSlot *slot = m_slots[index];
+    int32_t state = slot->m_state.load(std::memory_order_acquire);
+    do
+    {
+        if ((state <= 0) || (slot->m_sequence != sequence))
+        {
+            return false;
+        }
+    } while(!slot->m_state.compare_exchange_weak(state, state-1,
+        std::memory_order_release));
+
+    return true;
+}
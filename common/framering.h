@@ -0,0 +1,172 @@
+/*
+
+    OpenPnp-Capture: a video capture subsystem.
+
+    Ring of decoded frame buffers shared between the
+    capture thread and the consumers of a stream.
+
+    Copyright (c) 2017 Jason von Nieda, Niels Moseley.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#ifndef framering_h
+#define framering_h
+
+#include <stdint.h>
+#include <stdlib.h> // size_t
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <memory.h>
+#include "openpnp-capture.h"
+#include "bufferpool.h"
+
+/** A single frame buffer in the FrameRing */
+struct FrameSlot
+{
+    FrameSlot() :
+        m_index(0),
+        m_width(0),
+        m_height(0),
+        m_stride(0),
+        m_bytes(0),
+        m_format(CAPFORMAT_RGB24),
+        m_scale(1),
+        m_sequence(0),
+        m_rawBytes(0),
+        m_rawFourCC(0),
+        m_decoded(true),
+        m_state(0)
+    {
+        memset(&m_info, 0, sizeof(m_info));
+    }
+
+    FrameBuffer m_data;             ///< frame data
+    uint32_t    m_index;            ///< index of this slot in the ring
+    uint32_t    m_width;            ///< width of the frame in pixels
+    uint32_t    m_height;           ///< height of the frame in pixels
+    uint32_t    m_stride;           ///< number of bytes between two consecutive rows
+    uint32_t    m_bytes;            ///< number of valid bytes in m_data
+    uint32_t    m_format;           ///< pixel format of m_data (CAPFORMAT_xxx)
+    uint32_t    m_scale;            ///< the frame is 1/m_scale of the camera resolution
+    uint32_t    m_sequence;         ///< frame sequence number
+    CapFrameInfo m_info;            ///< frame metadata
+
+    FrameBuffer m_raw;              ///< undecoded payload, see Stream::storePayload
+    uint32_t    m_rawBytes;         ///< number of valid bytes in m_raw
+    uint32_t    m_rawFourCC;        ///< FOURCC of the payload in m_raw
+    std::atomic<bool> m_decoded;    ///< false if m_data does not hold the decoded payload yet
+    std::mutex  m_decodeMutex;      ///< serializes readers decoding the payload
+
+    /** Ownership of the slot: c_slotWriting if a producer is
+        writing to it, otherwise the number of readers that
+        have pinned it. */
+    std::atomic<int32_t> m_state;
+
+    static const int32_t c_slotWriting = -1;
+};
+
+/** The FrameRing holds a small number of decoded frames.
+
+    The producer (capture thread) writes into a slot that
+    is not visible to readers and publishes it when the
+    frame is complete. Readers pin the most recently
+    published slot, which guarantees the producer will
+    not touch it until it is released again.
+
+    The bookkeeping is lock-free: a producer claims a slot
+    by swapping its state from 0 to c_slotWriting and
+    publishes it with a single atomic exchange of m_latest.
+    Readers never wait for a producer to finish decoding.
+
+    allocate() and clear() must not be called while
+    producers or readers are active. grow() can be called
+    at any time.
+*/
+class FrameRing
+{
+public:
+    FrameRing();
+    virtual ~FrameRing();
+
+    /** Allocate 'slots' frame buffers of 'bytesPerSlot' bytes each.
+        The ring can later grow to at most 'maxSlots' slots.
+        Any previously allocated slots are deleted. */
+    void allocate(uint32_t slots, size_t bytesPerSlot, uint32_t maxSlots);
+
+    /** Add slots until there are at least 'slots' slots.
+        Returns false if this exceeds the maximum number of slots. */
+    bool grow(uint32_t slots);
+
+    /** Return the number of slots */
+    uint32_t getSlotCount() const
+    {
+        return m_count;
+    }
+
+    /** Delete all slots. Outstanding pointers to slots become invalid. */
+    void clear();
+
+    /** Return the size of each slot in bytes, or 0 if no slots are allocated */
+    size_t getSlotBytes() const
+    {
+        return m_slotBytes;
+    }
+
+    /** Get a slot the producer can write to. The slot is not
+        the most recently published one and it is not pinned
+        by a reader. Returns nullptr if no such slot exists.
+    */
+    FrameSlot* acquireWrite();
+
+    /** Make a slot obtained by acquireWrite the most recently
+        published frame. */
+    void publish(FrameSlot *slot);
+
+    /** Return a slot obtained by acquireWrite without publishing it */
+    void cancelWrite(FrameSlot *slot);
+
+    /** Pin the most recently published slot and return it.
+        Returns nullptr if no frame has been published yet.
+        The slot must be returned with releaseRead.
+    */
+    FrameSlot* acquireRead();
+
+    /** Pin a specific slot, provided it still holds the frame with
+        the given sequence number. Returns false otherwise.
+        The slot must be returned with releaseRead.
+    */
+    bool pin(FrameSlot *slot, uint32_t sequence);
+
+    /** Unpin a slot with a certain index and sequence number.
+        Returns false if the slot was not pinned.
+    */
+    bool releaseRead(uint32_t index, uint32_t sequence);
+
+protected:
+    std::vector<FrameSlot*> m_slots;        ///< frame slots, the first m_count entries are valid
+    std::atomic<uint32_t>   m_count;        ///< number of allocated slots
+    size_t                  m_slotBytes;    ///< size of each slot in bytes
+    std::atomic<int32_t>    m_latest;       ///< index of the most recently published slot or -1
+    std::atomic<uint32_t>   m_nextWrite;    ///< index where the search for a free slot starts
+    std::mutex              m_growMutex;    ///< serializes grow()
+};
+
+#endif
@@ -30,6 +30,7 @@
 #include "openpnp-capture.h"
 #include "context.h"
 #include "logging.h"
+#include "bufferpool.h"
 #include "version.h"
 
 // Define a PlatformContext factory call 
@@ -58,6 +59,26 @@ DLLPUBLIC CapResult Cap_releaseContext(CapContext ctx)
     return CAPRESULT_ERR;
 }
 
+DLLPUBLIC CapResult Cap_setReactorThreads(CapContext ctx, uint32_t threads)
+{
+    if (ctx != 0)
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->setReactorThreads(threads);
+    }
+    return CAPRESULT_ERR;
+}
+
+DLLPUBLIC CapResult Cap_setDecodeThreads(CapContext ctx, uint32_t threads)
+{
+    if (ctx != 0)
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->setDecodeThreads(threads);
+    }
+    return CAPRESULT_ERR;
+}
+
 DLLPUBLIC uint32_t Cap_getDeviceCount(CapContext ctx)
 {
     if (ctx != 0)
@@ -111,6 +132,22 @@ DLLPUBLIC void Cap_setLogLevel(uint32_t level)
     setLogLevel(level);
 }
 
+DLLPUBLIC CapResult Cap_configureBufferPool(uint32_t flags, uint64_t maxCachedBytes)
+{
+    BufferPool::instance().configure(flags, maxCachedBytes);
+    return CAPRESULT_OK;
+}
+
+DLLPUBLIC CapResult Cap_getBufferPoolStats(CapBufferPoolStats *stats)
+{
+    if (stats == nullptr)
+    {
+        return CAPRESULT_ERR;
+    }
+    BufferPool::instance().getStats(stats);
+    return CAPRESULT_OK;
+}
+
 DLLPUBLIC CapStream Cap_openStream(CapContext ctx, CapDeviceID index, CapFormatID formatID)
 {
     if (ctx != 0)
@@ -146,7 +183,71 @@ DLLPUBLIC CapResult Cap_captureFrame(CapContext ctx, CapStream stream, void *RGB
     if (ctx != 0)
     {
         Context *c = reinterpret_cast<Context*>(ctx);
-        return c->captureFrame(stream, (uint8_t*)RGBbufferPtr, RGBbufferBytes) ? CAPRESULT_OK : CAPRESULT_ERR;
+        return c->captureFrame(stream, (uint8_t*)RGBbufferPtr, RGBbufferBytes, 0, nullptr) ? CAPRESULT_OK : CAPRESULT_ERR;
+    }    
+    return CAPRESULT_ERR;
+}
+
+DLLPUBLIC CapResult Cap_captureFrameEx(CapContext ctx, CapStream stream, void *RGBbufferPtr, uint32_t RGBbufferBytes,
+    CapFrameInfo *info)
+{
+    if (ctx != 0)
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->captureFrame(stream, (uint8_t*)RGBbufferPtr, RGBbufferBytes, 0, info) ? CAPRESULT_OK : CAPRESULT_ERR;
+    }    
+    return CAPRESULT_ERR;
+}
+
+DLLPUBLIC CapResult Cap_captureFrameStrided(CapContext ctx, CapStream stream, void *bufferPtr, uint32_t bufferBytes,
+    uint32_t stride, CapFrameInfo *info)
+{
+    if (ctx != 0)
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->captureFrame(stream, (uint8_t*)bufferPtr, bufferBytes, stride, info) ? CAPRESULT_OK : CAPRESULT_ERR;
+    }    
+    return CAPRESULT_ERR;
+}
+
+DLLPUBLIC CapResult Cap_captureFrameROI(CapContext ctx, CapStream stream, const CapROI *rois, uint32_t roiCount,
+    CapFrameInfo *info)
+{
+    if (ctx != 0)
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->captureFrameROI(stream, rois, roiCount, info);
+    }    
+    return CAPRESULT_ERR;
+}
+
+DLLPUBLIC CapResult Cap_captureRawFrame(CapContext ctx, CapStream stream, void *buffer, uint32_t bufferBytes,
+    uint32_t *payloadBytes, uint32_t *fourCC, CapFrameInfo *info)
+{
+    if (ctx != 0)
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->captureRawFrame(stream, (uint8_t*)buffer, bufferBytes, payloadBytes, fourCC, info);
+    }    
+    return CAPRESULT_ERR;
+}
+
+DLLPUBLIC CapResult Cap_acquireFrame(CapContext ctx, CapStream stream, CapFrameLease *lease)
+{
+    if (ctx != 0)
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->acquireFrame(stream, lease);
+    }    
+    return CAPRESULT_ERR;
+}
+
+DLLPUBLIC CapResult Cap_releaseFrame(CapContext ctx, CapStream stream, const CapFrameLease *lease)
+{
+    if (ctx != 0)
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->releaseFrame(stream, lease) ? CAPRESULT_OK : CAPRESULT_ERR;
     }    
     return CAPRESULT_ERR;
 }
@@ -161,6 +262,228 @@ DLLPUBLIC uint32_t Cap_hasNewFrame(CapContext ctx, CapStream stream)
     return 0;
 }
 
+DLLPUBLIC CapResult Cap_waitForNewFrame(CapContext ctx, CapStream stream, uint32_t timeoutMs)
+{
+    if (ctx != 0)
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->waitForNewFrame(stream, timeoutMs);
+    }    
+    return CAPRESULT_ERR;
+}
+
+DLLPUBLIC CapResult Cap_setFrameCallback(CapContext ctx, CapStream stream, CapFrameCallback callback, void *user)
+{
+    if (ctx != 0)
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->setFrameCallback(stream, callback, user) ? CAPRESULT_OK : CAPRESULT_ERR;
+    }    
+    return CAPRESULT_ERR;
+}
+
+DLLPUBLIC CapResult Cap_setDeliveryMode(CapContext ctx, CapStream stream, uint32_t mode, uint32_t depth, uint32_t overflowPolicy)
+{
+    if (ctx != 0)
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->setDeliveryMode(stream, mode, depth, overflowPolicy) ? CAPRESULT_OK : CAPRESULT_ERR;
+    }    
+    return CAPRESULT_ERR;
+}
+
+DLLPUBLIC CapResult Cap_setOutputFormat(CapContext ctx, CapStream stream, uint32_t format)
+{
+    if (ctx != 0)
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->setOutputFormat(stream, format);
+    }    
+    return CAPRESULT_ERR;
+}
+
+DLLPUBLIC uint32_t Cap_getOutputFrameBytes(CapContext ctx, CapStream stream)
+{
+    if (ctx != 0)
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->getOutputFrameBytes(stream);
+    }
+    return 0;
+}
+
+DLLPUBLIC CapResult Cap_setOutputScale(CapContext ctx, CapStream stream, uint32_t denom)
+{
+    if (ctx != 0)
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->setOutputScale(stream, denom);
+    }    
+    return CAPRESULT_ERR;
+}
+
+DLLPUBLIC CapResult Cap_getOutputFrameSize(CapContext ctx, CapStream stream, uint32_t *width, uint32_t *height)
+{
+    if (ctx != 0)
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->getOutputFrameSize(stream, width, height) ? CAPRESULT_OK : CAPRESULT_ERR;
+    }    
+    return CAPRESULT_ERR;
+}
+
+DLLPUBLIC CapResult Cap_setDecodeMode(CapContext ctx, CapStream stream, uint32_t mode)
+{
+    if (ctx != 0)
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->setDecodeMode(stream, mode) ? CAPRESULT_OK : CAPRESULT_ERR;
+    }    
+    return CAPRESULT_ERR;
+}
+
+DLLPUBLIC CapResult Cap_setOutputDecimation(CapContext ctx, CapStream stream, uint32_t n)
+{
+    if (ctx != 0)
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->setOutputDecimation(stream, n) ? CAPRESULT_OK : CAPRESULT_ERR;
+    }    
+    return CAPRESULT_ERR;
+}
+
+DLLPUBLIC CapResult Cap_setMaxOutputFrameRate(CapContext ctx, CapStream stream, uint32_t fps)
+{
+    if (ctx != 0)
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->setMaxOutputFrameRate(stream, fps) ? CAPRESULT_OK : CAPRESULT_ERR;
+    }    
+    return CAPRESULT_ERR;
+}
+
+DLLPUBLIC CapResult Cap_setDmaBufExport(CapContext ctx, CapStream stream, uint32_t enable)
+{
+    if (ctx != 0)
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->setDmaBufExport(stream, enable != 0);
+    }    
+    return CAPRESULT_ERR;
+}
+
+DLLPUBLIC CapResult Cap_acquireDmaBuf(CapContext ctx, CapStream stream, CapDmaBufLease *lease)
+{
+    if (ctx != 0)
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->acquireDmaBuf(stream, lease);
+    }    
+    return CAPRESULT_ERR;
+}
+
+DLLPUBLIC CapResult Cap_releaseDmaBuf(CapContext ctx, CapStream stream, const CapDmaBufLease *lease)
+{
+    if (ctx != 0)
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->releaseDmaBuf(stream, lease) ? CAPRESULT_OK : CAPRESULT_ERR;
+    }    
+    return CAPRESULT_ERR;
+}
+
+DLLPUBLIC CapResult Cap_setSharedMemoryExport(CapContext ctx, CapStream stream, const char *name, uint32_t slotCount)
+{
+    if (ctx != 0)
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->setSharedMemoryExport(stream, name, slotCount) ? CAPRESULT_OK : CAPRESULT_ERR;
+    }    
+    return CAPRESULT_ERR;
+}
+
+DLLPUBLIC uint32_t Cap_getStreamOverflowCount(CapContext ctx, CapStream stream)
+{
+    if (ctx != 0)
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->getStreamOverflowCount(stream);
+    }
+    return 0;
+}
+
+DLLPUBLIC CapResult Cap_setIOMode(CapContext ctx, CapStream stream, uint32_t mode)
+{
+    if (ctx != 0)
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->setIOMode(stream, mode);
+    }    
+    return CAPRESULT_ERR;
+}
+
+DLLPUBLIC uint32_t Cap_getIOMode(CapContext ctx, CapStream stream)
+{
+    if (ctx != 0)
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->getIOMode(stream);
+    }
+    return CAPIO_MMAP;
+}
+
+DLLPUBLIC CapResult Cap_setCaptureQueue(CapContext ctx, CapStream stream, uint32_t bufferCount, uint32_t policy)
+{
+    if (ctx != 0)
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->setCaptureQueue(stream, bufferCount, policy);
+    }
+    return CAPRESULT_ERR;
+}
+
+DLLPUBLIC CapResult Cap_getLatencyStats(CapContext ctx, CapStream stream, CapLatencyStats *stats)
+{
+    if ((ctx != 0) && (stats != nullptr))
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->getLatencyStats(stream, stats) ? CAPRESULT_OK : CAPRESULT_ERR;
+    }
+    return CAPRESULT_ERR;
+}
+
+DLLPUBLIC CapResult Cap_resetLatencyStats(CapContext ctx, CapStream stream)
+{
+    if (ctx != 0)
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->resetLatencyStats(stream) ? CAPRESULT_OK : CAPRESULT_ERR;
+    }
+    return CAPRESULT_ERR;
+}
+
+DLLPUBLIC CapResult Cap_setThreadPolicy(CapContext ctx, CapStream stream, uint32_t policy, 
+    int32_t priority, uint64_t cpuMask)
+{
+    if (ctx != 0)
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->setThreadPolicy(stream, policy, priority, cpuMask);
+    }
+    return CAPRESULT_ERR;
+}
+
+DLLPUBLIC CapResult Cap_setDefaultThreadPolicy(CapContext ctx, uint32_t policy, 
+    int32_t priority, uint64_t cpuMask)
+{
+    if (ctx != 0)
+    {
+        Context *c = reinterpret_cast<Context*>(ctx);
+        return c->setDefaultThreadPolicy(policy, priority, cpuMask);
+    }
+    return CAPRESULT_ERR;
+}
+
 DLLPUBLIC uint32_t Cap_getStreamFrameCount(CapContext ctx, CapStream stream)
 {
     if (ctx != 0)
@@ -27,10 +27,24 @@
 */
 
 #include <memory.h> // for memcpy
+#include <chrono>
 #include "stream.h"
 #include "context.h"
 
 
+// Number of slots in the frame ring: one for the capture thread to
+// write into, one holding the most recent frame and two that can
+// be leased by the application while capturing continues.
+static const uint32_t c_frameSlots = 4;
+
+// Maximum number of slots handed to the driver to capture
+// into, see reserveDriverSlots. V4L2 has at most 32 buffers.
+static const uint32_t c_maxDriverSlots = 32;
+
+// Maximum number of slots, reached in FIFO mode at maximum depth
+// while the driver captures into the slots.
+static const uint32_t c_maxFrameSlots = c_frameSlots + CAPDELIVERY_MAXDEPTH + c_maxDriverSlots;
+
 // **********************************************************************
 //   Stream
 // **********************************************************************
@@ -38,39 +52,1189 @@
 Stream::Stream() :
     m_owner(nullptr),
     m_isOpen(false),
-    m_frames(0)
+    m_newFrame(false),
+    m_published(0),
+    m_frames(0),
+    m_deviceDropped(0),
+    m_libraryDropped(0),
+    m_lastDeviceSequence(0),
+    m_haveDeviceSequence(false),
+    m_waiters(0),
+    m_cancelWait(false),
+    m_fifoEnabled(false),
+    m_fifoCancelled(false),
+    m_fifoMayBlock(true),
+    m_fifoDepth(0),
+    m_overflowPolicy(CAPOVERFLOW_DROPOLDEST),
+    m_fifo(CAPDELIVERY_MAXDEPTH, nullptr),
+    m_fifoHead(0),
+    m_fifoCount(0),
+    m_fifoReserved(0),
+    m_overflows(0),
+    m_lazyDecode(false),
+    m_outputFormat(CAPFORMAT_RGB24),
+    m_outputScale(1),
+    m_decimation(1),
+    m_outputInterval(0),
+    m_decimationCount(0),
+    m_nextOutputTime(0),
+    m_driverSlots(0),
+    m_ageFrames(0),
+    m_staleFrames(0),
+    m_ageSum(0),
+    m_ageLast(0),
+    m_ageMax(0),
+    m_pipelineFrames(0),
+    m_pipelineDelaySum(0),
+    m_pipelineDelayMax(0),
+    m_callback(nullptr),
+    m_callbackUser(nullptr)
 {
 }
 
 Stream::~Stream()
 {
-    LOG(LOG_DEBUG,"Stream::~Stream reports %d frames captured.\n", m_frames);
+    LOG(LOG_DEBUG,"Stream::~Stream reports %d frames captured.\n", m_frames.load());
     //Note: close() should be called/handled by the PlatformStream!
 }
 
-bool Stream::hasNewFrame()
+bool Stream::hasNewFrame(uint32_t cursor)
 {
-    m_bufferMutex.lock();
-    bool ok = m_newFrame;
-    m_bufferMutex.unlock();
-    return ok;
+    if (m_fifoEnabled)
+    {
+        return m_newFrame.load();
+    }
+    return m_published.load() != cursor;
+}
+
+CapResult Stream::waitForNewFrame(uint32_t timeoutMs, uint32_t cursor, int32_t handle)
+{
+    if (!addWaiter(handle))
+    {
+        return CAPRESULT_ERR;
+    }
+    return waitRegistered(timeoutMs, cursor, handle);
+}
+
+bool Stream::addWaiter(int32_t handle)
+{
+    std::lock_guard<std::mutex> lock(m_waitMutex);
+    if (m_cancelWait || (m_cancelledHandles.count(handle) != 0))
+    {
+        return false;
+    }
+
+    m_waiters++;
+    m_handleWaiters[handle]++;
+    return true;
+}
+
+CapResult Stream::waitRegistered(uint32_t timeoutMs, uint32_t cursor, int32_t handle)
+{
+    std::unique_lock<std::mutex> lock(m_waitMutex);
+    bool ok = m_frameCond.wait_for(lock, std::chrono::milliseconds(timeoutMs), 
+        [this, cursor, handle]{ return hasNewFrame(cursor) || m_cancelWait || 
+            (m_cancelledHandles.count(handle) != 0); });
+    m_waiters--;
+    if (--m_handleWaiters[handle] == 0)
+    {
+        m_handleWaiters.erase(handle);
+    }
+
+    if (m_cancelWait || (m_cancelledHandles.count(handle) != 0))
+    {
+        // let cancelWaiters know we're leaving
+        m_frameCond.notify_all();
+        return CAPRESULT_ERR;
+    }
+
+    return ok ? CAPRESULT_OK : CAPRESULT_TIMEOUT;
 }
 
-bool Stream::captureFrame(uint8_t *RGBbufferPtr, uint32_t RGBbufferBytes)
+void Stream::cancelWaiters()
+{
+    // release a capture thread that waits for room in the FIFO
+    setFifoCancelled(true);
+
+    std::unique_lock<std::mutex> lock(m_waitMutex);
+    m_cancelWait = true;
+    m_frameCond.notify_all();
+    m_frameCond.wait(lock, [this]{ return m_waiters == 0; });
+}
+
+void Stream::cancelHandleWaiters(int32_t handle)
+{
+    // stream IDs are not re-used, so the ID stays 
+    // cancelled for as long as the stream exists.
+    std::unique_lock<std::mutex> lock(m_waitMutex);
+    m_cancelledHandles.insert(handle);
+    m_frameCond.notify_all();
+    m_frameCond.wait(lock, [this, handle]{ return m_handleWaiters.count(handle) == 0; });
+}
+
+bool Stream::captureFrame(uint8_t *RGBbufferPtr, uint32_t RGBbufferBytes, uint32_t stride, CapFrameInfo *info,
+    uint32_t *cursor)
 {
     if (!m_isOpen) return false;
 
-    m_bufferMutex.lock();    
-    size_t maxBytes = RGBbufferBytes <= m_frameBuffer.size() ? RGBbufferBytes : m_frameBuffer.size();
-    if (maxBytes != 0)
+    FrameSlot *slot = takeFrame(cursor);
+    if (slot == nullptr)
+    {
+        if (info != nullptr)
+        {
+            memset(info, 0, sizeof(CapFrameInfo));
+        }
+        // an empty FIFO is an error, for compatibility
+        // a stream without frames is not.
+        return !m_fifoEnabled;
+    }
+
+    bool ok = true;
+    if ((stride == 0) || (slot->m_format == CAPFORMAT_NATIVE))
+    {
+        // tightly packed destination
+        ok = decodeSlot(slot);
+        if (ok)
+        {
+            size_t maxBytes = RGBbufferBytes <= slot->m_bytes ? RGBbufferBytes : slot->m_bytes;
+            if (maxBytes != 0)
+            {
+                memcpy(RGBbufferPtr, &slot->m_data[0], maxBytes);
+            }
+        }
+    }
+    else if ((stride < getMinStride(slot->m_format, slot->m_width)) ||
+        (RGBbufferBytes < getFrameBytes(slot->m_format, slot->m_width, slot->m_height, stride)))
+    {
+        LOG(LOG_ERR, "captureFrame: stride %d or buffer size %d too small\n", stride, RGBbufferBytes);
+        ok = false;
+    }
+    else if (!slot->m_decoded.load(std::memory_order_acquire))
+    {
+        // decode straight into the destination. The frame is
+        // not cached, so this is the only pass over the data.
+        ok = decodePayload(slot, RGBbufferPtr, stride);
+    }
+    else
+    {
+        copyFrame(slot, RGBbufferPtr, stride);
+    }
+
+    if (info != nullptr)
+    {
+        if (ok)
+        {
+            *info = slot->m_info;
+        }
+        else
+        {
+            memset(info, 0, sizeof(CapFrameInfo));
+        }
+    }
+    m_frameRing.releaseRead(slot->m_index, slot->m_sequence);
+    return ok;
+}
+
+FrameSlot* Stream::takeFrame(uint32_t *cursor)
+{
+    FrameSlot *slot = m_fifoEnabled ? popFifo() : m_frameRing.acquireRead();
+    if ((slot != nullptr) && (cursor != nullptr))
+    {
+        *cursor = slot->m_sequence;
+    }
+    return slot;
+}
+
+void Stream::copyRegion(const FrameSlot *slot, const CapROI &roi, uint32_t dstStride)
+{
+    const uint32_t pixelBytes = getMinStride(slot->m_format, 1);
+    const uint8_t *src = &slot->m_data[roi.y*slot->m_stride + roi.x*pixelBytes];
+    uint8_t *dst = static_cast<uint8_t*>(roi.buffer);
+    for(uint32_t y=0; y<roi.height; y++)
+    {
+        memcpy(dst + y*dstStride, src + y*slot->m_stride, roi.width*pixelBytes);
+    }
+}
+
+void Stream::copyFrame(const FrameSlot *slot, uint8_t *dst, uint32_t dstStride)
+{
+    const uint8_t *src = &slot->m_data[0];
+    const uint32_t rowBytes = getMinStride(slot->m_format, slot->m_width);
+    uint32_t rows = slot->m_height;
+    if (slot->m_format == CAPFORMAT_NV12)
+    {
+        // the interleaved chroma plane has the same stride
+        rows += (slot->m_height+1)/2;
+    }
+
+    if (dstStride == slot->m_stride)
+    {
+        memcpy(dst, src, getFrameBytes(slot->m_format, slot->m_width, slot->m_height, dstStride));
+        return;
+    }
+
+    for(uint32_t y=0; y<rows; y++)
+    {
+        memcpy(dst + y*dstStride, src + y*slot->m_stride, rowBytes);
+    }
+
+    if (slot->m_format == CAPFORMAT_I420)
+    {
+        const uint32_t srcChromaStride = (slot->m_stride+1)/2;
+        const uint32_t dstChromaStride = (dstStride+1)/2;
+        const uint32_t chromaRows = 2*((slot->m_height+1)/2);  // U and V
+        src += slot->m_stride*slot->m_height;
+        dst += dstStride*slot->m_height;
+        for(uint32_t y=0; y<chromaRows; y++)
+        {
+            memcpy(dst + y*dstChromaStride, src + y*srcChromaStride, (slot->m_width+1)/2);
+        }
+    }
+}
+
+CapResult Stream::captureFrameROI(const CapROI *rois, uint32_t count, CapFrameInfo *info,
+    uint32_t *cursor)
+{
+    if ((!m_isOpen) || (rois == nullptr)) return CAPRESULT_ERR;
+
+    FrameSlot *slot = takeFrame(cursor);
+    if (slot == nullptr)
+    {
+        if (info != nullptr)
+        {
+            memset(info, 0, sizeof(CapFrameInfo));
+        }
+        return CAPRESULT_NOFRAME;
+    }
+
+    // check all regions before writing anything
+    const uint32_t pixelBytes = getMinStride(slot->m_format, 1);
+    bool ok = true;
+    if ((slot->m_format == CAPFORMAT_NV12) || (slot->m_format == CAPFORMAT_I420) ||
+        (slot->m_format == CAPFORMAT_NATIVE))
+    {
+        LOG(LOG_ERR, "captureFrameROI: regions require a packed or gray output format\n");
+        ok = false;
+    }
+
+    uint64_t area = 0;
+    for(uint32_t i=0; ok && (i<count); i++)
+    {
+        const CapROI &roi = rois[i];
+        const uint32_t stride = (roi.stride == 0) ? roi.width*pixelBytes : roi.stride;
+        if ((roi.buffer == nullptr) || (roi.width == 0) || (roi.height == 0) ||
+            (roi.x >= slot->m_width) || (roi.width > (slot->m_width - roi.x)) ||
+            (roi.y >= slot->m_height) || (roi.height > (slot->m_height - roi.y)) ||
+            (stride < roi.width*pixelBytes) || (roi.bufferBytes < stride*roi.height))
+        {
+            LOG(LOG_ERR, "captureFrameROI: region %d is invalid\n", i);
+            ok = false;
+        }
+        area += static_cast<uint64_t>(roi.width)*roi.height;
+    }
+
+    // when the regions cover a large part of the frame, decoding
+    // the whole frame once is cheaper and the result is cached.
+    if (ok && (!slot->m_decoded.load(std::memory_order_acquire)) &&
+        (area*2 > static_cast<uint64_t>(slot->m_width)*slot->m_height))
+    {
+        ok = decodeSlot(slot);
+    }
+
+    for(uint32_t i=0; ok && (i<count); i++)
+    {
+        const CapROI &roi = rois[i];
+        const uint32_t stride = (roi.stride == 0) ? roi.width*pixelBytes : roi.stride;
+        if (slot->m_decoded.load(std::memory_order_acquire) || 
+            (!decodePayloadRegion(slot, roi, stride)))
+        {
+            ok = decodeSlot(slot);
+            if (ok)
+            {
+                copyRegion(slot, roi, stride);
+            }
+        }
+    }
+
+    if (info != nullptr)
+    {
+        if (ok)
+        {
+            *info = slot->m_info;
+        }
+        else
+        {
+            memset(info, 0, sizeof(CapFrameInfo));
+        }
+    }
+    m_frameRing.releaseRead(slot->m_index, slot->m_sequence);
+    return ok ? CAPRESULT_OK : CAPRESULT_ERR;
+}
+
+CapResult Stream::captureRawFrame(uint8_t *buffer, uint32_t bufferBytes, uint32_t *payloadBytes,
+    uint32_t *fourCC, CapFrameInfo *info, uint32_t *cursor)
+{
+    if ((!m_isOpen) || (buffer == nullptr) || (payloadBytes == nullptr)) return CAPRESULT_ERR;
+
+    *payloadBytes = 0;
+    if (fourCC != nullptr)
+    {
+        *fourCC = 0;
+    }
+    if (info != nullptr)
+    {
+        memset(info, 0, sizeof(CapFrameInfo));
+    }
+
+    FrameSlot *slot = takeFrame(cursor);
+    if (slot == nullptr)
+    {
+        return CAPRESULT_NOFRAME;
+    }
+
+    // the payload is kept in m_raw when the frame is decoded
+    // from it, or is the frame data itself in native format.
+    const uint8_t *payload = nullptr;
+    uint32_t bytes = 0;
+    if (slot->m_rawBytes != 0)
+    {
+        payload = &slot->m_raw[0];
+        bytes   = slot->m_rawBytes;
+    }
+    else if (slot->m_format == CAPFORMAT_NATIVE)
+    {
+        payload = &slot->m_data[0];
+        bytes   = slot->m_bytes;
+    }
+
+    CapResult result = CAPRESULT_OK;
+    if (payload == nullptr)
+    {
+        LOG(LOG_ERR, "captureRawFrame: the frame has no camera payload\n");
+        result = CAPRESULT_FORMATNOTSUPPORTED;
+    }
+    else
+    {
+        *payloadBytes = bytes;
+        if (fourCC != nullptr)
+        {
+            *fourCC = slot->m_rawFourCC;
+        }
+
+        if (bufferBytes < bytes)
+        {
+            LOG(LOG_ERR, "captureRawFrame: the buffer is too small (%d < %d bytes)\n", bufferBytes, bytes);
+            result = CAPRESULT_ERR;
+        }
+        else
+        {
+            memcpy(buffer, payload, bytes);
+            if (info != nullptr)
+            {
+                *info = slot->m_info;
+            }
+        }
+    }
+
+    m_frameRing.releaseRead(slot->m_index, slot->m_sequence);
+    return result;
+}
+
+bool Stream::acquireFrame(CapFrameLease *lease, uint32_t *cursor)
+{
+    if ((!m_isOpen) || (lease == nullptr)) return false;
+
+    // in FIFO mode, the pin held by the queue
+    // is handed over to the lease
+    FrameSlot *slot = takeFrame(cursor);
+    if (slot == nullptr)
+    {
+        return false;
+    }
+
+    if (!decodeSlot(slot))
+    {
+        m_frameRing.releaseRead(slot->m_index, slot->m_sequence);
+        return false;
+    }
+
+    fillLease(slot, lease);
+    return true;
+}
+
+bool Stream::releaseFrame(const CapFrameLease *lease)
+{
+    if (lease == nullptr) return false;
+
+    if (!m_frameRing.releaseRead(lease->slot, lease->sequence))
+    {
+        LOG(LOG_ERR, "releaseFrame: frame %d was not leased\n", lease->sequence);
+        return false;
+    }
+    return true;
+}
+
+bool Stream::setDeliveryMode(uint32_t mode, uint32_t depth, uint32_t overflowPolicy)
+{
+    if (mode == CAPDELIVERY_LATEST)
+    {
+        std::lock_guard<std::mutex> lock(m_fifoMutex);
+        m_fifoEnabled = false;
+        flushFifo();
+        m_fifoCond.notify_all();
+        return true;
+    }
+
+    if ((mode != CAPDELIVERY_FIFO) || (depth == 0) || (depth > CAPDELIVERY_MAXDEPTH) ||
+        (overflowPolicy > CAPOVERFLOW_BLOCK))
+    {
+        LOG(LOG_ERR, "setDeliveryMode: invalid arguments (mode=%d depth=%d policy=%d)\n",
+            mode, depth, overflowPolicy);
+        return false;
+    }
+
+    // every queued frame occupies a slot, so make sure
+    // the capture thread and the leases still have room.
+    if ((m_frameRing.getSlotBytes() != 0) && (!m_frameRing.grow(depth + c_frameSlots + m_driverSlots)))
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_fifoMutex);
+    m_fifoDepth = depth;
+    m_overflowPolicy = overflowPolicy;
+    while(m_fifoCount > m_fifoDepth)
+    {
+        FrameSlot *slot = m_fifo[m_fifoHead];
+        m_frameRing.releaseRead(slot->m_index, slot->m_sequence);
+        m_fifoHead = (m_fifoHead + 1) % m_fifo.size();
+        m_fifoCount--;
+    }
+    m_newFrame = (m_fifoCount != 0);
+    m_fifoEnabled = true;
+    m_fifoCond.notify_all();
+    return true;
+}
+
+void Stream::setFifoCancelled(bool cancelled)
+{
+    m_fifoMutex.lock();
+    m_fifoCancelled = cancelled;
+    m_fifoMutex.unlock();
+    m_fifoCond.notify_all();
+}
+
+void Stream::setFifoMayBlock(bool mayBlock)
+{
+    std::lock_guard<std::mutex> lock(m_fifoMutex);
+    m_fifoMayBlock = mayBlock;
+}
+
+bool Stream::makeFifoRoom(bool reserve)
+{
+    std::unique_lock<std::mutex> lock(m_fifoMutex);
+
+    // admitted frames that are still being decoded
+    // take up room as if they were queued already
+    if ((!m_fifoEnabled) || (m_fifoCount + m_fifoReserved < m_fifoDepth))
+    {
+        m_fifoReserved += reserve ? 1 : 0;
+        return true;
+    }
+
+    m_overflows++;
+    switch(m_overflowPolicy)
+    {
+    case CAPOVERFLOW_DROPNEWEST:
+        m_libraryDropped++;
+        return false;
+    case CAPOVERFLOW_BLOCK:
+        if (!m_fifoMayBlock)
+        {
+            m_libraryDropped++;
+            return false;
+        }
+        m_fifoCond.wait(lock, [this]{ return (m_fifoCount + m_fifoReserved < m_fifoDepth) 
+            || (!m_fifoEnabled) || m_fifoCancelled; });
+        if (m_fifoCancelled)
+        {
+            m_libraryDropped++;
+            return false;
+        }
+        m_fifoReserved += reserve ? 1 : 0;
+        return true;
+    default:
+    case CAPOVERFLOW_DROPOLDEST:
+        // when only admitted frames take up the room,
+        // pushFifo drops the oldest once they arrive.
+        if (m_fifoCount != 0)
+        {
+            FrameSlot *slot = m_fifo[m_fifoHead];
+            m_frameRing.releaseRead(slot->m_index, slot->m_sequence);
+            m_fifoHead = (m_fifoHead + 1) % m_fifo.size();
+            m_fifoCount--;
+            m_libraryDropped++;
+        }
+        m_fifoReserved += reserve ? 1 : 0;
+        return true;
+    }
+}
+
+bool Stream::reserveFifoRoom()
+{
+    if (!makeFifoRoom(true))
     {
-        memcpy(RGBbufferPtr, &m_frameBuffer[0], maxBytes);
+        LOG(LOG_VERBOSE, "Stream: FIFO is full - dropping frame\n");
+        return false;
     }
-    m_newFrame = false;
-    m_bufferMutex.unlock();
     return true;
 }
 
+void Stream::releaseFifoRoom(uint32_t count)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    m_fifoMutex.lock();
+    m_fifoReserved = (count < m_fifoReserved) ? m_fifoReserved - count : 0;
+    m_fifoMutex.unlock();
+    m_fifoCond.notify_all();
+}
+
+void Stream::pushFifo(FrameSlot *slot, uint32_t sequence, bool reserved)
+{
+    std::lock_guard<std::mutex> lock(m_fifoMutex);
+    if (reserved && (m_fifoReserved != 0))
+    {
+        m_fifoReserved--;
+    }
+
+    if (!m_fifoEnabled)
+    {
+        return;
+    }
+
+    if (!m_frameRing.pin(slot, sequence))
+    {
+        m_libraryDropped++;
+        return;
+    }
+
+    // the FIFO can only be full here when
+    // several producers race: drop the oldest
+    if (m_fifoCount >= m_fifoDepth)
+    {
+        FrameSlot *oldest = m_fifo[m_fifoHead];
+        m_frameRing.releaseRead(oldest->m_index, oldest->m_sequence);
+        m_fifoHead = (m_fifoHead + 1) % m_fifo.size();
+        m_fifoCount--;
+        m_libraryDropped++;
+    }
+
+    m_fifo[(m_fifoHead + m_fifoCount) % m_fifo.size()] = slot;
+    m_fifoCount++;
+    m_newFrame = true;
+}
+
+FrameSlot* Stream::popFifo()
+{
+    FrameSlot *slot = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_fifoMutex);
+        if (m_fifoCount != 0)
+        {
+            slot = m_fifo[m_fifoHead];
+            m_fifoHead = (m_fifoHead + 1) % m_fifo.size();
+            m_fifoCount--;
+        }
+        m_newFrame = (m_fifoCount != 0);
+    }
+    m_fifoCond.notify_all();
+    return slot;
+}
+
+void Stream::flushFifo()
+{
+    while(m_fifoCount != 0)
+    {
+        FrameSlot *slot = m_fifo[m_fifoHead];
+        m_frameRing.releaseRead(slot->m_index, slot->m_sequence);
+        m_fifoHead = (m_fifoHead + 1) % m_fifo.size();
+        m_fifoCount--;
+    }
+    m_fifoHead = 0;
+}
+
+void Stream::fillLease(const FrameSlot *slot, CapFrameLease *lease) const
+{
+    lease->data     = &slot->m_data[0];
+    lease->width    = slot->m_width;
+    lease->height   = slot->m_height;
+    lease->stride   = slot->m_stride;
+    lease->sequence = slot->m_sequence;
+    lease->slot     = slot->m_index;
+    lease->info     = slot->m_info;
+}
+
+CapResult Stream::setOutputFormat(uint32_t format)
+{
+    if (format > CAPFORMAT_NATIVE)
+    {
+        LOG(LOG_ERR, "setOutputFormat: invalid format %d\n", format);
+        return CAPRESULT_ERR;
+    }
+
+    if (!supportsOutputFormat(format))
+    {
+        LOG(LOG_ERR, "setOutputFormat: format %d is not supported by this stream\n", format);
+        return CAPRESULT_FORMATNOTSUPPORTED;
+    }
+
+    m_outputFormat = format;
+    return CAPRESULT_OK;
+}
+
+bool Stream::supportsOutputFormat(uint32_t format)
+{
+    return (format == CAPFORMAT_RGB24);
+}
+
+uint32_t Stream::getOutputFrameBytes() const
+{
+    if (!m_isOpen)
+    {
+        return 0;
+    }
+
+    const uint32_t format = m_outputFormat;
+    if (format == CAPFORMAT_NATIVE)
+    {
+        return m_frameRing.getSlotBytes();
+    }
+    const uint32_t width = getOutputWidth();
+    return getFrameBytes(format, width, getOutputHeight(), getMinStride(format, width));
+}
+
+CapResult Stream::setOutputScale(uint32_t denom)
+{
+    if ((denom != 1) && (denom != 2) && (denom != 4) && (denom != 8))
+    {
+        LOG(LOG_ERR, "setOutputScale: invalid scale 1/%d\n", denom);
+        return CAPRESULT_ERR;
+    }
+
+    if ((denom != 1) && (!supportsOutputScale(denom)))
+    {
+        LOG(LOG_ERR, "setOutputScale: scale 1/%d is not supported by this stream\n", denom);
+        return CAPRESULT_FORMATNOTSUPPORTED;
+    }
+
+    m_outputScale = denom;
+    return CAPRESULT_OK;
+}
+
+bool Stream::supportsOutputScale(uint32_t denom)
+{
+    return false;
+}
+
+void Stream::setOutputDecimation(uint32_t n)
+{
+    m_decimation = (n == 0) ? 1 : n;
+}
+
+void Stream::setMaxOutputFrameRate(uint32_t fps)
+{
+    m_outputInterval = (fps == 0) ? 0 : 1000000 / fps;
+}
+
+bool Stream::skipFrame()
+{
+    // only called by the capture thread, so the
+    // counter and the pacing state need no locking.
+    const uint32_t decimation = m_decimation;
+    if (decimation > 1)
+    {
+        if (m_decimationCount != 0)
+        {
+            m_decimationCount = (m_decimationCount + 1) % decimation;
+            return true;
+        }
+        m_decimationCount = 1;
+    }
+
+    const uint32_t interval = m_outputInterval;
+    if (interval != 0)
+    {
+        const uint64_t now = getTimestamp();
+        if (now < m_nextOutputTime)
+        {
+            return true;
+        }
+
+        // keep the cadence when frames arrive with some jitter,
+        // but start over after a gap, e.g. the first frame.
+        m_nextOutputTime += interval;
+        if (m_nextOutputTime <= now)
+        {
+            m_nextOutputTime = now + interval;
+        }
+    }
+    return false;
+}
+
+bool Stream::setSharedMemoryExport(const char *name, uint32_t slots)
+{
+    if (name == nullptr)
+    {
+        return true;
+    }
+
+    LOG(LOG_ERR, "setSharedMemoryExport: not supported on this platform\n");
+    return false;
+}
+
+CapResult Stream::setIOMode(uint32_t mode)
+{
+    if (mode == CAPIO_MMAP)
+    {
+        return CAPRESULT_OK;
+    }
+
+    LOG(LOG_ERR, "setIOMode: mode %d is not supported on this platform\n", mode);
+    return (mode == CAPIO_USERPTR) ? CAPRESULT_FORMATNOTSUPPORTED : CAPRESULT_ERR;
+}
+
+CapResult Stream::setCaptureQueue(uint32_t bufferCount, uint32_t policy)
+{
+    LOG(LOG_ERR, "setCaptureQueue: not supported on this platform\n");
+    return CAPRESULT_FORMATNOTSUPPORTED;
+}
+
+CapResult Stream::setThreadPolicy(uint32_t policy, int32_t priority, uint64_t cpuMask)
+{
+    if ((policy == CAPTHREAD_NORMAL) && (cpuMask == 0))
+    {
+        return CAPRESULT_OK;
+    }
+
+    LOG(LOG_ERR, "setThreadPolicy: not supported on this platform\n");
+    return CAPRESULT_FORMATNOTSUPPORTED;
+}
+
+void Stream::getLatencyStats(CapLatencyStats *stats) const
+{
+    // the counters are updated by the capture thread
+    // one by one, so they can be a frame apart.
+    stats->frames      = m_ageFrames;
+    stats->staleFrames = m_staleFrames;
+    stats->lastAge     = m_ageLast;
+    stats->maxAge      = m_ageMax;
+    stats->averageAge  = (stats->frames != 0) ? m_ageSum / stats->frames : 0;
+    stats->pipelineFrames       = m_pipelineFrames;
+    stats->maxPipelineDelay     = m_pipelineDelayMax;
+    stats->averagePipelineDelay = (stats->pipelineFrames != 0) ? 
+        m_pipelineDelaySum / stats->pipelineFrames : 0;
+}
+
+void Stream::resetLatencyStats()
+{
+    m_ageFrames   = 0;
+    m_staleFrames = 0;
+    m_ageSum      = 0;
+    m_ageLast     = 0;
+    m_ageMax      = 0;
+    m_pipelineFrames   = 0;
+    m_pipelineDelaySum = 0;
+    m_pipelineDelayMax = 0;
+}
+
+void Stream::countStaleFrame()
+{
+    m_libraryDropped++;
+    m_staleFrames++;
+}
+
+void Stream::countPipelineDelay(uint64_t delay)
+{
+    m_pipelineDelaySum += delay;
+    if (delay > m_pipelineDelayMax)
+    {
+        m_pipelineDelayMax = delay;
+    }
+    m_pipelineFrames++;
+}
+
+CapResult Stream::setDmaBufExport(bool enable)
+{
+    if (!enable)
+    {
+        return CAPRESULT_OK;
+    }
+
+    LOG(LOG_ERR, "setDmaBufExport: not supported on this platform\n");
+    return CAPRESULT_FORMATNOTSUPPORTED;
+}
+
+CapResult Stream::acquireDmaBuf(CapDmaBufLease *lease)
+{
+    return CAPRESULT_ERR;
+}
+
+bool Stream::releaseDmaBuf(const CapDmaBufLease *lease)
+{
+    return false;
+}
+
+uint32_t Stream::getMinStride(uint32_t format, uint32_t width)
+{
+    switch(format)
+    {
+    case CAPFORMAT_RGB24:
+    case CAPFORMAT_BGR24:
+        return width*3;
+    case CAPFORMAT_RGBA32:
+    case CAPFORMAT_BGRA32:
+        return width*4;
+    case CAPFORMAT_GRAY8:
+    case CAPFORMAT_I420:
+        return width;
+    case CAPFORMAT_NV12:
+        // the interleaved chroma rows need an even width
+        return (width+1) & ~1;
+    default:
+        return 0;
+    }
+}
+
+uint32_t Stream::getFrameBytes(uint32_t format, uint32_t width, uint32_t height, uint32_t stride)
+{
+    const uint32_t chromaHeight = (height+1)/2;
+    switch(format)
+    {
+    case CAPFORMAT_RGB24:
+    case CAPFORMAT_BGR24:
+    case CAPFORMAT_RGBA32:
+    case CAPFORMAT_BGRA32:
+    case CAPFORMAT_GRAY8:
+        return stride*height;
+    case CAPFORMAT_NV12:
+        return stride*(height + chromaHeight);
+    case CAPFORMAT_I420:
+        return stride*height + 2*((stride+1)/2)*chromaHeight;
+    default:
+        return 0;
+    }
+}
+
+bool Stream::setDecodeMode(uint32_t mode)
+{
+    if (mode > CAPDECODE_LAZY)
+    {
+        LOG(LOG_ERR, "setDecodeMode: invalid mode %d\n", mode);
+        return false;
+    }
+    m_lazyDecode = (mode == CAPDECODE_LAZY);
+    return true;
+}
+
+void Stream::storePayload(FrameSlot *slot, const uint8_t *ptr, size_t bytes, uint32_t fourCC)
+{
+    // the payload buffer only grows, so after the first
+    // few frames no memory is allocated here.
+    if (slot->m_raw.size() < bytes)
+    {
+        slot->m_raw.resize(bytes);
+    }
+    memcpy(&slot->m_raw[0], ptr, bytes);
+    slot->m_rawBytes  = bytes;
+    slot->m_rawFourCC = fourCC;
+    slot->m_decoded.store(false, std::memory_order_relaxed);
+}
+
+bool Stream::decodeSlot(FrameSlot *slot)
+{
+    if (slot->m_decoded.load(std::memory_order_acquire))
+    {
+        return true;
+    }
+
+    // several readers can pin the same slot: the
+    // first one decodes, the others use the result.
+    std::lock_guard<std::mutex> lock(slot->m_decodeMutex);
+    if (slot->m_decoded.load(std::memory_order_relaxed))
+    {
+        return true;
+    }
+
+    if (!decodePayload(slot, &slot->m_data[0], slot->m_stride))
+    {
+        LOG(LOG_VERBOSE, "Stream: could not decode frame %d\n", slot->m_sequence);
+        return false;
+    }
+    slot->m_decoded.store(true, std::memory_order_release);
+    return true;
+}
+
+bool Stream::decodePayload(const FrameSlot *slot, uint8_t *dst, uint32_t stride)
+{
+    LOG(LOG_ERR, "Stream: decodePayload is not implemented on this platform\n");
+    return false;
+}
+
+bool Stream::decodePayloadRegion(const FrameSlot *slot, const CapROI &roi, uint32_t stride)
+{
+    return false;
+}
+
+void Stream::setFrameCallback(CapFrameCallback callback, void *user)
+{
+    // waits for a running callback to finish
+    std::lock_guard<std::mutex> lock(m_callbackMutex);
+    m_callback = callback;
+    m_callbackUser = user;
+}
+
+void Stream::deliverFrame(FrameSlot *slot, uint32_t sequence)
+{
+    // never block the producer on a busy callback:
+    // skip the frame instead.
+    if (!m_callbackMutex.try_lock())
+    {
+        LOG(LOG_VERBOSE, "Stream: frame callback busy - skipping frame %d\n", sequence);
+        return;
+    }
+
+    if (m_callback != nullptr)
+    {
+        // pin the slot so the frame stays valid
+        // during the callback, even if another
+        // frame is published in the meantime.
+        if (m_frameRing.pin(slot, sequence))
+        {
+            if (decodeSlot(slot))
+            {
+                CapFrameLease lease;
+                fillLease(slot, &lease);
+                m_callback(&lease, m_callbackUser);
+            }
+            m_frameRing.releaseRead(slot->m_index, sequence);
+        }
+    }
+
+    m_callbackMutex.unlock();
+}
+
+void Stream::allocateFrames(size_t frameBytes)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_fifoMutex);
+        m_fifoHead = 0;
+        m_fifoCount = 0;
+    }
+
+    uint32_t slots = c_frameSlots;
+    if (m_fifoEnabled)
+    {
+        slots += m_fifoDepth;
+    }
+
+    // make room for the largest output format, so the
+    // format can be changed while the stream is running.
+    const size_t maxOutputBytes = getFrameBytes(CAPFORMAT_RGBA32, m_width, m_height, 
+        getMinStride(CAPFORMAT_RGBA32, m_width));
+    if (frameBytes < maxOutputBytes)
+    {
+        frameBytes = maxOutputBytes;
+    }
+    m_driverSlots = 0;
+    m_frameRing.allocate(slots, frameBytes, c_maxFrameSlots);
+}
+
+bool Stream::reserveDriverSlots(uint32_t count)
+{
+    if (count > c_maxDriverSlots)
+    {
+        LOG(LOG_ERR, "reserveDriverSlots: too many slots (%d)\n", count);
+        return false;
+    }
+
+    uint32_t slots = c_frameSlots + count;
+    if (m_fifoEnabled)
+    {
+        slots += m_fifoDepth;
+    }
+
+    if (!m_frameRing.grow(slots))
+    {
+        return false;
+    }
+    m_driverSlots = count;
+    return true;
+}
+
+FrameSlot* Stream::beginFrame()
+{
+    if (m_frameRing.getSlotBytes() == 0)
+    {
+        LOG(LOG_ERR,"Stream::m_frameRing size is 0 - cant store frame buffers!\n");
+        return nullptr;
+    }
+
+    if (m_fifoEnabled && (!makeFifoRoom()))
+    {
+        LOG(LOG_VERBOSE, "Stream: FIFO is full - dropping frame\n");
+        return nullptr;
+    }
+
+    FrameSlot *slot = reserveFrame();
+    if (slot != nullptr)
+    {
+        initFrame(slot);
+    }
+    return slot;
+}
+
+FrameSlot* Stream::beginReservedFrame()
+{
+    FrameSlot *slot = reserveFrame();
+    if (slot != nullptr)
+    {
+        initFrame(slot);
+    }
+    return slot;
+}
+
+FrameSlot* Stream::reserveFrame()
+{
+    FrameSlot *slot = m_frameRing.acquireWrite();
+    if (slot == nullptr)
+    {
+        LOG(LOG_VERBOSE, "Stream: all frame slots are leased - dropping frame\n");
+        m_libraryDropped++;
+    }
+    return slot;
+}
+
+bool Stream::beginFrame(FrameSlot *slot)
+{
+    if (m_fifoEnabled && (!makeFifoRoom()))
+    {
+        LOG(LOG_VERBOSE, "Stream: FIFO is full - dropping frame\n");
+        return false;
+    }
+
+    initFrame(slot);
+    return true;
+}
+
+void Stream::initFrame(FrameSlot *slot)
+{
+    // default to tightly packed frames in the output format
+    // and scale. Native frames are never scaled.
+    const uint32_t format = m_outputFormat;
+    const uint32_t scale  = (format == CAPFORMAT_NATIVE) ? 1 : m_outputScale.load();
+    slot->m_format = format;
+    slot->m_scale  = scale;
+    slot->m_width  = getScaledSize(m_width, scale);
+    slot->m_height = getScaledSize(m_height, scale);
+    slot->m_stride = getMinStride(format, slot->m_width);
+    slot->m_bytes  = getFrameBytes(format, slot->m_width, slot->m_height, slot->m_stride);
+
+    // the platform code overwrites these if the
+    // driver provides better information
+    slot->m_info.captureTimestamp = getTimestamp();
+    slot->m_info.deviceSequence   = m_lastDeviceSequence;
+    slot->m_info.flags            = 0;
+
+    // frames hold decoded data unless storePayload is called
+    slot->m_rawBytes = 0;
+    slot->m_decoded.store(true, std::memory_order_relaxed);
+}
+
+uint32_t Stream::commitFrame(FrameSlot *slot, bool reserved)
+{
+    const uint32_t sequence = ++m_frames;
+    slot->m_sequence = sequence;
+    slot->m_info.sequence           = sequence;
+    slot->m_info.deliveryTimestamp  = getTimestamp();
+    slot->m_info.deviceDropped      = m_deviceDropped;
+    slot->m_info.libraryDropped     = m_libraryDropped;
+    slot->m_info.format             = slot->m_format;
+    slot->m_info.bytes              = slot->m_bytes;
+
+    // only the capture thread updates the age statistics
+    const uint64_t capture = slot->m_info.captureTimestamp;
+    const uint64_t age = (slot->m_info.deliveryTimestamp > capture) ?
+        slot->m_info.deliveryTimestamp - capture : 0;
+    m_ageLast = age;
+    m_ageSum += age;
+    if (age > m_ageMax)
+    {
+        m_ageMax = age;
+    }
+    m_ageFrames++;
+
+    m_frameRing.publish(slot);
+    m_published = sequence;
+
+    // in FIFO mode, pushFifo sets m_newFrame under the FIFO
+    // lock, and only when the frame actually went in.
+    if (m_fifoEnabled || reserved)
+    {
+        pushFifo(slot, sequence, reserved);
+    }
+    else
+    {
+        m_newFrame = true;
+    }
+
+    deliverFrame(slot, sequence);
+
+    // only take the wait mutex when someone is waiting.
+    // A waiter increments m_waiters before it evaluates
+    // hasNewFrame, so either it sees the new frame or we
+    // see the waiter.
+    if (m_waiters != 0)
+    {
+        m_waitMutex.lock();
+        m_waitMutex.unlock();
+        m_frameCond.notify_all();
+    }
+    return sequence;
+}
+
+void Stream::abortFrame(FrameSlot *slot)
+{
+    m_libraryDropped++;
+    m_frameRing.cancelWrite(slot);
+}
+
+void Stream::trackDeviceSequence(uint32_t deviceSequence)
+{
+    // note: unsigned arithmetic handles wrap-around
+    if (m_haveDeviceSequence)
+    {
+        uint32_t gap = deviceSequence - m_lastDeviceSequence;
+        if ((gap > 1) && (gap < 0x80000000))
+        {
+            m_deviceDropped += gap - 1;
+            LOG(LOG_VERBOSE, "Stream: driver dropped %d frame(s)\n", gap - 1);
+        }
+    }
+    m_lastDeviceSequence = deviceSequence;
+    m_haveDeviceSequence = true;
+}
+
+uint64_t Stream::getTimestamp()
+{
+    // on Linux, steady_clock is CLOCK_MONOTONIC
+    auto t = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::microseconds>(t).count();
+}
+
 void Stream::submitBuffer(const uint8_t *ptr, size_t bytes)
 {
     // sanity check
@@ -78,13 +1242,6 @@ void Stream::submitBuffer(const uint8_t *ptr, size_t bytes)
     {
         return;
     }
-    
-    m_bufferMutex.lock();
-    
-    if (m_frameBuffer.size() == 0)
-    {
-        LOG(LOG_ERR,"Stream::m_frameBuffer size is 0 - cant store frame buffers!\n");
-    }
 
     // Generate warning every 100 frames if the frame buffer is not
     // the expected size. 
@@ -95,11 +1252,15 @@ void Stream::submitBuffer(const uint8_t *ptr, size_t bytes)
         LOG(LOG_WARNING, "Warning: captureFrame received incorrect buffer size (got %d want %d)\n", bytes, wantSize);
     }
 
-    if (m_frameBuffer.size() >= bytes)
+    if (m_frameRing.getSlotBytes() >= bytes)
     {
-        memcpy(&m_frameBuffer[0], ptr, bytes);
-        m_newFrame = true; 
-        m_frames++;
+        FrameSlot *slot = beginFrame();
+        if (slot != nullptr)
+        {
+            // only CAPFORMAT_RGB24 is supported here,
+            // see supportsOutputFormat.
+            memcpy(&slot->m_data[0], ptr, bytes);
+            commitFrame(slot);
+        }
     }
-    m_bufferMutex.unlock();
 }
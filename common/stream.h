@@ -30,8 +30,14 @@
 
 #include <stdint.h>
 #include <vector>
+#include <map>
+#include <set>
+#include <atomic>
 #include <mutex>
+#include <condition_variable>
+#include "openpnp-capture.h"
 #include "logging.h"
+#include "framering.h"
 
 class Context;      // pre-declaration
 class deviceInfo;   // pre-declaration
@@ -55,15 +61,214 @@ public:
     virtual void close() {};
 
     /** Returns true if a new frame is available for reading using 'captureFrame'. 
-        The internal new frame flag is reset by captureFrame.
+        'cursor' is the sequence number of the last frame read by the
+        caller, as updated by captureFrame, captureFrameROI and
+        acquireFrame. In FIFO mode, the queue is shared by all readers
+        and the cursor is ignored.
     */
-    bool hasNewFrame();
+    bool hasNewFrame(uint32_t cursor);
+
+    /** Wait until a new frame is available, at most timeoutMs milliseconds.
+        See hasNewFrame for 'cursor'. 'handle' is the stream ID the
+        caller waits through, see cancelHandleWaiters.
+        Returns CAPRESULT_OK, CAPRESULT_TIMEOUT or CAPRESULT_ERR when
+        the wait was cancelled by cancelWaiters() or cancelHandleWaiters().
+    */
+    CapResult waitForNewFrame(uint32_t timeoutMs, uint32_t cursor, int32_t handle = -1);
+
+    /** Register a thread that is about to wait through the stream
+        ID 'handle', so cancelWaiters and cancelHandleWaiters wait
+        for it even before it has started waiting. Follow up with
+        waitRegistered. Returns false if waits through 'handle' are
+        cancelled; the thread is not registered then.
+    */
+    bool addWaiter(int32_t handle);
+
+    /** Wait like waitForNewFrame, for a thread registered with
+        addWaiter. The registration ends when this returns. */
+    CapResult waitRegistered(uint32_t timeoutMs, uint32_t cursor, int32_t handle);
+
+    /** Wake up the threads blocked in waitForNewFrame through the
+        stream ID 'handle' and wait until they have returned, when
+        the ID is closed while other IDs still share the stream.
+        Subsequent waits through the ID fail immediately.
+    */
+    void cancelHandleWaiters(int32_t handle);
+
+    /** Wake up all threads blocked in waitForNewFrame and wait
+        until they have returned. Subsequent waits fail immediately.
+        Must be called before the stream object is deleted.
+    */
+    void cancelWaiters();
 
     /** Retrieve the most recently captured frame and copy it in a
         buffer pointed to by RGBbufferPtr. The maximum buffer size 
         must be supplied in RGBbufferBytes.
+        If stride is not 0, the rows of the frame are written 
+        'stride' bytes apart, otherwise they are tightly packed.
+        If info is not NULL, it receives the frame metadata.
+        If cursor is not NULL, it receives the sequence number of 
+        the frame, see hasNewFrame.
+    */
+    bool captureFrame(uint8_t *RGBbufferPtr, uint32_t RGBbufferBytes, uint32_t stride, CapFrameInfo *info,
+        uint32_t *cursor = nullptr);
+
+    /** Copy one or more regions of the most recently captured frame
+        into separate buffers, see Cap_captureFrameROI. Only packed and
+        gray output formats are supported. Returns CAPRESULT_NOFRAME 
+        if there is no frame or CAPRESULT_ERR if a region is invalid.
+    */
+    CapResult captureFrameROI(const CapROI *rois, uint32_t count, CapFrameInfo *info,
+        uint32_t *cursor = nullptr);
+
+    /** Copy the undecoded camera payload of the most recently
+        captured frame, e.g. the JPEG bitstream of an MJPEG camera,
+        into 'buffer', see Cap_captureRawFrame. The size of the payload
+        is returned in payloadBytes, also when the buffer is too small,
+        and its FOURCC in fourCC.
+        Returns CAPRESULT_NOFRAME if there is no frame,
+        CAPRESULT_FORMATNOTSUPPORTED if the frame does not have a
+        payload or CAPRESULT_ERR if the buffer is too small.
+        See captureFrame for 'cursor'.
     */
-    bool captureFrame(uint8_t *RGBbufferPtr, uint32_t RGBbufferBytes);
+    CapResult captureRawFrame(uint8_t *buffer, uint32_t bufferBytes, uint32_t *payloadBytes,
+        uint32_t *fourCC, CapFrameInfo *info, uint32_t *cursor = nullptr);
+
+    /** Pin the most recently captured frame and return a read-only
+        pointer to it, without copying. The frame stays valid until
+        it is released with releaseFrame. The capture thread
+        continues to write into the other slots of the frame ring.
+        Returns false if no frame has been captured yet.
+        See captureFrame for 'cursor'.
+    */
+    bool acquireFrame(CapFrameLease *lease, uint32_t *cursor = nullptr);
+
+    /** Release a frame obtained by acquireFrame */
+    bool releaseFrame(const CapFrameLease *lease);
+
+    /** Select latest-only or FIFO delivery of frames, see Cap_setDeliveryMode.
+        Returns false if the arguments are invalid. */
+    bool setDeliveryMode(uint32_t mode, uint32_t depth, uint32_t overflowPolicy);
+
+    /** Return the number of times a frame arrived while the FIFO was full */
+    uint32_t getOverflowCount() const
+    {
+        return m_overflows;
+    }
+
+    /** Select the pixel format of the frames, see Cap_setOutputFormat.
+        Returns CAPRESULT_FORMATNOTSUPPORTED if the platform or camera
+        format cannot produce it. */
+    CapResult setOutputFormat(uint32_t format);
+
+    /** Return the current output format (CAPFORMAT_xxx) */
+    uint32_t getOutputFormat() const
+    {
+        return m_outputFormat;
+    }
+
+    /** Return the number of bytes needed to hold one frame in the
+        current output format and scale */
+    uint32_t getOutputFrameBytes() const;
+
+    /** Select the output scale 1/denom, see Cap_setOutputScale.
+        Returns CAPRESULT_FORMATNOTSUPPORTED if the platform or camera
+        format cannot scale. */
+    CapResult setOutputScale(uint32_t denom);
+
+    /** Return the width of the frames at the current output scale */
+    uint32_t getOutputWidth() const
+    {
+        return getScaledSize(m_width, m_outputScale);
+    }
+
+    /** Return the height of the frames at the current output scale */
+    uint32_t getOutputHeight() const
+    {
+        return getScaledSize(m_height, m_outputScale);
+    }
+
+    /** Return a dimension scaled by 1/denom, rounded up like TJSCALED */
+    static uint32_t getScaledSize(uint32_t size, uint32_t denom)
+    {
+        return (size + denom - 1) / denom;
+    }
+
+    /** Return the smallest row stride of a frame in a given format,
+        or 0 for CAPFORMAT_NATIVE */
+    static uint32_t getMinStride(uint32_t format, uint32_t width);
+
+    /** Return the number of bytes of a frame in a given format
+        with a given row stride, or 0 for CAPFORMAT_NATIVE */
+    static uint32_t getFrameBytes(uint32_t format, uint32_t width, uint32_t height, uint32_t stride);
+
+    /** Select eager or lazy decoding of frames, see Cap_setDecodeMode.
+        Returns false if the mode is invalid. */
+    bool setDecodeMode(uint32_t mode);
+
+    /** Returns true if frames are decoded when they are read */
+    bool isLazyDecode() const
+    {
+        return m_lazyDecode;
+    }
+
+    /** Only publish every n-th frame the camera delivers,
+        see Cap_setOutputDecimation. 0 and 1 publish all frames. */
+    void setOutputDecimation(uint32_t n);
+
+    /** Publish at most 'fps' frames per second, see 
+        Cap_setMaxOutputFrameRate. 0 removes the limit. */
+    void setMaxOutputFrameRate(uint32_t fps);
+
+    /** Export the frames to a POSIX shared memory ring with 'slots' 
+        slots, see Cap_setSharedMemoryExport. A NULL name stops the
+        export. The default implementation does not support exporting
+        and returns false. */
+    virtual bool setSharedMemoryExport(const char *name, uint32_t slots);
+
+    /** Keep the driver buffer of the most recent frame and export it
+        as a DMABUF, see Cap_setDmaBufExport. The default implementation
+        does not support this and returns CAPRESULT_FORMATNOTSUPPORTED. */
+    virtual CapResult setDmaBufExport(bool enable);
+
+    /** Lease the DMABUF of the most recent frame, see Cap_acquireDmaBuf.
+        The default implementation returns CAPRESULT_ERR. */
+    virtual CapResult acquireDmaBuf(CapDmaBufLease *lease);
+
+    /** Return a DMABUF leased by acquireDmaBuf */
+    virtual bool releaseDmaBuf(const CapDmaBufLease *lease);
+
+    /** Select how the driver hands frames to the library, see
+        Cap_setIOMode. The default implementation only supports 
+        CAPIO_MMAP. */
+    virtual CapResult setIOMode(uint32_t mode);
+
+    /** Return the I/O mode (CAPIO_xxx) in use */
+    virtual uint32_t getIOMode()
+    {
+        return CAPIO_MMAP;
+    }
+
+    /** Set the number of driver buffers and the queue policy, see
+        Cap_setCaptureQueue. The default implementation does not
+        support this and returns CAPRESULT_FORMATNOTSUPPORTED. */
+    virtual CapResult setCaptureQueue(uint32_t bufferCount, uint32_t policy);
+
+    /** Set the scheduling policy and CPU affinity of the capture
+        thread, see Cap_setThreadPolicy. The default implementation
+        only supports CAPTHREAD_NORMAL without CPU affinity. */
+    virtual CapResult setThreadPolicy(uint32_t policy, int32_t priority, uint64_t cpuMask);
+
+    /** Fill in the frame age statistics, see Cap_getLatencyStats */
+    void getLatencyStats(CapLatencyStats *stats) const;
+
+    /** Start the frame age statistics over */
+    void resetLatencyStats();
+
+    /** Install a callback that is called by commitFrame for
+        each published frame. When this function returns, the
+        previous callback is not running anymore. */
+    void setFrameCallback(CapFrameCallback callback, void *user);
     
     /** Set the frame rate of this stream.
         Returns false if the camera does not support the desired
@@ -80,9 +285,7 @@ public:
     /** Return the FOURCC media type of the stream */
     virtual uint32_t getFOURCC() = 0;
 
-    /** Return the number of frames captured.
-        FIXME: protect by mutex 
-    */
+    /** Return the number of frames captured. */
     uint32_t getFrameCount() const
     {
         return m_frames;
@@ -115,16 +318,236 @@ protected:
     */
     virtual void submitBuffer(const uint8_t* ptr, size_t bytes);
 
+    /** Returns true if the platform can produce frames in the given
+        output format. The default implementation only supports 
+        CAPFORMAT_RGB24. */
+    virtual bool supportsOutputFormat(uint32_t format);
+
+    /** Returns true if the platform can produce frames scaled by
+        1/denom (2, 4 or 8). The default implementation returns false. */
+    virtual bool supportsOutputScale(uint32_t denom);
+
+    /** Allocate the frame ring. Each slot can hold a native frame
+        of 'frameBytes' bytes or a frame in any of the output formats.
+        Call this from the platform dependent open() after setting
+        m_width and m_height.
+    */
+    void allocateFrames(size_t frameBytes);
+
+    /** Get a frame slot to write a new frame into. The geometry
+        of the slot is set according to the output format. For
+        CAPFORMAT_NATIVE, the producer must set m_stride and m_bytes.
+        Returns nullptr if all slots are leased, in which
+        case the frame must be dropped.
+    */
+    FrameSlot* beginFrame();
+
+    /** Make room in the frame ring for 'count' slots that are held
+        by the driver to capture into, see reserveFrame, or by
+        frames being decoded. Returns false if the ring cannot
+        grow that much. */
+    bool reserveDriverSlots(uint32_t count);
+
+    /** Get a frame slot before the frame arrives, e.g. to let the
+        driver capture into it. The slot is not visible to readers.
+        Start the frame with beginFrame(slot) once it has arrived,
+        or give the slot back with m_frameRing.cancelWrite. Returns
+        nullptr if all slots are in use; the frame is counted as
+        dropped.
+    */
+    FrameSlot* reserveFrame();
+
+    /** Start a frame in a slot obtained by reserveFrame, like
+        beginFrame. Returns false if the frame must be dropped
+        because the FIFO is full; the slot stays reserved. */
+    bool beginFrame(FrameSlot *slot);
+
+    /** Set the geometry and default metadata of a new frame */
+    void initFrame(FrameSlot *slot);
+
+    /** Get a frame slot for a frame admitted with reserveFifoRoom,
+        like beginFrame but without waiting for room in the FIFO.
+        Returns nullptr if all slots are leased; the caller must
+        give back the room with releaseFifoRoom. */
+    FrameSlot* beginReservedFrame();
+
+    /** Publish a frame slot obtained by beginFrame, or by
+        beginReservedFrame with 'reserved' set to true.
+        Returns the sequence number of the frame. */
+    uint32_t commitFrame(FrameSlot *slot, bool reserved = false);
+
+    /** Return a frame slot obtained by beginFrame
+        without publishing it, e.g. when decoding failed.
+        The frame is counted as dropped by the library. */
+    void abortFrame(FrameSlot *slot);
+
+    /** Store the undecoded payload of a frame in a slot obtained
+        by beginFrame. It is decoded by decodePayload when the
+        frame is first read. */
+    void storePayload(FrameSlot *slot, const uint8_t *ptr, size_t bytes, uint32_t fourCC);
+
+    /** Make sure a pinned slot holds decoded frame data.
+        Returns false if the payload could not be decoded. */
+    bool decodeSlot(FrameSlot *slot);
+
+    /** Decode the payload stored by storePayload into 'dst', in the
+        format of the slot, with rows 'stride' bytes apart. 'dst' is
+        either the frame data of the slot or a caller's buffer.
+        Platforms that use storePayload must implement this.
+        Can be called from any reader thread. */
+    virtual bool decodePayload(const FrameSlot *slot, uint8_t *dst, uint32_t stride);
+
+    /** Decode only a region of the payload stored by storePayload
+        into roi.buffer, with rows 'stride' bytes apart. Returns 
+        false if the platform cannot decode regions, in which case
+        the whole frame is decoded. */
+    virtual bool decodePayloadRegion(const FrameSlot *slot, const CapROI &roi, uint32_t stride);
+
+    /** Copy a region of the decoded frame data of a slot to
+        roi.buffer with rows 'dstStride' bytes apart */
+    static void copyRegion(const FrameSlot *slot, const CapROI &roi, uint32_t dstStride);
+
+    /** Pin the next frame to be read: the oldest frame in FIFO mode
+        or the most recent frame otherwise. Returns nullptr if there is
+        none. The slot must be released with m_frameRing.releaseRead. 
+        If cursor is not NULL, it receives the sequence number of the slot. */
+    FrameSlot* takeFrame(uint32_t *cursor);
+
+    /** Copy the decoded frame data of a slot to 'dst' with
+        rows 'dstStride' bytes apart */
+    static void copyFrame(const FrameSlot *slot, uint8_t *dst, uint32_t dstStride);
+
+    /** Track the sequence number the driver assigned to a frame
+        to detect frames dropped by the driver. Call this for
+        every buffer received from the driver. */
+    void trackDeviceSequence(uint32_t deviceSequence);
+
+    /** Returns true if the frame the camera delivered just now
+        must be skipped because of the output decimation or the
+        maximum output frame rate. The platform code must call this
+        once for every frame, before it touches the frame data. 
+        Skipped frames are not counted as dropped. */
+    bool skipFrame();
+
+    /** Count a frame that was received from the driver but 
+        skipped because a newer one was already waiting, see
+        CAPQUEUE_NEWEST and Cap_setDecodeThreads. It is counted
+        as dropped. */
+    void countStaleFrame();
+
+    /** Add the time a frame spent in a decode pipeline, waiting
+        rather than being decoded, to the latency statistics.
+        Called with the frame's commitFrame. */
+    void countPipelineDelay(uint64_t delay);
+
+    /** Return the current time in microseconds, using the same
+        clock as the frame timestamps */
+    static uint64_t getTimestamp();
+
+    /** In FIFO mode, make room for a new frame according to the
+        overflow policy. If 'reserve' is true, the room is kept for
+        the frame until it is published, see reserveFifoRoom.
+        Returns false if the frame must be dropped. */
+    bool makeFifoRoom(bool reserve = false);
+
+    /** Admit a frame that another thread decodes and publishes
+        later, e.g. a worker of a decode pool: apply the overflow
+        policy now, on the capture thread, and keep room in the FIFO
+        for the frame, so the other thread never waits for the
+        application. Start the frame with beginReservedFrame and
+        publish it with commitFrame(slot, true), or give back the
+        room with releaseFifoRoom if it is dropped. Returns false
+        if the frame must be dropped. */
+    bool reserveFifoRoom();
+
+    /** Give back the room of 'count' frames admitted with
+        reserveFifoRoom that are dropped */
+    void releaseFifoRoom(uint32_t count);
+
+    /** Release a producer that waits in makeFifoRoom and keep it
+        from waiting again (cancelled = true), so capturing can be
+        stopped, or let it wait again after capturing is restarted. */
+    void setFifoCancelled(bool cancelled);
+
+    /** Select if the producer may wait for room in the FIFO under
+        CAPOVERFLOW_BLOCK. A thread shared by several streams must
+        not, so the incoming frame is dropped instead. */
+    void setFifoMayBlock(bool mayBlock);
+
+    /** Append a published slot to the FIFO and pin it. If 'reserved'
+        is true, the frame takes the room kept by reserveFifoRoom. */
+    void pushFifo(FrameSlot *slot, uint32_t sequence, bool reserved);
+
+    /** Remove the oldest slot from the FIFO. The slot is still pinned
+        and must be released by the caller. Returns nullptr if the FIFO
+        is empty. */
+    FrameSlot* popFifo();
+
+    /** Unpin and remove all slots in the FIFO. m_fifoMutex must be held. */
+    void flushFifo();
+
+    /** Fill a lease structure with the information of a pinned slot */
+    void fillLease(const FrameSlot *slot, CapFrameLease *lease) const;
+
+    /** Call the frame callback, if any, for a published slot */
+    void deliverFrame(FrameSlot *slot, uint32_t sequence);
+
     Context*    m_owner;                    ///< The context object associated with this stream
 
     uint32_t    m_width;                    ///< The width of the frame in pixels
     uint32_t    m_height;                   ///< The height of the frame in pixels
     bool        m_isOpen;
 
-    std::mutex  m_bufferMutex;              ///< mutex to protect m_frameBuffer and m_newFrame
-    bool        m_newFrame;                 ///< new frame buffer flag
-    std::vector<uint8_t> m_frameBuffer;     ///< raw frame buffer
-    uint32_t    m_frames;                   ///< number of frames captured
+    std::atomic<bool>       m_newFrame;     ///< FIFO mode: the FIFO is not empty
+    std::atomic<uint32_t>   m_published;    ///< sequence number of the most recently published frame
+    FrameRing               m_frameRing;    ///< decoded frame buffers
+    std::atomic<uint32_t>   m_frames;       ///< number of frames captured
+    std::atomic<uint32_t>   m_deviceDropped;///< number of frames dropped by the driver
+    std::atomic<uint32_t>   m_libraryDropped;///< number of frames dropped by the library
+    std::atomic<uint32_t>   m_lastDeviceSequence;   ///< last sequence number seen by trackDeviceSequence
+    bool                    m_haveDeviceSequence;   ///< true if m_lastDeviceSequence is valid
+
+    std::mutex              m_waitMutex;    ///< mutex for m_frameCond
+    std::condition_variable m_frameCond;    ///< signalled when a frame is published or waits are cancelled
+    std::atomic<uint32_t>   m_waiters;      ///< number of threads in waitForNewFrame
+    bool                    m_cancelWait;   ///< if true, waitForNewFrame returns immediately
+    std::set<int32_t>       m_cancelledHandles; ///< closed stream IDs, see cancelHandleWaiters
+    std::map<int32_t, uint32_t> m_handleWaiters;///< number of threads in waitForNewFrame by stream ID
+
+    std::mutex              m_fifoMutex;    ///< protects the FIFO state below
+    std::condition_variable m_fifoCond;     ///< signalled when the FIFO has room
+    std::atomic<bool>       m_fifoEnabled;  ///< true in CAPDELIVERY_FIFO mode
+    bool                    m_fifoCancelled;///< if true, the producer does not wait for room
+    bool                    m_fifoMayBlock; ///< if false, CAPOVERFLOW_BLOCK drops the incoming frame
+    uint32_t                m_fifoDepth;    ///< maximum number of frames in the FIFO
+    uint32_t                m_overflowPolicy;   ///< CAPOVERFLOW_xxx
+    std::vector<FrameSlot*> m_fifo;         ///< circular buffer of queued (pinned) slots
+    uint32_t                m_fifoHead;     ///< index of the oldest entry in m_fifo
+    uint32_t                m_fifoCount;    ///< number of entries in m_fifo
+    uint32_t                m_fifoReserved; ///< number of admitted frames not published yet, see reserveFifoRoom
+    std::atomic<uint32_t>   m_overflows;    ///< number of FIFO overflow events
+
+    std::atomic<bool>       m_lazyDecode;   ///< true in CAPDECODE_LAZY mode
+    std::atomic<uint32_t>   m_outputFormat; ///< CAPFORMAT_xxx of new frames
+    std::atomic<uint32_t>   m_outputScale;  ///< new frames are scaled by 1/m_outputScale
+    std::atomic<uint32_t>   m_decimation;   ///< publish every m_decimation-th frame
+    std::atomic<uint32_t>   m_outputInterval;   ///< minimum time between published frames in microseconds
+    uint32_t                m_decimationCount;  ///< frames since the last one that was not skipped
+    uint64_t                m_nextOutputTime;   ///< earliest time of the next frame that is not skipped
+    uint32_t                m_driverSlots;  ///< number of slots held by the driver, see reserveDriverSlots
+
+    std::atomic<uint32_t>   m_ageFrames;    ///< number of frames in the age statistics
+    std::atomic<uint32_t>   m_staleFrames;  ///< number of frames counted by countStaleFrame
+    std::atomic<uint64_t>   m_ageSum;       ///< sum of the frame ages in microseconds
+    std::atomic<uint64_t>   m_ageLast;      ///< age of the most recently published frame
+    std::atomic<uint64_t>   m_ageMax;       ///< maximum frame age
+    std::atomic<uint32_t>   m_pipelineFrames;   ///< number of frames counted by countPipelineDelay
+    std::atomic<uint64_t>   m_pipelineDelaySum; ///< sum of their pipeline delays in microseconds
+    std::atomic<uint64_t>   m_pipelineDelayMax; ///< maximum pipeline delay
+
+    std::mutex              m_callbackMutex;///< held while the frame callback runs
+    CapFrameCallback        m_callback;     ///< frame callback or NULL
+    void*                   m_callbackUser; ///< user pointer for the frame callback
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,149 @@
+/*
+
+    OpenPnp-Capture: a video capture subsystem.
+
+    Copyright (c) 2017 Jason von Nieda, Niels Moseley.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+/*!
+*  @file
+*  @brief C API for reading frames exported to shared memory
+*
+*  A stream exported with Cap_setSharedMemoryExport publishes
+*  its frames into a POSIX shared memory object. Other processes
+*  attach to it with the small openpnp-capture-shm library,
+*  which does not depend on the capture library itself:
+*
+*      CapShmReader *reader = CapShm_open("/camera0");
+*      CapShmFrame frame;
+*      uint32_t last = 0;
+*      while(CapShm_waitFrame(reader, last, 1000, &frame) != CAPRESULT_ERR)
+*      {
+*          ... process frame.data in place ...
+*          if (CapShm_isFrameValid(reader, &frame)) last = frame.sequence;
+*      }
+*      CapShm_close(reader);
+*
+*  The shared memory object holds a CapShmHeader followed by
+*  'slotCount' slots. Frame n is written to slot n % slotCount.
+*  Each slot starts with a CapShmSlotHeader, its frame data
+*  starts 'slotDataOffset' bytes after the start of the slot.
+*
+*  Readers access the frame data without copying. A slot is
+*  protected by a sequence lock: its 'generation' is odd while
+*  the producer writes to it, so a reader can detect that a
+*  frame was overwritten while it was reading it. The producer
+*  never waits for readers.
+*
+*  The 'latest' word in the header is a Linux futex: it holds
+*  the sequence number of the most recent frame and readers
+*  sleep on it until it changes.
+*/
+
+#ifndef openpnp_capture_shm_h
+#define openpnp_capture_shm_h
+
+#include "openpnp-capture.h"
+
+#define CAPSHM_MAGIC    0x4D485343  ///< 'CSHM'
+#define CAPSHM_VERSION  1
+
+/** Layout of the start of the shared memory object */
+typedef struct
+{
+    uint32_t magic;             ///< CAPSHM_MAGIC
+    uint32_t version;           ///< CAPSHM_VERSION
+    uint32_t headerBytes;       ///< offset of the first slot
+    uint32_t slotCount;         ///< number of slots
+    uint32_t slotBytes;         ///< distance in bytes between two slots
+    uint32_t slotDataOffset;    ///< offset of the frame data within a slot
+    uint32_t maxFrameBytes;     ///< maximum number of frame data bytes in a slot
+    uint32_t producerPid;       ///< process ID of the producer
+    uint32_t latest;            ///< futex: sequence number of the most recent frame, 0 if none
+    uint32_t waiters;           ///< number of readers sleeping on 'latest'
+    uint32_t closed;            ///< 1 when the producer has stopped exporting
+    uint32_t reserved;
+} CapShmHeader;
+
+/** Layout of the start of each slot */
+typedef struct
+{
+    uint32_t generation;        ///< sequence lock, odd while the slot is written
+    uint32_t sequence;          ///< library frame sequence number
+    uint64_t captureTimestamp;  ///< see CapFrameInfo
+    uint64_t deliveryTimestamp; ///< see CapFrameInfo
+    uint32_t width;             ///< width in pixels
+    uint32_t height;            ///< height in pixels
+    uint32_t stride;            ///< number of bytes between two rows, 0 for compressed data
+    uint32_t format;            ///< CAPFORMAT_xxx
+    uint32_t bytes;             ///< number of valid frame data bytes
+    uint32_t reserved;
+} CapShmSlotHeader;
+
+/** A frame in shared memory, see CapShm_waitFrame */
+typedef struct
+{
+    const uint8_t* data;        ///< pointer to the frame data in shared memory
+    uint32_t width;             ///< width in pixels
+    uint32_t height;            ///< height in pixels
+    uint32_t stride;            ///< number of bytes between two rows, 0 for compressed data
+    uint32_t format;            ///< CAPFORMAT_xxx
+    uint32_t bytes;             ///< number of valid bytes at 'data'
+    uint32_t sequence;          ///< frame sequence number, starting at 1
+    uint64_t captureTimestamp;  ///< see CapFrameInfo
+    uint64_t deliveryTimestamp; ///< see CapFrameInfo
+    uint32_t slot;              ///< internal slot index, do not modify
+    uint32_t generation;        ///< internal slot generation, do not modify
+} CapShmFrame;
+
+typedef struct CapShmReader CapShmReader;   ///< opaque reader handle
+
+/** Attach to a stream exported under 'name' (e.g. "/camera0").
+    @return a reader handle or NULL if the shared memory object
+            does not exist or has an incompatible layout.
+*/
+DLLPUBLIC CapShmReader* CapShm_open(const char *name);
+
+/** Detach from the shared memory object. Frames returned
+    by CapShm_waitFrame become invalid. */
+DLLPUBLIC void CapShm_close(CapShmReader *reader);
+
+/** Wait until a frame newer than 'lastSequence' is available,
+    at most timeoutMs milliseconds, and return a view of the most
+    recent frame. Pass 0 as 'lastSequence' to get the most recent
+    frame without waiting, if there is one.
+
+    The frame data is not copied: 'frame->data' points into the
+    shared memory. The producer may overwrite the slot once it has
+    written 'slotCount-1' newer frames; call CapShm_isFrameValid
+    after using the data to find out.
+
+    @return CAPRESULT_OK, CAPRESULT_TIMEOUT or CAPRESULT_ERR if the
+            reader is invalid or the producer has stopped exporting.
+*/
+DLLPUBLIC CapResult CapShm_waitFrame(CapShmReader *reader, uint32_t lastSequence,
+    uint32_t timeoutMs, CapShmFrame *frame);
+
+/** Returns 1 if the data of a frame returned by CapShm_waitFrame
+    has not been overwritten by the producer, 0 otherwise. */
+DLLPUBLIC uint32_t CapShm_isFrameValid(CapShmReader *reader, const CapShmFrame *frame);
+
+#endif
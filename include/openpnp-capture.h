@@ -102,6 +102,63 @@ typedef struct
 #define CAPRESULT_DEVICENOTFOUND 2
 #define CAPRESULT_FORMATNOTSUPPORTED 3
 #define CAPRESULT_PROPERTYNOTSUPPORTED 4
+#define CAPRESULT_NOFRAME 5
+#define CAPRESULT_TIMEOUT 6
+
+// output pixel formats, see Cap_setOutputFormat
+#define CAPFORMAT_RGB24         0   ///< packed 8-bit R,G,B (default)
+#define CAPFORMAT_BGR24         1   ///< packed 8-bit B,G,R
+#define CAPFORMAT_RGBA32        2   ///< packed 8-bit R,G,B,A with A=255
+#define CAPFORMAT_BGRA32        3   ///< packed 8-bit B,G,R,A with A=255
+#define CAPFORMAT_GRAY8         4   ///< 8-bit luminance
+#define CAPFORMAT_NV12          5   ///< Y plane followed by an interleaved U,V plane at half resolution
+#define CAPFORMAT_I420          6   ///< Y plane followed by a U and a V plane at half resolution
+#define CAPFORMAT_NATIVE        7   ///< the unconverted camera data, e.g. MJPEG or YUYV
+
+/** Per-frame metadata, see Cap_captureFrameEx.
+    All timestamps are in microseconds. On Linux, they use 
+    CLOCK_MONOTONIC so they can be compared with 
+    clock_gettime(CLOCK_MONOTONIC, ...) in the application. 
+*/
+typedef struct
+{
+    uint64_t captureTimestamp;  ///< time the frame was captured by the driver, or the time it reached the library if the platform does not provide it
+    uint64_t deliveryTimestamp; ///< time the decoded frame was published by the library
+    uint32_t sequence;          ///< library frame sequence number, starting at 1
+    uint32_t deviceSequence;    ///< frame sequence number reported by the driver
+    uint32_t deviceDropped;     ///< cumulative number of frames dropped by the driver, derived from gaps in deviceSequence
+    uint32_t libraryDropped;    ///< cumulative number of frames received but not published by the library
+    uint32_t flags;             ///< platform dependent buffer flags (V4L2_BUF_FLAG_xxx on Linux)
+    uint32_t format;            ///< pixel format of the frame data (CAPFORMAT_xxx)
+    uint32_t bytes;             ///< number of valid bytes in the frame data
+} CapFrameInfo;
+
+/** A read-only view of a frame owned by the library,
+    see Cap_acquireFrame */
+typedef struct
+{
+    const uint8_t* data;    ///< pointer to the first pixel of the frame
+    uint32_t width;         ///< width in pixels
+    uint32_t height;        ///< height in pixels
+    uint32_t stride;        ///< number of bytes between the start of two consecutive rows
+    uint32_t sequence;      ///< frame sequence number, starting at 1
+    uint32_t slot;          ///< internal frame slot identifier, do not modify
+    CapFrameInfo info;      ///< frame metadata
+} CapFrameLease;
+
+/** A camera buffer exported as a DMABUF, see Cap_acquireDmaBuf */
+typedef struct
+{
+    int32_t  fd;            ///< DMABUF file descriptor, owned by the library
+    uint32_t bytes;         ///< number of valid bytes in the buffer
+    uint32_t length;        ///< size of the buffer in bytes
+    uint32_t width;         ///< width in pixels
+    uint32_t height;        ///< height in pixels
+    uint32_t stride;        ///< number of bytes between the start of two rows, 0 for compressed data
+    uint32_t fourCC;        ///< camera format of the data
+    uint32_t buffer;        ///< internal buffer identifier, do not modify
+    CapFrameInfo info;      ///< frame metadata
+} CapDmaBufLease;
 
 /********************************************************************************** 
      CONTEXT CREATION AND DEVICE ENUMERATION
@@ -118,6 +175,67 @@ DLLPUBLIC CapContext Cap_createContext(void);
 */
 DLLPUBLIC CapResult Cap_releaseContext(CapContext ctx);
 
+/** Select how the camera devices of a context are serviced.
+
+    By default (threads = 0), every open stream has a capture thread
+    of its own that waits for its camera and decodes its frames.
+
+    With threads > 0, the context starts that many threads which
+    wait for the cameras of all its streams with epoll, so the 
+    number of threads stays the same as cameras are added. A frame
+    is decoded by the thread that received it, so a thread that 
+    decodes a large frame delays the cameras that it would service
+    next; use about one thread per CPU core that is set aside for
+    capturing. A shared thread never waits for the application:
+    streams serviced by it treat CAPOVERFLOW_BLOCK as 
+    CAPOVERFLOW_DROPNEWEST, see Cap_setDeliveryMode.
+
+    Must be called before a stream is opened in the context.
+    Only supported on Linux.
+
+    @param ctx The ID of the context.
+    @param threads the number of shared capture threads, or 0 for one thread per stream.
+    @return CAPRESULT_OK, CAPRESULT_FORMATNOTSUPPORTED or CAPRESULT_ERR.
+*/
+DLLPUBLIC CapResult Cap_setReactorThreads(CapContext ctx, uint32_t threads);
+
+/** Select which threads decode the camera frames of a context.
+
+    By default (threads = 0), a frame is decoded by the capture
+    thread or reactor thread that received it, and the camera
+    buffer is only handed back to the driver afterwards.
+
+    With threads > 0, the context starts that many worker threads
+    that decode the frames of all its streams. The capture thread
+    copies a frame, hands the buffer back to the driver at once
+    and goes on waiting for the camera, so a stream with large
+    frames does not hold up the others.
+
+    Every thread has its own MJPEG decompressor, so a stream can
+    have as many frames in flight as there are threads, which
+    raises its frame rate when a single core cannot decode its
+    frames fast enough. When several streams are capturing, a
+    stream uses at most all threads but one, so a burst of one
+    camera does not hold up the others. Frames are still 
+    published in the order they arrived. When a stream has two
+    frames waiting for a thread, the oldest one is dropped and
+    counted in CapLatencyStats::staleFrames. The time frames
+    spend waiting for a thread and for earlier frames is reported
+    in CapLatencyStats::averagePipelineDelay and maxPipelineDelay.
+
+    Frames that are published as they arrive (CAPFORMAT_NATIVE),
+    decoded when read (CAPDECODE_LAZY) or exported as DMABUFs
+    are handled by the capture thread as before.
+
+    Must be called before a stream is opened in the context.
+    Only supported on Linux.
+
+    @param ctx The ID of the context.
+    @param threads the number of decode threads, or 0 to decode on the capture threads.
+    @return CAPRESULT_OK, CAPRESULT_FORMATNOTSUPPORTED or CAPRESULT_ERR.
+*/
+DLLPUBLIC CapResult Cap_setDecodeThreads(CapContext ctx, uint32_t threads);
+
 /** Get the number of capture devices on the system.
     note: this can change dynamically due to the
     pluggin and unplugging of USB devices.
@@ -180,6 +298,68 @@ DLLPUBLIC int32_t Cap_getNumFormats(CapContext ctx, CapDeviceID index);
 DLLPUBLIC CapResult Cap_getFormatInfo(CapContext ctx, CapDeviceID index, CapFormatID id, CapFormatInfo *info); 
 
 
+// frame delivery modes, see Cap_setDeliveryMode
+#define CAPDELIVERY_LATEST      0   ///< only the most recent frame is kept (default)
+#define CAPDELIVERY_FIFO        1   ///< frames are queued and read in capture order
+
+// FIFO overflow policies, see Cap_setDeliveryMode
+#define CAPOVERFLOW_DROPOLDEST  0   ///< discard the oldest queued frame
+#define CAPOVERFLOW_DROPNEWEST  1   ///< discard the incoming frame
+#define CAPOVERFLOW_BLOCK       2   ///< stall the stream's capture thread until there is room
+
+#define CAPDELIVERY_MAXDEPTH    32  ///< maximum FIFO depth
+
+// frame decode modes, see Cap_setDecodeMode
+#define CAPDECODE_EAGER         0   ///< every frame is decoded when it arrives (default)
+#define CAPDECODE_LAZY          1   ///< frames are decoded when they are read
+
+// capture I/O modes, see Cap_setIOMode
+#define CAPIO_MMAP              0   ///< the driver captures into its own buffers (default)
+#define CAPIO_USERPTR           1   ///< the driver captures into the frame buffers of the library
+
+// driver queue policies, see Cap_setCaptureQueue
+#define CAPQUEUE_ALL            0   ///< every frame the driver delivers is processed in order (default)
+#define CAPQUEUE_NEWEST         1   ///< frames that are already stale when they are dequeued are skipped
+
+#define CAPQUEUE_DEFAULTBUFFERS 8   ///< default number of driver buffers
+#define CAPQUEUE_MAXBUFFERS     32  ///< maximum number of driver buffers
+
+/** Frame age statistics of a stream, see Cap_getLatencyStats.
+    The age of a frame is its deliveryTimestamp minus its
+    captureTimestamp, in microseconds. */
+typedef struct
+{
+    uint32_t frames;            ///< number of frames published since the last reset
+    uint32_t staleFrames;       ///< number of frames skipped for a newer one since the last reset, see CAPQUEUE_NEWEST and Cap_setDecodeThreads
+    uint64_t lastAge;           ///< age of the most recently published frame
+    uint64_t averageAge;        ///< average age of the published frames
+    uint64_t maxAge;            ///< maximum age of the published frames
+    uint32_t pipelineFrames;    ///< number of published frames decoded by the decode threads, see Cap_setDecodeThreads
+    uint64_t averagePipelineDelay;  ///< average time those frames waited for a decode thread and for earlier frames
+    uint64_t maxPipelineDelay;  ///< maximum time those frames waited for a decode thread and for earlier frames
+} CapLatencyStats;
+
+// thread scheduling policies, see Cap_setThreadPolicy
+#define CAPTHREAD_NORMAL        0       ///< the normal time-sharing scheduler (default)
+#define CAPTHREAD_FIFO          1       ///< real-time first-in first-out scheduling
+#define CAPTHREAD_RR            2       ///< real-time round-robin scheduling
+#define CAPTHREAD_LOCKMEMORY    0x100   ///< flag: lock all memory of the process with mlockall
+
+/** A region of interest and its destination buffer, see Cap_captureFrameROI */
+typedef struct
+{
+    uint32_t x;             ///< left edge of the region in pixels
+    uint32_t y;             ///< top edge of the region in pixels
+    uint32_t width;         ///< width of the region in pixels
+    uint32_t height;        ///< height of the region in pixels
+    void*    buffer;        ///< destination buffer
+    uint32_t bufferBytes;   ///< size of the destination buffer in bytes
+    uint32_t stride;        ///< number of bytes between two rows in the buffer, 0 for tightly packed rows
+} CapROI;
+
+/** Frame callback function, see Cap_setFrameCallback */
+typedef void (*CapFrameCallback)(const CapFrameLease *frame, void *user);
+
 /********************************************************************************** 
      STREAM MANAGEMENT
 **********************************************************************************/
@@ -187,7 +367,19 @@ DLLPUBLIC CapResult Cap_getFormatInfo(CapContext ctx, CapDeviceID index, CapForm
 /** Open a capture stream to a device with specific format requirements 
 
     Although the (internal) frame buffer format is set via the fourCC ID,
-    the frames returned by Cap_captureFrame are always 24-bit RGB.
+    the frames returned by Cap_captureFrame are 24-bit RGB unless
+    another format is selected with Cap_setOutputFormat.
+
+    A device can be opened more than once in the same context, e.g.
+    for a preview and an image processing thread. The extra stream 
+    IDs share the capture and decoding of the first one: the device
+    is captured and decoded once. Each stream ID has its own new frame
+    flag (see Cap_hasNewFrame), but the output format, scale, decode 
+    mode, delivery mode, frame callback and camera properties are
+    shared. In CAPDELIVERY_FIFO mode, the queue is shared as well, 
+    so each frame is read through only one of the IDs. Opening an
+    open device with a different formatID fails. The device is closed
+    when all of its stream IDs have been closed.
 
     @param ctx The ID of the context.
     @param index The device index of the capture device.
@@ -197,6 +389,11 @@ DLLPUBLIC CapResult Cap_getFormatInfo(CapContext ctx, CapDeviceID index, CapForm
 DLLPUBLIC CapStream Cap_openStream(CapContext ctx, CapDeviceID index, CapFormatID formatID);
 
 /** Close a capture stream 
+
+    The capture thread is woken up and stopped right away, also
+    when the camera has stopped delivering frames. A frame that
+    is being decoded is finished first.
+
     @param ctx The ID of the context.
     @param stream The stream ID.
     @return CapResult
@@ -219,9 +416,558 @@ DLLPUBLIC uint32_t Cap_isOpenStream(CapContext ctx, CapStream stream);
 */
 DLLPUBLIC CapResult Cap_captureFrame(CapContext ctx, CapStream stream, void *RGBbufferPtr, uint32_t RGBbufferBytes);
 
-/** returns 1 if a new frame has been captured, 0 otherwise */
+/** this function copies the most recent RGB frame data
+    to the given buffer and fills 'info' with the metadata
+    of that frame, such as the capture timestamp, the driver
+    sequence number and the number of dropped frames.
+
+    If no frame has been captured yet, info is zeroed.
+
+    @param ctx The ID of the context.
+    @param stream The stream ID.
+    @param RGBbufferPtr pointer to the destination buffer.
+    @param RGBbufferBytes size of the destination buffer in bytes.
+    @param info pointer to a CapFrameInfo structure to be filled with data, can be NULL.
+    @return CapResult
+*/
+DLLPUBLIC CapResult Cap_captureFrameEx(CapContext ctx, CapStream stream, void *RGBbufferPtr, uint32_t RGBbufferBytes,
+    CapFrameInfo *info);
+
+/** this function copies the most recent frame to a buffer
+    whose rows are 'stride' bytes apart, e.g. a QImage with
+    4-byte aligned scanlines or a region of a larger image.
+
+    In CAPDECODE_LAZY mode, a frame that has not been read yet
+    is decoded straight into the buffer, so the frame lands in
+    its final layout in a single pass. Otherwise, the decoded
+    frame is copied row by row.
+
+    For planar formats, 'stride' is the stride of the Y plane,
+    see Cap_setOutputFormat. For CAPFORMAT_NATIVE, the stride is
+    ignored.
+
+    @param ctx The ID of the context.
+    @param stream The stream ID.
+    @param bufferPtr pointer to the destination buffer.
+    @param bufferBytes size of the destination buffer in bytes, at least stride * height for packed formats.
+    @param stride number of bytes between the start of two consecutive rows, 0 for tightly packed rows.
+    @param info pointer to a CapFrameInfo structure to be filled with data, can be NULL.
+    @return CAPRESULT_OK or CAPRESULT_ERR if the stride or buffer is too small.
+*/
+DLLPUBLIC CapResult Cap_captureFrameStrided(CapContext ctx, CapStream stream, void *bufferPtr, uint32_t bufferBytes,
+    uint32_t stride, CapFrameInfo *info);
+
+/** this function copies one or more regions of the most recent
+    frame to separate buffers. All regions are taken from the same
+    frame and can overlap.
+
+    In CAPDECODE_LAZY mode, only the regions are decoded: for
+    MJPEG, scanlines above and below a region are skipped and
+    only the JPEG blocks covering it are decoded, and for YUYV only 
+    the pixels inside the region are converted. When the regions 
+    cover more than half of the frame, the whole frame is decoded 
+    once instead. In CAPDECODE_EAGER mode, the regions are copied
+    from the decoded frame.
+
+    Only packed and gray output formats are supported, see 
+    Cap_setOutputFormat.
+
+    @param ctx The ID of the context.
+    @param stream The stream ID.
+    @param rois pointer to an array of regions.
+    @param roiCount the number of regions.
+    @param info pointer to a CapFrameInfo structure to be filled with data, can be NULL.
+    @return CAPRESULT_OK, CAPRESULT_NOFRAME if no frame is available or
+            CAPRESULT_ERR if a region is outside the frame or its
+            buffer is too small.
+*/
+DLLPUBLIC CapResult Cap_captureFrameROI(CapContext ctx, CapStream stream, const CapROI *rois, uint32_t roiCount,
+    CapFrameInfo *info);
+
+/** this function copies the undecoded camera payload of the most
+    recent frame, e.g. the JPEG bitstream of an MJPEG camera, so it 
+    can be stored or forwarded without decoding it.
+
+    The payload is available:
+      - for MJPEG cameras, in all modes,
+      - for all cameras, in CAPDECODE_LAZY mode,
+      - in CAPFORMAT_NATIVE output format.
+    
+    In CAPDECODE_LAZY mode, frames that are only read with this
+    function are never decoded. Capture the frame with
+    Cap_captureFrame to decode it.
+
+    Like Cap_captureFrame, this consumes the new frame flag
+    or, in FIFO mode, the oldest frame in the queue.
+
+    @param ctx The ID of the context.
+    @param stream The stream ID.
+    @param buffer pointer to the destination buffer.
+    @param bufferBytes size of the destination buffer in bytes.
+    @param payloadBytes receives the size of the payload in bytes,
+           also when the buffer is too small.
+    @param fourCC receives the FOURCC of the payload, can be NULL.
+    @param info pointer to a CapFrameInfo structure to be filled with data, can be NULL.
+    @return CAPRESULT_OK, CAPRESULT_NOFRAME if no frame is available,
+            CAPRESULT_FORMATNOTSUPPORTED if the frame has no payload or
+            CAPRESULT_ERR if the buffer is too small.
+*/
+DLLPUBLIC CapResult Cap_captureRawFrame(CapContext ctx, CapStream stream, void *buffer, uint32_t bufferBytes,
+    uint32_t *payloadBytes, uint32_t *fourCC, CapFrameInfo *info);
+
+/** Lease the most recent RGB frame without copying it.
+
+    The frame data is owned by the library and remains valid
+    and unchanged until the lease is returned with Cap_releaseFrame.
+    Capturing continues into other buffers in the meantime.
+    The number of frames that can be leased at the same time
+    is small: when all buffers are leased, new frames are dropped
+    so leases should be returned as soon as possible.
+
+    All leases must be released before the stream is closed.
+
+    @param ctx The ID of the context.
+    @param stream The stream ID.
+    @param lease pointer to a CapFrameLease structure to be filled with data.
+    @return CAPRESULT_OK, CAPRESULT_NOFRAME if no frame has been captured yet
+            or CAPRESULT_ERR if the context or stream are invalid.
+*/
+DLLPUBLIC CapResult Cap_acquireFrame(CapContext ctx, CapStream stream, CapFrameLease *lease);
+
+/** Return a frame leased by Cap_acquireFrame to the library.
+    @param ctx The ID of the context.
+    @param stream The stream ID.
+    @param lease pointer to the CapFrameLease structure filled by Cap_acquireFrame.
+    @return CapResult
+*/
+DLLPUBLIC CapResult Cap_releaseFrame(CapContext ctx, CapStream stream, const CapFrameLease *lease);
+
+/** returns 1 if a new frame has been captured since the last frame
+    was read through this stream ID, 0 otherwise */
 DLLPUBLIC uint32_t Cap_hasNewFrame(CapContext ctx, CapStream stream);
 
+/** Block until a new frame has been captured, the timeout expires
+    or the stream is closed by another thread.
+
+    This is the blocking alternative to polling Cap_hasNewFrame:
+    the calling thread is woken as soon as a frame is published.
+    The new frame flag is not reset; call Cap_captureFrame or
+    Cap_acquireFrame to read the frame.
+
+    @param ctx The ID of the context.
+    @param stream The stream ID.
+    @param timeoutMs maximum time to wait in milliseconds.
+    @return CAPRESULT_OK if a new frame is available,
+            CAPRESULT_TIMEOUT if the timeout expired or
+            CAPRESULT_ERR if the stream is invalid or was closed.
+*/
+DLLPUBLIC CapResult Cap_waitForNewFrame(CapContext ctx, CapStream stream, uint32_t timeoutMs);
+
+/** Select how frames are delivered by Cap_captureFrame and Cap_acquireFrame.
+
+    In CAPDELIVERY_LATEST mode (the default), only the most recent
+    frame is kept and frames that are not read in time are replaced.
+
+    In CAPDELIVERY_FIFO mode, up to 'depth' frames are queued in
+    pre-allocated buffers and each call to Cap_captureFrame or 
+    Cap_acquireFrame removes the oldest one, so no frame is lost
+    during bursts. Cap_hasNewFrame returns 1 as long as the queue 
+    is not empty and Cap_captureFrame returns CAPRESULT_ERR when 
+    it is empty.
+
+    When the queue is full, 'overflowPolicy' decides what happens:
+      CAPOVERFLOW_DROPOLDEST: the oldest queued frame is discarded.
+      CAPOVERFLOW_DROPNEWEST: the incoming frame is discarded before
+                              it is decoded.
+      CAPOVERFLOW_BLOCK:      the capture thread waits until the
+                              application reads a frame. The camera
+                              driver will drop frames while it waits.
+                              Streams serviced by the shared threads
+                              of Cap_setReactorThreads cannot stall
+                              the other cameras: they drop the 
+                              incoming frame, as with
+                              CAPOVERFLOW_DROPNEWEST.
+
+    Switching back to CAPDELIVERY_LATEST discards all queued frames.
+
+    @param ctx The ID of the context.
+    @param stream The stream ID.
+    @param mode CAPDELIVERY_LATEST or CAPDELIVERY_FIFO.
+    @param depth the number of frames in the FIFO (1 .. CAPDELIVERY_MAXDEPTH), ignored in CAPDELIVERY_LATEST mode.
+    @param overflowPolicy one of the CAPOVERFLOW_xxx values, ignored in CAPDELIVERY_LATEST mode.
+    @return CapResult
+*/
+DLLPUBLIC CapResult Cap_setDeliveryMode(CapContext ctx, CapStream stream, uint32_t mode, uint32_t depth, uint32_t overflowPolicy);
+
+/** Returns the number of times a frame arrived while the FIFO
+    was full, see Cap_setDeliveryMode. */
+DLLPUBLIC uint32_t Cap_getStreamOverflowCount(CapContext ctx, CapStream stream);
+
+/** Select the pixel format of the frames returned by Cap_captureFrame,
+    Cap_acquireFrame and the frame callback.
+
+    The camera data is converted directly into the requested format
+    by the decoder, so no extra pass over the frame is needed. 
+    Frames captured before the call keep their format; use
+    CapFrameInfo.format to find out the format of a frame.
+
+    Planar formats (CAPFORMAT_NV12, CAPFORMAT_I420) store the chroma
+    planes directly after the Y plane. The stride of a frame is the
+    stride of the Y plane; the NV12 chroma plane has the same stride
+    and the I420 chroma planes have half the stride, rounded up.
+
+    CAPFORMAT_GRAY8 is the cheapest format for YUYV and MJPEG
+    cameras: the luminance of a YUYV frame is copied as it is,
+    and only the luminance of a JPEG frame is decoded, without
+    colour conversion and chroma upsampling.
+
+    CAPFORMAT_NATIVE passes the camera data through without
+    conversion. The size of such a frame can vary, see 
+    CapFrameInfo.bytes, and the stride can be 0 for
+    compressed data.
+
+    Not every platform and camera format supports every output format.
+
+    @param ctx The ID of the context.
+    @param stream The stream ID.
+    @param format one of the CAPFORMAT_xxx values.
+    @return CAPRESULT_OK, CAPRESULT_FORMATNOTSUPPORTED or CAPRESULT_ERR.
+*/
+DLLPUBLIC CapResult Cap_setOutputFormat(CapContext ctx, CapStream stream, uint32_t format);
+
+/** Returns the size in bytes of a buffer that can hold one frame 
+    in the current output format and scale, see Cap_setOutputFormat
+    and Cap_setOutputScale.
+    Returns 0 if the stream is invalid or not open. */
+DLLPUBLIC uint32_t Cap_getOutputFrameBytes(CapContext ctx, CapStream stream);
+
+/** Scale the frames down by 1/denom, e.g. for previews.
+
+    MJPEG frames are scaled by the JPEG decoder, which skips most
+    of the IDCT work, so a scaled frame is much cheaper to produce
+    than a full frame. YUYV frames are subsampled while they are
+    converted. The output size is the camera resolution divided
+    by denom and rounded up, see Cap_getOutputFrameSize.
+
+    CAPFORMAT_NATIVE frames are never scaled.
+
+    @param ctx The ID of the context.
+    @param stream The stream ID.
+    @param denom 1 (no scaling), 2, 4 or 8.
+    @return CAPRESULT_OK, CAPRESULT_FORMATNOTSUPPORTED or CAPRESULT_ERR.
+*/
+DLLPUBLIC CapResult Cap_setOutputScale(CapContext ctx, CapStream stream, uint32_t denom);
+
+/** Get the size of the frames at the current output scale,
+    see Cap_setOutputScale.
+    @param ctx The ID of the context.
+    @param stream The stream ID.
+    @param width pointer to a variable that receives the width in pixels.
+    @param height pointer to a variable that receives the height in pixels.
+    @return CapResult
+*/
+DLLPUBLIC CapResult Cap_getOutputFrameSize(CapContext ctx, CapStream stream, uint32_t *width, uint32_t *height);
+
+/** Select when compressed (MJPEG) and YUV frames are converted to RGB.
+
+    In CAPDECODE_EAGER mode (the default), the capture thread, or a
+    decode thread (see Cap_setDecodeThreads), decodes every frame the
+    camera delivers.
+
+    In CAPDECODE_LAZY mode, the capture thread only stores the camera
+    payload. The frame is decoded by the first call to Cap_captureFrame
+    or Cap_acquireFrame that reads it, and the result is kept, so
+    reading the same frame again does not decode it again. Frames
+    that are never read are never decoded. This saves a lot of CPU
+    time when the application reads fewer frames than the camera
+    delivers.
+
+    If a frame callback is installed, every frame that is passed to
+    the callback is decoded by the capture thread.
+
+    When a lazily decoded frame turns out to be corrupt, Cap_captureFrame
+    returns CAPRESULT_ERR and Cap_acquireFrame returns CAPRESULT_NOFRAME.
+
+    @param ctx The ID of the context.
+    @param stream The stream ID.
+    @param mode CAPDECODE_EAGER or CAPDECODE_LAZY.
+    @return CapResult
+*/
+DLLPUBLIC CapResult Cap_setDecodeMode(CapContext ctx, CapStream stream, uint32_t mode);
+
+/** Only publish every n-th frame the camera delivers, e.g. 6 to
+    get 5 frames per second from a camera that only offers 30.
+
+    The capture thread hands the skipped frames straight back to the
+    driver, without copying or decoding them, so they cost almost no
+    CPU time. Skipped frames are not counted as dropped in CapFrameInfo.
+
+    @param ctx The ID of the context.
+    @param stream The stream ID.
+    @param n publish one in n frames, 0 or 1 publishes all frames.
+    @return CapResult
+*/
+DLLPUBLIC CapResult Cap_setOutputDecimation(CapContext ctx, CapStream stream, uint32_t n);
+
+/** Publish at most 'fps' frames per second, independent of the 
+    frame rate of the camera. Frames are skipped like with
+    Cap_setOutputDecimation, the others are evenly paced by their
+    arrival time. When both are set, the frame rate limit applies 
+    to the frames left by the decimation.
+
+    @param ctx The ID of the context.
+    @param stream The stream ID.
+    @param fps maximum number of frames per second, 0 for no limit.
+    @return CapResult
+*/
+DLLPUBLIC CapResult Cap_setMaxOutputFrameRate(CapContext ctx, CapStream stream, uint32_t fps);
+
+/** Install a callback that is called for every frame as soon as it
+    has been decoded. The callback receives a read-only view of the
+    frame in the library's own buffer, so no copy is made.
+
+    Threading contract:
+      * the callback is called from a library-owned capture thread,
+        never from the thread that installed it.
+      * callbacks for one stream are never run concurrently.
+      * the frame data is only valid until the callback returns.
+        Call Cap_acquireFrame from within the callback to keep
+        the frame for longer.
+      * the callback must not call Cap_setFrameCallback, 
+        Cap_closeStream or Cap_releaseContext.
+
+    Backpressure: frames are never queued for the callback.
+    While the callback runs, the capture thread of the stream 
+    is blocked; the camera driver buffers a few frames and
+    then drops new ones. A frame that is completed while the 
+    callback is still busy with an earlier frame is skipped
+    and only delivered through Cap_captureFrame.
+    Keep the callback short or hand the work to another thread.
+
+    When Cap_setFrameCallback returns, the previous callback
+    is no longer running and will not be called again.
+
+    @param ctx The ID of the context.
+    @param stream The stream ID.
+    @param callback the callback function or NULL to remove it.
+    @param user a user pointer that is passed to the callback.
+    @return CapResult
+*/
+DLLPUBLIC CapResult Cap_setFrameCallback(CapContext ctx, CapStream stream, CapFrameCallback callback, void *user);
+
+/** Export the frames of a stream to another process through a
+    POSIX shared memory object, e.g. "/camera0". Every frame is 
+    written into a ring of 'slotCount' slots, in the output format
+    of the stream, together with its sequence number, timestamps,
+    format and stride. Other processes read the frames without 
+    copying with the openpnp-capture-shm library, see 
+    openpnp-capture-shm.h.
+
+    The capture thread never waits for readers: a reader that
+    falls more than slotCount-1 frames behind sees its frame 
+    being overwritten. In CAPDECODE_LAZY mode, exported frames 
+    are decoded by the capture thread.
+
+    Only supported on Linux.
+
+    @param ctx The ID of the context.
+    @param stream The stream ID.
+    @param name the name of the shared memory object or NULL to stop exporting.
+    @param slotCount the number of frames in the ring, at least 2.
+    @return CapResult
+*/
+DLLPUBLIC CapResult Cap_setSharedMemoryExport(CapContext ctx, CapStream stream, const char *name, uint32_t slotCount);
+
+/** Make the camera buffers available to other devices, e.g. a
+    hardware encoder or a GPU, as DMABUF file descriptors, so they
+    can import a frame without a CPU copy.
+
+    When enabled, the capture thread keeps the driver buffer of the
+    most recent frame instead of handing it back to the driver. It
+    can be leased with Cap_acquireDmaBuf. The frames are still
+    decoded as usual; select CAPDECODE_LAZY to avoid decoding frames
+    that are only used through their DMABUF.
+
+    Only supported on Linux, for cameras that use streaming I/O in
+    CAPIO_MMAP mode and support VIDIOC_EXPBUF. If the driver cannot export its buffers,
+    the export is disabled and Cap_acquireDmaBuf returns 
+    CAPRESULT_NOFRAME.
+
+    @param ctx The ID of the context.
+    @param stream The stream ID.
+    @param enable 1 to export the buffers, 0 to stop.
+    @return CAPRESULT_OK, CAPRESULT_FORMATNOTSUPPORTED if the platform
+            does not support DMABUFs or CAPRESULT_ERR.
+*/
+DLLPUBLIC CapResult Cap_setDmaBufExport(CapContext ctx, CapStream stream, uint32_t enable);
+
+/** Lease the camera buffer of the most recent frame as a DMABUF,
+    see Cap_setDmaBufExport.
+
+    The buffer holds the camera data, e.g. YUYV or MJPEG, see
+    CapDmaBufLease.fourCC. It is not handed back to the driver, 
+    and its contents stay unchanged, until the lease is returned 
+    with Cap_releaseDmaBuf. The file descriptor is owned by the
+    library and stays open until the stream is closed or capturing
+    is restarted by Cap_setIOMode or Cap_setCaptureQueue; dup() it
+    or import it into another API to keep it longer. A buffer
+    can be leased more than once.
+
+    The driver needs at least two buffers to keep capturing. While
+    the application holds too many buffers, new frames are captured
+    but not exported.
+
+    @param ctx The ID of the context.
+    @param stream The stream ID.
+    @param lease pointer to a CapDmaBufLease structure to be filled with data.
+    @return CAPRESULT_OK, CAPRESULT_NOFRAME if no buffer has been exported yet
+            or CAPRESULT_ERR.
+*/
+DLLPUBLIC CapResult Cap_acquireDmaBuf(CapContext ctx, CapStream stream, CapDmaBufLease *lease);
+
+/** Return a buffer leased with Cap_acquireDmaBuf.
+    @param ctx The ID of the context.
+    @param stream The stream ID.
+    @param lease pointer to the lease filled in by Cap_acquireDmaBuf.
+    @return CapResult
+*/
+DLLPUBLIC CapResult Cap_releaseDmaBuf(CapContext ctx, CapStream stream, const CapDmaBufLease *lease);
+
+/** Select how the driver hands frames to the library.
+
+    In CAPIO_MMAP mode (the default), the driver captures into its
+    own buffers and every frame is copied or decoded from there.
+
+    In CAPIO_USERPTR mode, the driver captures straight into the
+    page-aligned frame buffers of the library. When the camera
+    format and the output format are the same (RGB24 cameras with
+    CAPFORMAT_RGB24, GREY cameras with CAPFORMAT_GRAY8, or 
+    CAPFORMAT_NATIVE) and the output is not scaled, the captured 
+    buffer is published as it is, without a copy. Other frames
+    are converted as in CAPIO_MMAP mode.
+
+    If the driver does not accept CAPIO_USERPTR, the stream falls
+    back to CAPIO_MMAP; see Cap_getIOMode. Capturing is restarted
+    when the mode changes, which can drop a frame. A frame that
+    waits for room in the FIFO (CAPOVERFLOW_BLOCK) is dropped, so
+    the restart never waits for the application.
+
+    Only supported on Linux.
+
+    @param ctx The ID of the context.
+    @param stream The stream ID.
+    @param mode CAPIO_MMAP or CAPIO_USERPTR.
+    @return CAPRESULT_OK, CAPRESULT_FORMATNOTSUPPORTED or CAPRESULT_ERR.
+*/
+DLLPUBLIC CapResult Cap_setIOMode(CapContext ctx, CapStream stream, uint32_t mode);
+
+/** Returns the I/O mode (CAPIO_xxx) the stream uses, which can
+    differ from the mode selected with Cap_setIOMode if the driver 
+    does not support it. */
+DLLPUBLIC uint32_t Cap_getIOMode(CapContext ctx, CapStream stream);
+
+/** Set the number of buffers the driver captures into and
+    how the frames that queue up in them are processed.
+
+    Frames wait in the driver buffers while the capture thread
+    is busy decoding an earlier frame. With CAPQUEUE_ALL (the 
+    default), every frame is processed in capture order, so when
+    decoding cannot keep up with the camera, the published frames
+    lag behind by up to 'bufferCount' frame times.
+
+    With CAPQUEUE_NEWEST, the capture thread takes all frames that
+    are waiting each time it looks for one, hands all but the most
+    recent back to the driver without decoding them, and publishes
+    only the most recent one. The skipped frames are counted in
+    CapFrameInfo.libraryDropped. Together with a small buffer count,
+    this keeps the published frames as fresh as the decoder allows.
+    Use Cap_getLatencyStats to measure the effect.
+
+    Capturing is restarted when the buffer count changes, which
+    can drop a frame. A frame that waits for room in the FIFO
+    (CAPOVERFLOW_BLOCK) is dropped, so the restart never waits for
+    the application. The driver can use more or fewer buffers
+    than requested.
+
+    Only supported on Linux, for cameras that use streaming I/O.
+
+    @param ctx The ID of the context.
+    @param stream The stream ID.
+    @param bufferCount the number of driver buffers, 2 .. CAPQUEUE_MAXBUFFERS,
+           or 0 for CAPQUEUE_DEFAULTBUFFERS.
+    @param policy CAPQUEUE_ALL or CAPQUEUE_NEWEST.
+    @return CAPRESULT_OK, CAPRESULT_FORMATNOTSUPPORTED or CAPRESULT_ERR.
+*/
+DLLPUBLIC CapResult Cap_setCaptureQueue(CapContext ctx, CapStream stream, uint32_t bufferCount, uint32_t policy);
+
+/** Get the frame age statistics of a stream, see CapLatencyStats.
+
+    The age of a frame covers the time it waited in the driver
+    and the time the library took to decode it. In CAPDECODE_LAZY
+    mode, frames are published before they are decoded. When the
+    driver does not provide monotonic timestamps, the age starts 
+    when the frame reaches the library.
+
+    @param ctx The ID of the context.
+    @param stream The stream ID.
+    @param stats pointer to a CapLatencyStats structure to be filled.
+    @return CapResult
+*/
+DLLPUBLIC CapResult Cap_getLatencyStats(CapContext ctx, CapStream stream, CapLatencyStats *stats);
+
+/** Reset the frame age statistics of a stream, e.g. after
+    changing the capture queue with Cap_setCaptureQueue.
+    @param ctx The ID of the context.
+    @param stream The stream ID.
+    @return CapResult
+*/
+DLLPUBLIC CapResult Cap_resetLatencyStats(CapContext ctx, CapStream stream);
+
+/** Set the scheduling policy, priority and CPU affinity of the 
+    capture thread of a stream, so that the threads of the
+    application do not delay frame delivery.
+
+    With CAPTHREAD_FIFO or CAPTHREAD_RR, the thread runs with a
+    real-time priority of 1 (lowest) to 99. This needs the 
+    CAP_SYS_NICE capability or a suitable RLIMIT_RTPRIO. With
+    the CAPTHREAD_LOCKMEMORY flag, all memory of the process,
+    including the frame buffers, is locked in RAM with mlockall,
+    which needs CAP_IPC_LOCK or a suitable RLIMIT_MEMLOCK. The 
+    memory stays locked when the flag is cleared again.
+
+    The policy is kept when capturing is restarted. When the
+    context uses shared capture threads (see Cap_setReactorThreads),
+    those follow the context default, see Cap_setDefaultThreadPolicy.
+
+    Only supported on Linux.
+
+    @param ctx The ID of the context.
+    @param stream The stream ID.
+    @param policy CAPTHREAD_NORMAL, CAPTHREAD_FIFO or CAPTHREAD_RR, optionally
+           combined with CAPTHREAD_LOCKMEMORY.
+    @param priority the real-time priority, ignored for CAPTHREAD_NORMAL.
+    @param cpuMask bit n selects CPU n; 0 allows all CPUs.
+    @return CAPRESULT_OK, CAPRESULT_FORMATNOTSUPPORTED, or CAPRESULT_ERR if the
+            arguments are invalid or a part of the policy could not be applied,
+            e.g. for lack of privileges. Capturing continues in that case and
+            the reason is logged.
+*/
+DLLPUBLIC CapResult Cap_setThreadPolicy(CapContext ctx, CapStream stream, uint32_t policy, 
+    int32_t priority, uint64_t cpuMask);
+
+/** Set the default thread policy of a context, see Cap_setThreadPolicy.
+    It applies to the capture threads of streams opened from now on
+    and, right away, to the shared capture threads of the context.
+
+    @param ctx The ID of the context.
+    @param policy CAPTHREAD_xxx, optionally combined with CAPTHREAD_LOCKMEMORY.
+    @param priority the real-time priority, ignored for CAPTHREAD_NORMAL.
+    @param cpuMask bit n selects CPU n; 0 allows all CPUs.
+    @return CapResult, see Cap_setThreadPolicy.
+*/
+DLLPUBLIC CapResult Cap_setDefaultThreadPolicy(CapContext ctx, uint32_t policy, 
+    int32_t priority, uint64_t cpuMask);
+
 /** returns the number of frames captured during the lifetime of the stream. 
     For debugging purposes */
 DLLPUBLIC uint32_t Cap_getStreamFrameCount(CapContext ctx, CapStream stream);
@@ -272,6 +1018,43 @@ DLLPUBLIC CapResult Cap_getProperty(CapContext ctx, CapStream stream, CapPropert
 */
 DLLPUBLIC CapResult Cap_getAutoProperty(CapContext ctx, CapStream stream, CapPropertyID propID, uint32_t *outValue);
 
+/********************************************************************************** 
+     FRAME BUFFER POOL
+**********************************************************************************/
+
+// buffer pool flags, see Cap_configureBufferPool
+#define CAPPOOL_HUGEPAGES   1   ///< back large buffers with (transparent) huge pages, Linux only
+
+/** Statistics of the library-wide frame buffer pool */
+typedef struct
+{
+    uint64_t bytesInUse;        ///< bytes in buffers used by streams and decoders
+    uint64_t bytesCached;       ///< bytes in released buffers kept for re-use
+    uint64_t highWaterMark;     ///< maximum of bytesInUse + bytesCached so far
+    uint32_t allocations;       ///< number of buffers allocated from the system
+    uint32_t reuses;            ///< number of buffers re-used from the pool
+} CapBufferPoolStats;
+
+/** Configure the frame buffer pool shared by all contexts.
+
+    All frame storage of the library (frame buffers, camera payloads,
+    decoder scratch buffers) is 64-byte aligned and comes from a pool
+    that keeps released buffers for re-use, so closing and re-opening
+    a stream, e.g. to switch formats, does not go back to the system.
+
+    @param flags CAPPOOL_xxx flags, applied to buffers allocated from now on.
+    @param maxCachedBytes maximum number of bytes kept in released buffers.
+           Buffers beyond this limit are returned to the system.
+    @return CapResult
+*/
+DLLPUBLIC CapResult Cap_configureBufferPool(uint32_t flags, uint64_t maxCachedBytes);
+
+/** Get the statistics of the frame buffer pool.
+    @param stats pointer to a CapBufferPoolStats structure to be filled.
+    @return CapResult
+*/
+DLLPUBLIC CapResult Cap_getBufferPoolStats(CapBufferPoolStats *stats);
+
 /********************************************************************************** 
      DEBUGGING
 **********************************************************************************/
@@ -0,0 +1,275 @@
+/*
+
+    OpenPnp-Capture: a video capture subsystem.
+
+    Linux platform code, epoll reactor that services
+    the V4L2 devices of several streams
+
+    Copyright (c) 2017 Jason von Nieda, Niels Moseley.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+*/
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <errno.h>
+#include "capturereactor.h"
+#include "platformstream.h"
+#include "../common/logging.h"
+
+// the key of the wake-up eventfd
+static const uint64_t c_wakeKey = 0;
+
+// events handled per epoll_wait call
+static const int c_maxEvents = 16;
+
+CaptureReactor::CaptureReactor() :
+    m_epollFd(-1),
+    m_wakeFd(-1),
+    m_quit(false),
+    m_nextKey(c_wakeKey + 1)
+{
+}
+
+CaptureReactor::~CaptureReactor()
+{
+    stop();
+}
+
+bool CaptureReactor::start(uint32_t threads)
+{
+    stop();
+
+    if (threads == 0)
+    {
+        return false;
+    }
+
+    m_epollFd = epoll_create1(EPOLL_CLOEXEC);
+    m_wakeFd  = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if ((m_epollFd < 0) || (m_wakeFd < 0))
+    {
+        LOG(LOG_ERR, "CaptureReactor: could not create the epoll instance (errno %d)\n", errno);
+        stop();
+        return false;
+    }
+
+    // level-triggered, so every thread sees it
+    epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u64 = c_wakeKey;
+    if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_wakeFd, &ev) != 0)
+    {
+        LOG(LOG_ERR, "CaptureReactor: could not watch the eventfd (errno %d)\n", errno);
+        stop();
+        return false;
+    }
+
+    m_quit = false;
+    for(uint32_t i=0; i<threads; i++)
+    {
+        m_threads.push_back(new std::thread(&CaptureReactor::threadFunction, this));
+        if (!m_policy.isDefault())
+        {
+            m_policy.apply(m_threads.back()->native_handle());
+        }
+    }
+
+    LOG(LOG_INFO, "CaptureReactor: started %d thread(s)\n", threads);
+    return true;
+}
+
+void CaptureReactor::stop()
+{
+    m_quit = true;
+    if (m_wakeFd >= 0)
+    {
+        const uint64_t one = 1;
+        if (write(m_wakeFd, &one, sizeof(one)) != sizeof(one))
+        {
+            LOG(LOG_ERR, "CaptureReactor: could not wake the threads (errno %d)\n", errno);
+        }
+    }
+
+    for(uint32_t i=0; i<m_threads.size(); i++)
+    {
+        m_threads[i]->join();
+        delete m_threads[i];
+    }
+    m_threads.clear();
+
+    if (!m_entries.empty())
+    {
+        LOG(LOG_ERR, "CaptureReactor: stopped with %d device(s) still registered\n", m_entries.size());
+        m_entries.clear();
+    }
+
+    if (m_wakeFd >= 0)
+    {
+        ::close(m_wakeFd);
+        m_wakeFd = -1;
+    }
+
+    if (m_epollFd >= 0)
+    {
+        ::close(m_epollFd);
+        m_epollFd = -1;
+    }
+}
+
+bool CaptureReactor::setThreadPolicy(const ThreadPolicy &policy)
+{
+    m_policy = policy;
+
+    bool ok = true;
+    for(uint32_t i=0; i<m_threads.size(); i++)
+    {
+        ok = m_policy.apply(m_threads[i]->native_handle()) && ok;
+    }
+    return ok;
+}
+
+bool CaptureReactor::add(PlatformStream *stream, PlatformStreamHelper *helper)
+{
+    if ((m_epollFd < 0) || (stream == nullptr) || (helper == nullptr))
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const uint64_t key = m_nextKey++;
+
+    Entry entry;
+    entry.stream  = stream;
+    entry.helper  = helper;
+    entry.busy    = false;
+    entry.removed = false;
+    m_entries[key] = entry;
+
+    epoll_event ev;
+    ev.events = EPOLLIN | EPOLLONESHOT;
+    ev.data.u64 = key;
+    if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, helper->m_fd, &ev) != 0)
+    {
+        LOG(LOG_ERR, "CaptureReactor: could not watch device (errno %d)\n", errno);
+        m_entries.erase(key);
+        return false;
+    }
+    return true;
+}
+
+void CaptureReactor::remove(PlatformStream *stream)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for(auto iter = m_entries.begin(); iter != m_entries.end(); iter++)
+    {
+        if (iter->second.stream != stream)
+        {
+            continue;
+        }
+
+        // a thread that has already taken an event for
+        // the device finds the entry gone, or is waited for.
+        epoll_ctl(m_epollFd, EPOLL_CTL_DEL, iter->second.helper->m_fd, nullptr);
+        if (!iter->second.busy)
+        {
+            m_entries.erase(iter);
+            return;
+        }
+
+        const uint64_t key = iter->first;
+        iter->second.removed = true;
+        m_idle.wait(lock, [this, key]{ return m_entries.find(key) == m_entries.end(); });
+        return;
+    }
+}
+
+void CaptureReactor::threadFunction()
+{
+    epoll_event events[c_maxEvents];
+    while(!m_quit)
+    {
+        const int count = epoll_wait(m_epollFd, events, c_maxEvents, -1);
+        if (count < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            LOG(LOG_ERR, "CaptureReactor: epoll_wait failed (errno %d)\n", errno);
+            break;
+        }
+
+        for(int i=0; (i<count) && (!m_quit); i++)
+        {
+            if (events[i].data.u64 != c_wakeKey)
+            {
+                service(events[i].data.u64);
+            }
+        }
+    }
+}
+
+void CaptureReactor::service(uint64_t key)
+{
+    PlatformStream *stream;
+    PlatformStreamHelper *helper;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto iter = m_entries.find(key);
+        if (iter == m_entries.end())
+        {
+            return;
+        }
+        iter->second.busy = true;
+        stream = iter->second.stream;
+        helper = iter->second.helper;
+    }
+
+    const bool ok = stream->threadServiceDevice(helper);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto iter = m_entries.find(key);
+    iter->second.busy = false;
+    if (iter->second.removed)
+    {
+        m_entries.erase(iter);
+        m_idle.notify_all();
+        return;
+    }
+
+    if (!ok)
+    {
+        // like a capture thread that exits on an error,
+        // the device is not serviced anymore.
+        LOG(LOG_ERR, "CaptureReactor: capturing stopped after a device error\n");
+        return;
+    }
+
+    // EPOLLONESHOT disarmed the device, arm it again
+    epoll_event ev;
+    ev.events = EPOLLIN | EPOLLONESHOT;
+    ev.data.u64 = key;
+    if (epoll_ctl(m_epollFd, EPOLL_CTL_MOD, helper->m_fd, &ev) != 0)
+    {
+        LOG(LOG_ERR, "CaptureReactor: could not re-arm device (errno %d)\n", errno);
+    }
+}
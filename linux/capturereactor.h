@@ -0,0 +1,114 @@
+/*
+
+    OpenPnp-Capture: a video capture subsystem.
+
+    Linux platform code, epoll reactor that services
+    the V4L2 devices of several streams
+
+    Copyright (c) 2017 Jason von Nieda, Niels Moseley.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+*/
+
+#ifndef linux_capturereactor_h
+#define linux_capturereactor_h
+
+#include <stdint.h>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+#include "threadpolicy.h"
+
+class PlatformStream;           // pre-declaration
+class PlatformStreamHelper;     // pre-declaration
+
+/** A fixed number of threads that wait on the V4L2 devices of
+    all streams of a context with epoll, instead of one capture
+    thread per stream, see Cap_setReactorThreads.
+
+    A device is registered with EPOLLONESHOT, so only one thread
+    services it at a time and the frames of a stream are still
+    produced by a single thread at a time.
+*/
+class CaptureReactor
+{
+public:
+    CaptureReactor();
+    virtual ~CaptureReactor();
+
+    /** Create the epoll instance and start 'threads' threads.
+        Returns false if this fails. */
+    bool start(uint32_t threads);
+
+    /** Stop the threads. All streams must have been removed. */
+    void stop();
+
+    /** Return the number of reactor threads */
+    uint32_t getThreadCount() const
+    {
+        return static_cast<uint32_t>(m_threads.size());
+    }
+
+    /** Apply a thread policy to the reactor threads, also to
+        threads started later. Returns false if a part of the
+        policy could not be applied, see ThreadPolicy::apply. */
+    bool setThreadPolicy(const ThreadPolicy &policy);
+
+    /** Watch the device of a streaming helper. The reactor calls
+        stream->threadServiceDevice(helper) when the device has a
+        frame. Returns false if the device cannot be watched. */
+    bool add(PlatformStream *stream, PlatformStreamHelper *helper);
+
+    /** Stop watching the device of a stream. When this returns,
+        the device is not being serviced and will not be serviced
+        again. Must not be called from a reactor thread. */
+    void remove(PlatformStream *stream);
+
+protected:
+    /** Thread function: wait for devices and service them */
+    void threadFunction();
+
+    /** Service the device registered under 'key' */
+    void service(uint64_t key);
+
+    struct Entry
+    {
+        PlatformStream*         stream;     ///< stream the device belongs to
+        PlatformStreamHelper*   helper;     ///< V4L2 buffers of the device
+        bool                    busy;       ///< true while a thread services the device
+        bool                    removed;    ///< true if remove() waits for the service to end
+    };
+
+    int                         m_epollFd;  ///< epoll instance or -1
+    int                         m_wakeFd;   ///< eventfd that stops the threads, or -1
+    std::atomic<bool>           m_quit;     ///< if true, the threads exit
+    std::vector<std::thread*>   m_threads;  ///< reactor threads
+    ThreadPolicy                m_policy;   ///< policy of the reactor threads
+
+    std::mutex                  m_mutex;    ///< protects m_entries and m_nextKey
+    std::condition_variable     m_idle;     ///< signalled when a removed entry is no longer busy
+    std::map<uint64_t, Entry>   m_entries;  ///< watched devices by epoll key
+    uint64_t                    m_nextKey;  ///< key of the next device, 0 is the wake-up eventfd
+};
+
+#endif
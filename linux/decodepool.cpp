@@ -0,0 +1,312 @@
+/*
+
+    OpenPnp-Capture: a video capture subsystem.
+
+    Linux platform code, worker threads that decode
+    the camera frames of several streams
+
+    Copyright (c) 2017 Jason von Nieda, Niels Moseley.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+*/
+
+#include <string.h>
+#include "decodepool.h"
+#include "platformstream.h"
+#include "../common/logging.h"
+
+DecodePool::DecodePool() :
+    m_quit(false)
+{
+}
+
+DecodePool::~DecodePool()
+{
+    stop();
+}
+
+bool DecodePool::start(uint32_t threads)
+{
+    stop();
+
+    if (threads == 0)
+    {
+        return false;
+    }
+
+    m_quit = false;
+    for(uint32_t i=0; i<threads; i++)
+    {
+        m_threads.push_back(new std::thread(&DecodePool::threadFunction, this));
+        if (!m_policy.isDefault())
+        {
+            m_policy.apply(m_threads.back()->native_handle());
+        }
+    }
+
+    LOG(LOG_INFO, "DecodePool: started %d thread(s)\n", threads);
+    return true;
+}
+
+void DecodePool::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_work.notify_all();
+
+    for(uint32_t i=0; i<m_threads.size(); i++)
+    {
+        m_threads[i]->join();
+        delete m_threads[i];
+    }
+    m_threads.clear();
+
+    if (!m_queues.empty())
+    {
+        LOG(LOG_ERR, "DecodePool: stopped with %d stream(s) still queued\n", m_queues.size());
+    }
+
+    for(auto iter = m_queues.begin(); iter != m_queues.end(); iter++)
+    {
+        for(uint32_t i=0; i<iter->second.jobs.size(); i++)
+        {
+            delete iter->second.jobs[i];
+        }
+        for(auto job = iter->second.decoded.begin(); job != iter->second.decoded.end(); job++)
+        {
+            delete job->second;
+        }
+    }
+    m_queues.clear();
+    m_ready.clear();
+
+    for(uint32_t i=0; i<m_freeJobs.size(); i++)
+    {
+        delete m_freeJobs[i];
+    }
+    m_freeJobs.clear();
+}
+
+bool DecodePool::setThreadPolicy(const ThreadPolicy &policy)
+{
+    m_policy = policy;
+
+    bool ok = true;
+    for(uint32_t i=0; i<m_threads.size(); i++)
+    {
+        ok = m_policy.apply(m_threads[i]->native_handle()) && ok;
+    }
+    return ok;
+}
+
+DecodeJob* DecodePool::allocateJob()
+{
+    if (m_freeJobs.empty())
+    {
+        return new DecodeJob();
+    }
+
+    DecodeJob *job = m_freeJobs.back();
+    m_freeJobs.pop_back();
+    return job;
+}
+
+uint32_t DecodePool::submit(PlatformStream *stream, const void *ptr, size_t bytes,
+    const v4l2_buffer &buf, uint64_t arrival)
+{
+    DecodeJob *job;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        job = allocateJob();
+    }
+
+    // copy outside the lock, so the capture threads
+    // of other streams are not held up
+    job->m_payload.resize(bytes);
+    memcpy(job->m_payload.data(), ptr, bytes);
+    job->m_bytes   = bytes;
+    job->m_buf     = buf;
+    job->m_arrival = arrival;
+    job->m_slot    = nullptr;
+
+    uint32_t dropped = 0;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    StreamQueue &queue = m_queues[stream];
+    if (queue.jobs.size() >= c_maxPending)
+    {
+        // the workers cannot keep up with this stream,
+        // the oldest frame is the least useful one.
+        m_freeJobs.push_back(queue.jobs.front());
+        queue.jobs.pop_front();
+        dropped = 1;
+    }
+
+    queue.jobs.push_back(job);
+    schedule(stream, queue);
+    return dropped;
+}
+
+uint32_t DecodePool::getMaxRunning() const
+{
+    // when several streams use the pool, one stream
+    // never takes all workers, so a frame of another
+    // stream does not wait for a whole burst.
+    const uint32_t threads = static_cast<uint32_t>(m_threads.size());
+    if ((m_queues.size() > 1) && (threads > 1))
+    {
+        return threads - 1;
+    }
+    return threads;
+}
+
+void DecodePool::schedule(PlatformStream *stream, StreamQueue &queue)
+{
+    // every frame a worker has taken holds a frame slot
+    // until it is published, see PlatformStream::startCapture
+    if ((!queue.ready) && (!queue.jobs.empty()) && (queue.running < getMaxRunning()))
+    {
+        queue.ready = true;
+        m_ready.push_back(stream);
+        m_work.notify_one();
+    }
+}
+
+void DecodePool::flush(PlatformStream *stream)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto iter = m_queues.find(stream);
+    if (iter == m_queues.end())
+    {
+        return;
+    }
+
+    StreamQueue &queue = iter->second;
+    m_idle.wait(lock, [&queue]{ return queue.jobs.empty() && (queue.running == 0); });
+}
+
+uint32_t DecodePool::cancel(PlatformStream *stream)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto iter = m_queues.find(stream);
+    if (iter == m_queues.end())
+    {
+        return 0;
+    }
+
+    StreamQueue &queue = iter->second;
+    const uint32_t discarded = static_cast<uint32_t>(queue.jobs.size());
+    for(uint32_t i=0; i<queue.jobs.size(); i++)
+    {
+        m_freeJobs.push_back(queue.jobs[i]);
+    }
+    queue.jobs.clear();
+
+    if (queue.ready)
+    {
+        for(auto ready = m_ready.begin(); ready != m_ready.end(); ready++)
+        {
+            if (*ready == stream)
+            {
+                m_ready.erase(ready);
+                break;
+            }
+        }
+        queue.ready = false;
+    }
+
+    // frames taken by a worker are still published
+    m_idle.wait(lock, [&queue]{ return queue.running == 0; });
+    m_queues.erase(stream);
+
+    // a stream left alone can use all workers again
+    for(auto iter = m_queues.begin(); iter != m_queues.end(); iter++)
+    {
+        schedule(iter->first, iter->second);
+    }
+    return discarded;
+}
+
+void DecodePool::threadFunction()
+{
+    // TurboJPEG handles must not be used by two
+    // threads at once, so every worker has its own.
+    MJPEGHelper mjpeg;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while(true)
+    {
+        m_work.wait(lock, [this]{ return m_quit || !m_ready.empty(); });
+        if (m_quit)
+        {
+            return;
+        }
+
+        PlatformStream *stream = m_ready.front();
+        m_ready.pop_front();
+
+        // std::map does not move its elements and cancel()
+        // waits for running frames, so 'queue' stays valid.
+        StreamQueue &queue = m_queues[stream];
+        queue.ready = false;
+        DecodeJob *job = queue.jobs.front();
+        queue.jobs.pop_front();
+        job->m_ticket = queue.nextTicket++;
+        queue.running++;
+
+        // another worker can start on the next frame
+        schedule(stream, queue);
+
+        lock.unlock();
+        stream->threadDecodeJob(job, &mjpeg);
+        lock.lock();
+
+        if (job->m_ticket != queue.nextPublish)
+        {
+            // frames ahead of this one are still being decoded,
+            // the worker that publishes them publishes this one.
+            queue.decoded[job->m_ticket] = job;
+            continue;
+        }
+
+        while(job != nullptr)
+        {
+            lock.unlock();
+            stream->threadPublishJob(job);
+            lock.lock();
+
+            m_freeJobs.push_back(job);
+            queue.nextPublish++;
+            queue.running--;
+
+            job = nullptr;
+            auto next = queue.decoded.find(queue.nextPublish);
+            if (next != queue.decoded.end())
+            {
+                job = next->second;
+                queue.decoded.erase(next);
+            }
+        }
+
+        schedule(stream, queue);
+        m_idle.notify_all();
+    }
+}
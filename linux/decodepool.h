@@ -0,0 +1,155 @@
+/*
+
+    OpenPnp-Capture: a video capture subsystem.
+
+    Linux platform code, worker threads that decode
+    the camera frames of several streams
+
+    Copyright (c) 2017 Jason von Nieda, Niels Moseley.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+*/
+
+#ifndef linux_decodepool_h
+#define linux_decodepool_h
+
+#include <stdint.h>
+#include <vector>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <linux/videodev2.h>
+#include "../common/bufferpool.h"
+#include "../common/framering.h"
+#include "mjpeghelper.h"
+#include "threadpolicy.h"
+
+class PlatformStream;   // pre-declaration
+
+/** A camera frame waiting to be decoded or published */
+struct DecodeJob
+{
+    FrameBuffer m_payload;      ///< copy of the camera buffer
+    size_t      m_bytes;        ///< number of valid bytes in m_payload
+    v4l2_buffer m_buf;          ///< V4L2 metadata of the frame
+    uint64_t    m_ticket;       ///< position of the frame in its stream
+    uint64_t    m_arrival;      ///< time the frame was dequeued
+    uint64_t    m_started;      ///< time a worker started decoding it
+    uint64_t    m_decoded;      ///< time the worker finished decoding it
+    FrameSlot*  m_slot;         ///< decoded frame, not published yet, or nullptr
+};
+
+/** Worker threads shared by the streams of a context that
+    decode camera frames, see Cap_setDecodeThreads. The capture
+    thread copies a frame into a job and hands the camera buffer
+    straight back to the driver.
+
+    Every worker has its own MJPEG decompressor, so several
+    frames of a stream can be decoded at the same time, up to
+    one per worker. When several streams use the pool, a stream
+    leaves at least one worker to the others. The frames are
+    published one at a time and in the order they arrived: a
+    worker that finishes a frame before the frames ahead of it
+    leaves it to the worker that publishes the frame just
+    before it.
+*/
+class DecodePool
+{
+public:
+    DecodePool();
+    virtual ~DecodePool();
+
+    /** Start 'threads' worker threads. Returns false if 'threads' is 0. */
+    bool start(uint32_t threads);
+
+    /** Stop the worker threads. Queued jobs are discarded. */
+    void stop();
+
+    /** Return the number of worker threads */
+    uint32_t getThreadCount() const
+    {
+        return static_cast<uint32_t>(m_threads.size());
+    }
+
+    /** Apply a thread policy to the workers, also to workers
+        started later. Returns false if a part of the policy
+        could not be applied, see ThreadPolicy::apply. */
+    bool setThreadPolicy(const ThreadPolicy &policy);
+
+    /** Copy a camera frame of a stream and queue it. When the
+        stream has c_maxPending frames waiting for a worker
+        already, the oldest is dropped. Returns the number of
+        frames dropped (0 or 1). */
+    uint32_t submit(PlatformStream *stream, const void *ptr, size_t bytes,
+        const v4l2_buffer &buf, uint64_t arrival);
+
+    /** Wait until all queued frames of a stream are published */
+    void flush(PlatformStream *stream);
+
+    /** Discard the queued frames of a stream and wait for the
+        frames being decoded, if any. When this returns, the pool
+        does not use the stream anymore. Returns the number of
+        frames discarded. */
+    uint32_t cancel(PlatformStream *stream);
+
+    static const uint32_t c_maxPending = 2; ///< frames waiting for a worker, per stream
+
+protected:
+    /** Thread function: decode and publish the jobs of ready streams */
+    void threadFunction();
+
+    /** Get a job from the free list or a new one. m_mutex must be held. */
+    DecodeJob* allocateJob();
+
+    struct StreamQueue
+    {
+        StreamQueue() : running(0), ready(false), nextTicket(0), nextPublish(0) {}
+
+        std::deque<DecodeJob*>  jobs;       ///< frames waiting for a worker, oldest first
+        uint32_t                running;    ///< number of frames taken by a worker and not published yet
+        bool                    ready;      ///< true if the stream is in m_ready
+        uint64_t                nextTicket; ///< ticket of the next frame a worker takes
+        uint64_t                nextPublish;///< ticket of the next frame to publish
+        std::map<uint64_t, DecodeJob*> decoded; ///< decoded frames waiting for earlier ones, by ticket
+    };
+
+    /** Add a stream to m_ready if a worker can take one of its
+        frames. m_mutex must be held. */
+    void schedule(PlatformStream *stream, StreamQueue &queue);
+
+    /** Return the number of frames of one stream the workers can
+        decode at the same time. m_mutex must be held. */
+    uint32_t getMaxRunning() const;
+
+    bool                        m_quit;     ///< if true, the workers exit, protected by m_mutex
+    std::vector<std::thread*>   m_threads;  ///< worker threads
+    ThreadPolicy                m_policy;   ///< policy of the workers
+
+    std::mutex                  m_mutex;    ///< protects the members below
+    std::condition_variable     m_work;     ///< signalled when a stream becomes ready
+    std::condition_variable     m_idle;     ///< signalled when a frame is published
+    std::map<PlatformStream*, StreamQueue> m_queues;    ///< frames by stream
+    std::deque<PlatformStream*> m_ready;    ///< streams with frames a worker can take
+    std::vector<DecodeJob*>     m_freeJobs; ///< jobs for re-use
+};
+
+#endif
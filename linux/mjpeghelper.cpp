@@ -28,11 +28,118 @@
 */
 
 #include "mjpeghelper.h"
+#include "openpnp-capture.h"
 #include "../common/logging.h"
 
+#ifdef HAVE_JPEG_CROP_SCANLINE
+#include <stdio.h>
+#include <setjmp.h>
+#include <memory.h>
+#include <jpeglib.h>
+
+/** libjpeg decompressor used for partial decoding, which
+    the TurboJPEG API does not support. Errors are reported
+    with a longjmp back to decompressRegion. */
+struct JPEGRegionDecoder
+{
+    jpeg_decompress_struct  cinfo;
+    jpeg_error_mgr          jerr;
+    jmp_buf                 jumpBuffer;
+    FrameBuffer             row;        ///< buffer for one cropped scanline
+};
+
+static void regionErrorExit(j_common_ptr cinfo)
+{
+    JPEGRegionDecoder *decoder = reinterpret_cast<JPEGRegionDecoder*>(cinfo->client_data);
+    longjmp(decoder->jumpBuffer, 1);
+}
+
+static void regionOutputMessage(j_common_ptr cinfo)
+{
+    // suppress warnings, see decompressFrame
+}
+#else
+struct JPEGRegionDecoder {};
+#endif
+
+/** Return the TurboJPEG pixel format of a packed
+    output format, or -1 if there is none */
+static int getTJPixelFormat(uint32_t format)
+{
+    switch(format)
+    {
+    case CAPFORMAT_RGB24:
+        return TJPF_RGB;
+    case CAPFORMAT_BGR24:
+        return TJPF_BGR;
+    case CAPFORMAT_RGBA32:
+        return TJPF_RGBA;
+    case CAPFORMAT_BGRA32:
+        return TJPF_BGRA;
+    case CAPFORMAT_GRAY8:
+        // libjpeg-turbo skips the IDCT and upsampling
+        // of the chroma components for gray output
+        return TJPF_GRAY;
+    default:
+        return -1;
+    }
+}
+
+/** Resample a chroma plane to a different size by averaging
+    the source pixels that cover each destination pixel.
+    'dstStep' is the distance in bytes between two 
+    destination pixels, i.e. 2 for interleaved planes. */
+static void resampleChroma(const uint8_t *src, uint32_t srcWidth, uint32_t srcHeight, uint32_t srcStride,
+    uint8_t *dst, uint32_t dstWidth, uint32_t dstHeight, uint32_t dstStride, uint32_t dstStep)
+{
+    for(uint32_t y=0; y<dstHeight; y++)
+    {
+        uint32_t y0 = y*srcHeight/dstHeight;
+        uint32_t y1 = (y+1)*srcHeight/dstHeight;
+        if (y1 <= y0) y1 = y0+1;
+
+        uint8_t *row = dst + y*dstStride;
+        for(uint32_t x=0; x<dstWidth; x++)
+        {
+            uint32_t x0 = x*srcWidth/dstWidth;
+            uint32_t x1 = (x+1)*srcWidth/dstWidth;
+            if (x1 <= x0) x1 = x0+1;
+
+            uint32_t sum = 0;
+            for(uint32_t sy=y0; sy<y1; sy++)
+            {
+                for(uint32_t sx=x0; sx<x1; sx++)
+                {
+                    sum += src[sy*srcStride + sx];
+                }
+            }
+            const uint32_t n = (y1-y0)*(x1-x0);
+            row[x*dstStep] = (sum + n/2) / n;
+        }
+    }
+}
+
+MJPEGHelper::MJPEGHelper() : m_regionDecoder(nullptr)
+{
+    m_decompressHandle = tjInitDecompress();
+}
+
+MJPEGHelper::~MJPEGHelper()
+{
+    tjDestroy(m_decompressHandle);
+    #ifdef HAVE_JPEG_CROP_SCANLINE
+    if (m_regionDecoder != nullptr)
+    {
+        jpeg_destroy_decompress(&m_regionDecoder->cinfo);
+    }
+    #endif
+    delete m_regionDecoder;
+}
+
 bool MJPEGHelper::decompressFrame(const uint8_t *inBuffer,
     size_t inBytes, uint8_t *outBuffer,
-    uint32_t outBufWidth, uint32_t outBufHeight)
+    uint32_t outBufWidth, uint32_t outBufHeight,
+    uint32_t outStride, uint32_t format, uint32_t scale)
 {
     // note: the jpeg-turbo library apparently uses a non-const
     // buffer pointer to the incoming JPEG data.
@@ -54,8 +161,29 @@ bool MJPEGHelper::decompressFrame(const uint8_t *inBuffer,
         LOG(LOG_VERBOSE, "MJPG: %d %d size %d bytes\n", width, height, inBytes);
     }
 
+    // let the IDCT produce a smaller image directly
+    if (scale != 1)
+    {
+        const tjscalingfactor factor = {1, static_cast<int>(scale)};
+        width  = TJSCALED(width, factor);
+        height = TJSCALED(height, factor);
+    }
+
+    if ((format == CAPFORMAT_NV12) || (format == CAPFORMAT_I420))
+    {
+        return decompressToYUV(jpegPtr, inBytes, width, height, jpegSubsamp, 
+            outBuffer, outStride, format);
+    }
+
+    const int pixelFormat = getTJPixelFormat(format);
+    if (pixelFormat < 0)
+    {
+        LOG(LOG_ERR, "MJPEGHelper: unsupported output format %d\n", format);
+        return false;
+    }
+
     if (tjDecompress2(m_decompressHandle, jpegPtr, inBytes, outBuffer, 
-        width, 0/*pitch*/, height, TJPF_RGB, TJFLAG_FASTDCT) != 0)
+        width, outStride, height, pixelFormat, TJFLAG_FASTDCT) != 0)
     {
         // A lot of cameras produce incorrect but decodable JPEG data
         // and produce warnings that fill the console,
@@ -80,4 +208,187 @@ bool MJPEGHelper::decompressFrame(const uint8_t *inBuffer,
     }
 
     return true;
-}
\ No newline at end of file
+}
+bool MJPEGHelper::decompressToYUV(uint8_t *jpegPtr, size_t inBytes, int32_t width, int32_t height,
+    int32_t jpegSubsamp, uint8_t *outBuffer, uint32_t outStride, uint32_t format)
+{
+    const uint32_t chromaWidth  = (width+1)/2;
+    const uint32_t chromaHeight = (height+1)/2;
+    uint8_t *chroma = outBuffer + outStride*height;
+
+    unsigned char *planes[3];
+    int strides[3];
+    planes[0]  = outBuffer;
+    strides[0] = outStride;
+
+    // 4:2:0 JPEG to I420: all planes are decoded in place
+    if ((format == CAPFORMAT_I420) && (jpegSubsamp == TJSAMP_420))
+    {
+        strides[1] = strides[2] = (outStride+1)/2;
+        planes[1]  = chroma;
+        planes[2]  = chroma + strides[1]*chromaHeight;
+
+        // note: decoding errors are ignored, see decompressFrame
+        tjDecompressToYUVPlanes(m_decompressHandle, jpegPtr, inBytes, planes,
+            width, strides, height, TJFLAG_FASTDCT);
+        return true;
+    }
+
+    const uint32_t planeWidth  = (jpegSubsamp == TJSAMP_GRAY) ? 0 : tjPlaneWidth(1, width, jpegSubsamp);
+    const uint32_t planeHeight = (jpegSubsamp == TJSAMP_GRAY) ? 0 : tjPlaneHeight(1, height, jpegSubsamp);
+    if (m_chroma.size() < 2*planeWidth*planeHeight)
+    {
+        m_chroma.resize(2*planeWidth*planeHeight);
+    }
+
+    strides[1] = strides[2] = planeWidth;
+    planes[1]  = m_chroma.empty() ? nullptr : &m_chroma[0];
+    planes[2]  = m_chroma.empty() ? nullptr : &m_chroma[planeWidth*planeHeight];
+
+    tjDecompressToYUVPlanes(m_decompressHandle, jpegPtr, inBytes, planes,
+        width, strides, height, TJFLAG_FASTDCT);
+
+    uint8_t *u = chroma;
+    uint8_t *v = (format == CAPFORMAT_NV12) ? chroma+1 : chroma + ((outStride+1)/2)*chromaHeight;
+    const uint32_t uvStride = (format == CAPFORMAT_NV12) ? outStride : (outStride+1)/2;
+    const uint32_t uvStep   = (format == CAPFORMAT_NV12) ? 2 : 1;
+
+    if (jpegSubsamp == TJSAMP_GRAY)
+    {
+        // no chroma: neutral gray
+        for(uint32_t y=0; y<chromaHeight; y++)
+        {
+            for(uint32_t x=0; x<chromaWidth; x++)
+            {
+                u[y*uvStride + x*uvStep] = 128;
+                v[y*uvStride + x*uvStep] = 128;
+            }
+        }
+        return true;
+    }
+
+    resampleChroma(planes[1], planeWidth, planeHeight, planeWidth, u, chromaWidth, chromaHeight, uvStride, uvStep);
+    resampleChroma(planes[2], planeWidth, planeHeight, planeWidth, v, chromaWidth, chromaHeight, uvStride, uvStep);
+    return true;
+}
+
+bool MJPEGHelper::supportsPartialDecode()
+{
+    #ifdef HAVE_JPEG_CROP_SCANLINE
+    return true;
+    #else
+    return false;
+    #endif
+}
+
+bool MJPEGHelper::decompressRegion(const uint8_t *inBuffer, size_t inBytes,
+    uint32_t x, uint32_t y, uint32_t width, uint32_t height,
+    uint8_t *outBuffer, uint32_t outStride, uint32_t format, uint32_t scale)
+{
+#ifdef HAVE_JPEG_CROP_SCANLINE
+    J_COLOR_SPACE colorSpace;
+    uint32_t pixelBytes;
+    switch(format)
+    {
+    case CAPFORMAT_RGB24:
+        colorSpace = JCS_EXT_RGB;
+        pixelBytes = 3;
+        break;
+    case CAPFORMAT_BGR24:
+        colorSpace = JCS_EXT_BGR;
+        pixelBytes = 3;
+        break;
+    case CAPFORMAT_RGBA32:
+        colorSpace = JCS_EXT_RGBA;
+        pixelBytes = 4;
+        break;
+    case CAPFORMAT_BGRA32:
+        colorSpace = JCS_EXT_BGRA;
+        pixelBytes = 4;
+        break;
+    case CAPFORMAT_GRAY8:
+        colorSpace = JCS_GRAYSCALE;
+        pixelBytes = 1;
+        break;
+    default:
+        return false;
+    }
+
+    if (m_regionDecoder == nullptr)
+    {
+        m_regionDecoder = new JPEGRegionDecoder();
+        m_regionDecoder->cinfo.err = jpeg_std_error(&m_regionDecoder->jerr);
+        m_regionDecoder->jerr.error_exit = regionErrorExit;
+        m_regionDecoder->jerr.output_message = regionOutputMessage;
+        m_regionDecoder->cinfo.client_data = m_regionDecoder;
+        jpeg_create_decompress(&m_regionDecoder->cinfo);
+    }
+
+    jpeg_decompress_struct *cinfo = &m_regionDecoder->cinfo;
+    if (setjmp(m_regionDecoder->jumpBuffer))
+    {
+        LOG(LOG_VERBOSE, "MJPEGHelper: partial decode failed\n");
+        jpeg_abort_decompress(cinfo);
+        return false;
+    }
+
+    jpeg_mem_src(cinfo, const_cast<uint8_t*>(inBuffer), inBytes);
+    jpeg_read_header(cinfo, TRUE);
+
+    cinfo->out_color_space = colorSpace;
+    cinfo->dct_method = JDCT_IFAST;     // same as TJFLAG_FASTDCT
+    cinfo->scale_num = 1;
+    cinfo->scale_denom = scale;
+    jpeg_start_decompress(cinfo);
+
+    if (((x + width) > cinfo->output_width) || ((y + height) > cinfo->output_height))
+    {
+        LOG(LOG_ERR, "MJPEGHelper: region is outside the %d x %d frame\n", 
+            cinfo->output_width, cinfo->output_height);
+        jpeg_abort_decompress(cinfo);
+        return false;
+    }
+
+    // the chroma upsampler treats the edges of the crop as
+    // image edges, so widen it by one iMCU on both sides to
+    // get the same pixels as a full decode. jpeg_crop_scanline
+    // widens it further to iMCU boundaries.
+    #if JPEG_LIB_VERSION >= 70
+    const uint32_t iMCUWidth = cinfo->max_h_samp_factor * cinfo->min_DCT_h_scaled_size;
+    #else
+    const uint32_t iMCUWidth = cinfo->max_h_samp_factor * cinfo->min_DCT_scaled_size;
+    #endif
+    JDIMENSION cropX = (x > iMCUWidth) ? x - iMCUWidth : 0;
+    JDIMENSION cropRight = x + width + iMCUWidth;
+    if (cropRight > cinfo->output_width)
+    {
+        cropRight = cinfo->output_width;
+    }
+    JDIMENSION cropWidth = cropRight - cropX;
+    jpeg_crop_scanline(cinfo, &cropX, &cropWidth);
+
+    if (m_regionDecoder->row.size() < cropWidth*pixelBytes)
+    {
+        m_regionDecoder->row.resize(cropWidth*pixelBytes);
+    }
+
+    if (y != 0)
+    {
+        jpeg_skip_scanlines(cinfo, y);
+    }
+
+    JSAMPROW rowPtr = &m_regionDecoder->row[0];
+    const uint32_t offset = (x - cropX)*pixelBytes;
+    for(uint32_t row=0; row<height; row++)
+    {
+        jpeg_read_scanlines(cinfo, &rowPtr, 1);
+        memcpy(outBuffer + row*outStride, rowPtr + offset, width*pixelBytes);
+    }
+
+    // don't decode the rest of the frame
+    jpeg_abort_decompress(cinfo);
+    return true;
+#else
+    return false;
+#endif
+}
@@ -33,30 +33,59 @@
 #include <turbojpeg.h>
 #include <stdint.h>
 #include <stdlib.h> // size_t
+#include "../common/bufferpool.h"
+
+struct JPEGRegionDecoder;   // pre-declaration, see mjpeghelper.cpp
 
 class MJPEGHelper
 {
 public:
-    MJPEGHelper()
-    {
-        m_decompressHandle = tjInitDecompress();
-    }
-
-    virtual ~MJPEGHelper()
-    {
-        tjDestroy(m_decompressHandle);
-    }
+    MJPEGHelper();
+    virtual ~MJPEGHelper();
 
     /** Decompress a JPEG contained in the buffer. 
         The width and height of the output buffer are for
         sanity checking only. If the JPEG does not match
         the buffer size, the function will return false.
+
+        The output is written in the given pixel format
+        (CAPFORMAT_xxx) with rows of 'outStride' bytes.
+
+        When 'scale' is 2, 4 or 8, the JPEG is decoded at
+        1/scale of its size using DCT scaling. The output then
+        measures TJSCALED(outBufWidth/Height, 1/scale).
     */
     bool decompressFrame(const uint8_t *inBuffer, size_t inBytes, 
-        uint8_t *outBuffer, uint32_t outBufWidth, uint32_t outButHeight);
+        uint8_t *outBuffer, uint32_t outBufWidth, uint32_t outButHeight,
+        uint32_t outStride, uint32_t format, uint32_t scale = 1);
+
+    /** Returns true if decompressRegion can decode a region
+        without decoding the whole JPEG */
+    static bool supportsPartialDecode();
+
+    /** Decompress a region of a JPEG into a packed or gray 
+        output format (CAPFORMAT_xxx) with rows of 'outStride' bytes.
+        Scanlines above and below the region are skipped and only 
+        the iMCU columns covering the region are decoded.
+        The region is given in pixels of the JPEG decoded at
+        1/scale of its size, see decompressFrame.
+        Returns false if the region could not be decoded or if
+        partial decoding is not supported.
+    */
+    bool decompressRegion(const uint8_t *inBuffer, size_t inBytes,
+        uint32_t x, uint32_t y, uint32_t width, uint32_t height,
+        uint8_t *outBuffer, uint32_t outStride, uint32_t format, uint32_t scale = 1);
 
 protected:
+    /** Decompress a JPEG into NV12 or I420. The Y plane and, for 4:2:0 
+        JPEGs, the I420 chroma planes are decoded in place. Other
+        chroma layouts are decoded into m_chroma and resampled. */
+    bool decompressToYUV(uint8_t *jpegPtr, size_t inBytes, int32_t width, int32_t height,
+        int32_t jpegSubsamp, uint8_t *outBuffer, uint32_t outStride, uint32_t format);
+
     tjhandle m_decompressHandle;  ///< decompressor handle
+    FrameBuffer m_chroma;           ///< scratch buffer for chroma planes
+    JPEGRegionDecoder *m_regionDecoder; ///< libjpeg decompressor for partial decoding, created on demand
 };
 
 #endif
@@ -46,7 +46,9 @@ Context* createPlatformContext()
 }
 
 PlatformContext::PlatformContext() :
-    Context()
+    Context(),
+    m_reactor(nullptr),
+    m_decodePool(nullptr)
 {
     LOG(LOG_DEBUG, "Context created\n");
     enumerateDevices();
@@ -54,6 +56,74 @@ PlatformContext::PlatformContext() :
 
 PlatformContext::~PlatformContext()
 {
+    // the streams must stop using the reactor
+    // and the decode pool before they are deleted
+    while(!m_streams.empty())
+    {
+        removeStream(m_streams.begin()->first);
+    }
+    delete m_reactor;
+    delete m_decodePool;
+}
+
+CapResult PlatformContext::setReactorThreads(uint32_t threads)
+{
+    std::lock_guard<std::mutex> lock(m_streamMutex);
+    for(auto iter = m_streams.begin(); iter != m_streams.end(); iter++)
+    {
+        if (iter->second != nullptr)
+        {
+            LOG(LOG_ERR, "setReactorThreads must be called before a stream is opened\n");
+            return CAPRESULT_ERR;
+        }
+    }
+
+    delete m_reactor;
+    m_reactor = nullptr;
+    if (threads == 0)
+    {
+        return CAPRESULT_OK;
+    }
+
+    m_reactor = new CaptureReactor();
+    m_reactor->setThreadPolicy(m_threadPolicy);
+    if (!m_reactor->start(threads))
+    {
+        delete m_reactor;
+        m_reactor = nullptr;
+        return CAPRESULT_ERR;
+    }
+    return CAPRESULT_OK;
+}
+
+CapResult PlatformContext::setDecodeThreads(uint32_t threads)
+{
+    std::lock_guard<std::mutex> lock(m_streamMutex);
+    for(auto iter = m_streams.begin(); iter != m_streams.end(); iter++)
+    {
+        if (iter->second != nullptr)
+        {
+            LOG(LOG_ERR, "setDecodeThreads must be called before a stream is opened\n");
+            return CAPRESULT_ERR;
+        }
+    }
+
+    delete m_decodePool;
+    m_decodePool = nullptr;
+    if (threads == 0)
+    {
+        return CAPRESULT_OK;
+    }
+
+    m_decodePool = new DecodePool();
+    m_decodePool->setThreadPolicy(m_threadPolicy);
+    if (!m_decodePool->start(threads))
+    {
+        delete m_decodePool;
+        m_decodePool = nullptr;
+        return CAPRESULT_ERR;
+    }
+    return CAPRESULT_OK;
 }
 
 bool PlatformContext::enumerateDevices()
@@ -224,3 +294,28 @@ uint32_t PlatformContext::findMaxFrameRate(int fd, uint32_t pixelformat,
 
     return fps;
 }
+
+CapResult PlatformContext::setDefaultThreadPolicy(uint32_t policy, int32_t priority, uint64_t cpuMask)
+{
+    ThreadPolicy threadPolicy;
+    threadPolicy.policy   = policy;
+    threadPolicy.priority = priority;
+    threadPolicy.cpuMask  = cpuMask;
+    if (!threadPolicy.isValid())
+    {
+        LOG(LOG_ERR, "setDefaultThreadPolicy: invalid policy (%d) or priority (%d)\n", policy, priority);
+        return CAPRESULT_ERR;
+    }
+
+    m_threadPolicy = threadPolicy;
+    bool ok = true;
+    if (m_reactor != nullptr)
+    {
+        ok = m_reactor->setThreadPolicy(threadPolicy);
+    }
+    if (m_decodePool != nullptr)
+    {
+        ok = m_decodePool->setThreadPolicy(threadPolicy) && ok;
+    }
+    return ok ? CAPRESULT_OK : CAPRESULT_ERR;
+}
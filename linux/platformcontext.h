@@ -43,6 +43,9 @@
 #pragma comment(lib, "strmiids")
 #include "platformdeviceinfo.h"
 #include "../common/context.h"
+#include "capturereactor.h"
+#include "decodepool.h"
+#include "threadpolicy.h"
 
 /** context base class keeps track of all the platform independent
     objects and information */
@@ -60,6 +63,40 @@ public:
     PlatformContext();
     virtual ~PlatformContext();
 
+    /** Service the devices of streams opened from now on with
+        'threads' shared epoll threads, or with one capture thread
+        per stream if 'threads' is 0. See Cap_setReactorThreads. */
+    virtual CapResult setReactorThreads(uint32_t threads) override;
+
+    /** Decode the frames of streams opened from now on with
+        'threads' shared worker threads, or on the thread that
+        receives them if 'threads' is 0. See Cap_setDecodeThreads. */
+    virtual CapResult setDecodeThreads(uint32_t threads) override;
+
+    /** Set the thread policy of streams opened from now on
+        and of the reactor and decode threads, see Cap_setDefaultThreadPolicy */
+    virtual CapResult setDefaultThreadPolicy(uint32_t policy, int32_t priority, uint64_t cpuMask) override;
+
+    /** Return the thread policy streams start with */
+    const ThreadPolicy& getDefaultThreadPolicy() const
+    {
+        return m_threadPolicy;
+    }
+
+    /** Return the capture reactor or nullptr if streams
+        use their own capture thread */
+    CaptureReactor* getReactor() const
+    {
+        return m_reactor;
+    }
+
+    /** Return the decode pool or nullptr if frames are
+        decoded by the thread that receives them */
+    DecodePool* getDecodePool() const
+    {
+        return m_decodePool;
+    }
+
 protected:
     bool queryFrameSize(int fd, uint32_t index, uint32_t pixelformat, uint32_t *width, uint32_t *height);
 
@@ -70,6 +107,9 @@ protected:
     */
     virtual bool enumerateDevices();
 
+    CaptureReactor* m_reactor;  ///< shared capture threads or nullptr
+    DecodePool*     m_decodePool;   ///< shared decode threads or nullptr
+    ThreadPolicy    m_threadPolicy; ///< default thread policy
 };
 
 #endif
\ No newline at end of file
@@ -36,6 +36,8 @@
 #include <sys/types.h>
 #include <sys/time.h>
 #include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <poll.h>
 #include <memory.h>
 #include <string>
 #include "scopedptr.h"
@@ -47,6 +49,9 @@
 
 #define CLEAR(x) memset(&(x), 0, sizeof(x))
 
+// time without frames after which a camera is reported as stalled
+static const int c_stallTimeoutMs = 5000;
+
 Stream* createPlatformStream()
 {
     return new PlatformStream();
@@ -85,6 +90,8 @@ bool PlatformStreamHelper::createAndMapBuffers(uint32_t nBuffers)
         return false;
     }
 
+    m_memory = V4L2_MEMORY_MMAP;
+
     if (req.count < 2) 
     {
         LOG(LOG_ERR, "createAndMapBuffers: need more than 1 buffer.\n");
@@ -130,13 +137,80 @@ bool PlatformStreamHelper::createAndMapBuffers(uint32_t nBuffers)
     return true;
 }
 
+bool PlatformStreamHelper::createUserBuffers(uint32_t nBuffers)
+{
+    v4l2_requestbuffers req;
+
+    CLEAR(req);
+
+    req.count  = nBuffers;
+    req.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    req.memory = V4L2_MEMORY_USERPTR;
+
+    if (xioctl(m_fd, VIDIOC_REQBUFS, &req) == -1) 
+    {
+        LOG(LOG_INFO, "createUserBuffers: no user pointer support (errno=%d).\n", errno);
+        return false;
+    }
+
+    m_memory = V4L2_MEMORY_USERPTR;
+    if (req.count < 2) 
+    {
+        LOG(LOG_ERR, "createUserBuffers: need more than 1 buffer.\n");
+        unmapAndDeleteBuffers();
+        return false;
+    }
+
+    LOG(LOG_DEBUG, "Reserving %d user pointer buffers\n", req.count);
+
+    bufferInfo info;
+    info.start  = nullptr;
+    info.length = 0;
+    m_buffers.assign(req.count, info);
+    return true;
+}
+
+bool PlatformStreamHelper::queueUserBuffer(uint32_t index, void *ptr, size_t length)
+{
+    v4l2_buffer buf;
+
+    CLEAR(buf);
+    buf.type      = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory    = V4L2_MEMORY_USERPTR;
+    buf.index     = index;
+    buf.m.userptr = reinterpret_cast<unsigned long>(ptr);
+    buf.length    = length;
+
+    if (xioctl(m_fd, VIDIOC_QBUF, &buf) == -1)
+    {
+        LOG(LOG_ERR,"queueUserBuffer: VIDIOC_QBUF failed (errno=%d)\n", errno);
+        return false;
+    }
+
+    m_buffers[index].start  = ptr;
+    m_buffers[index].length = length;
+    return true;
+}
+
 void PlatformStreamHelper::unmapAndDeleteBuffers()
 {
-    for(uint32_t i=0; i<m_buffers.size(); i++)
+    if (m_memory == V4L2_MEMORY_MMAP)
     {
-        munmap(m_buffers[i].start, m_buffers[i].length);
+        for(uint32_t i=0; i<m_buffers.size(); i++)
+        {
+            munmap(m_buffers[i].start, m_buffers[i].length);
+        }
     }
 
+    // release the buffers in the driver, so it can
+    // switch to another I/O mode.
+    v4l2_requestbuffers req;
+    CLEAR(req);
+    req.count  = 0;
+    req.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    req.memory = m_memory;
+    xioctl(m_fd, VIDIOC_REQBUFS, &req);
+
     m_buffers.clear();
     LOG(LOG_DEBUG, "Mmap buffers deleted\n");
 }
@@ -209,7 +283,8 @@ void captureThreadFunction(PlatformStream *stream, int fd, size_t bufferSizeByte
     LOG(LOG_DEBUG, "capture thread running (deviceHandle = %08X) ...\n", fd);
 
     // create local frame buffer
-    std::vector<uint8_t> buffer(bufferSizeBytes);
+    FrameBuffer buffer;
+    buffer.resize(bufferSizeBytes);
 
     // FIXME: For now, weĺl just rely on the read to fail
     // when the PlatformStream closes the file
@@ -225,18 +300,16 @@ void captureThreadFunction(PlatformStream *stream, int fd, size_t bufferSizeByte
         }
 
         // read will only return complete buffers
-        stream->threadSubmitBuffer(&buffer[0], actualBytesRead);
+        stream->threadSubmitBuffer(&buffer[0], actualBytesRead, nullptr);
         LOG(LOG_INFO, "yay\n");
     }
 }
 
 
 
-void captureThreadFunctionAsync(PlatformStream *stream, int fd, size_t bufferSizeBytes)
+void captureThreadFunctionAsync(PlatformStream *stream, int fd, int wakeFd, size_t bufferSizeBytes)
 {
     //https://linuxtv.org/downloads/v4l-dvb-apis/uapi/v4l/capture.c.html
-    const uint32_t nBuffers = 8;
-    
     if (stream == nullptr)
     {
         return;
@@ -247,89 +320,66 @@ void captureThreadFunctionAsync(PlatformStream *stream, int fd, size_t bufferSiz
     PlatformStreamHelper *pHelper = new PlatformStreamHelper(fd);
     ScopedPtr<PlatformStreamHelper> helper(pHelper);
 
-    if (!helper->createAndMapBuffers(nBuffers))
-    {
-        return;
-    }
-    
-    if (!helper->queueAllBuffers())
-    {
-        return;
-    }
-    
-    if (!helper->streamOn())
+    if (!stream->threadStartStreaming(pHelper))
     {
         return;
     }
 
+    // wait for a frame or for stopCapture, which
+    // signals the eventfd so we do not have to wait
+    // for the timeout.
+    uint32_t stalledMs = 0;
     while(!stream->getThreadQuitState())
     {
-        fd_set fds;
-        struct timeval tv;
-        int result;
-
-        FD_ZERO(&fds);
-        FD_SET(fd, &fds);
-
-        /* Timeout. */
-        tv.tv_sec = 5;
-        tv.tv_usec = 0;
-
-        result = select(fd + 1, &fds, NULL, NULL, &tv);
+        pollfd fds[2];
+        fds[0].fd = fd;
+        fds[0].events = POLLIN;
+        fds[0].revents = 0;
+        fds[1].fd = wakeFd;
+        fds[1].events = POLLIN;
+        fds[1].revents = 0;
+
+        int result = poll(fds, 2, c_stallTimeoutMs);
         if (result == -1)
         {
             if (errno == EINTR)
             {
                 continue;
             }
-            LOG(LOG_ERR,"Select failed (errno=%d)\n", errno);
-            return;
+            LOG(LOG_ERR,"poll failed (errno=%d)\n", errno);
+            break;
         }
         else if (result == 0)
         {
-            LOG(LOG_ERR,"Select timeout\n");
-            return;
+            // the camera is stalled, e.g. waiting for an external 
+            // trigger. Keep waiting: it may deliver frames again.
+            stalledMs += c_stallTimeoutMs;
+            LOG(LOG_WARNING,"Camera stalled: no frame for %d ms\n", stalledMs);
+            continue;
         }
 
-        // ****************************************
-        // read the frame
-        // ****************************************
-        v4l2_buffer buf;
-        CLEAR(buf);
-        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        buf.memory = V4L2_MEMORY_MMAP;
-
-        if (xioctl(fd, VIDIOC_DQBUF, &buf) == -1)
+        if (fds[1].revents != 0)
         {
-            switch (errno) 
-            {
-            case EAGAIN:
-                LOG(LOG_DEBUG, "VIDIOC_DQBUF returned EAGAIN\n");
-                //FIXME: what to do here?!?
-                continue;
-
-            case EIO:
-                /* Could ignore EIO, see spec. */
-
-                /* fall through */
-
-            default:
-                LOG(LOG_ERR, "VIDIOC_DQBUF error\n");
-                return;
-            }
+            LOG(LOG_DEBUG, "captureThreadFunctionAsync: stop requested\n");
+            break;
         }
 
-        //assert(buf.index < nBuffers);
-        stream->threadSubmitBuffer(helper->getBufferPointer(buf.index), buf.bytesused);
+        if (stalledMs != 0)
+        {
+            LOG(LOG_INFO,"Camera resumed after a stall of at least %d ms\n", stalledMs);
+            stalledMs = 0;
+        }
 
-        // re-queue the buffer
-        if (xioctl(fd, VIDIOC_QBUF, &buf) == -1)
+        // an error is reported as an event as well,
+        // DQBUF then fails and we stop.
+        if (!stream->threadServiceDevice(pHelper))
         {
-            LOG(LOG_ERR, "VIDIOC_DQBUF error\n");
-            return;    
+            break;
         }
     } // while  
 
+    stream->threadStopStreaming(pHelper);
+
     // Note: the destruction of the PlatformHelper 
     // by the scoped pointer will automatically
     // turn off streaming and remove the
@@ -344,14 +394,33 @@ void captureThreadFunctionAsync(PlatformStream *stream, int fd, size_t bufferSiz
 PlatformStream::PlatformStream() : 
     Stream(),
     m_quitThread(false),
-    m_helperThread(nullptr)
+    m_helperThread(nullptr),
+    m_reactor(nullptr),
+    m_reactorHelper(nullptr),
+    m_decodePool(nullptr),
+    m_pooledFrames(false),
+    m_shmExport(nullptr),
+    m_dmaEnabled(false),
+    m_dmaLatest(-1),
+    m_ioMode(CAPIO_MMAP),
+    m_activeIOMode(CAPIO_MMAP),
+    m_bufferCount(CAPQUEUE_DEFAULTBUFFERS),
+    m_queuePolicy(CAPQUEUE_ALL)
 {
-
+    m_wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (m_wakeFd < 0)
+    {
+        LOG(LOG_ERR, "Could not create the wake-up eventfd (errno %d)\n", errno);
+    }
 }
 
 PlatformStream::~PlatformStream()
 {
     close();
+    if (m_wakeFd >= 0)
+    {
+        ::close(m_wakeFd);
+    }
 }
 
 void PlatformStream::close()
@@ -362,18 +431,30 @@ void PlatformStream::close()
     m_width = 0;
     m_height = 0;
     m_isOpen = false; 
-    m_quitThread = true;
 
-    if (m_helperThread != nullptr)
+    stopCapture();
+    m_reactor = nullptr;
+    m_decodePool = nullptr;
+
+    setSharedMemoryExport(nullptr, 0);
+
+    // the capture thread has stopped streaming, so
+    // no buffer has to be handed back to the driver.
     {
-        m_helperThread->join();
-        
-        delete m_helperThread;           
-        
-        m_helperThread = nullptr;
+        std::lock_guard<std::mutex> lock(m_dmaMutex);
+        for(uint32_t i=0; i<m_dmaBuffers.size(); i++)
+        {
+            if (m_dmaBuffers[i].fd >= 0)
+            {
+                ::close(m_dmaBuffers[i].fd);
+            }
+        }
+        m_dmaBuffers.clear();
+        m_dmaEnabled = false;
+        m_dmaLatest = -1;
     }
 
-    m_frameBuffer.resize(0);
+    m_frameRing.clear();
     ::close(m_deviceHandle);
 
     m_deviceHandle = -1;    
@@ -413,6 +494,14 @@ bool PlatformStream::open(Context *owner, deviceInfo *device, uint32_t width, ui
 
     m_owner = owner;
     m_frames = 0;
+
+    PlatformContext *context = dynamic_cast<PlatformContext*>(owner);
+    m_reactor = (context != nullptr) ? context->getReactor() : nullptr;
+    m_decodePool = (context != nullptr) ? context->getDecodePool() : nullptr;
+    if (context != nullptr)
+    {
+        m_threadPolicy = context->getDefaultThreadPolicy();
+    }
     m_width = 0;
     m_height = 0;    
 
@@ -486,11 +575,27 @@ bool PlatformStream::open(Context *owner, deviceInfo *device, uint32_t width, ui
 
     // set the (max) size of the frame buffer in Stream class
     //
-    // Note: we only support 24-bit per pixel RGB
-    // buffers for now!
-    m_frameBuffer.resize(m_width*m_height*3);
+    // Note: the slots must also be able to hold
+    // native frames, see CAPFORMAT_NATIVE.
+    allocateFrames(m_fmt.fmt.pix.sizeimage);
 
     m_isOpen = true;
+    startCapture();
+    return true;
+}
+
+void PlatformStream::startCapture()
+{
+    // every frame the decode pool works on occupies a
+    // frame slot until it is published
+    if (m_decodePool != nullptr)
+    {
+        reserveDriverSlots(m_decodePool->getThreadCount());
+    }
+
+    // stopCapture released a producer waiting for
+    // room in the FIFO, let the new one wait again
+    setFifoCancelled(false);
 
     // create the helper thread to read from the device
     m_quitThread = false;
@@ -500,84 +605,1038 @@ bool PlatformStream::open(Context *owner, deviceInfo *device, uint32_t width, ui
     m_helperThread = new std::thread(&captureThreadFunction, this,
         m_deviceHandle, m_width*m_height*4);
 #else
+    if (m_reactor != nullptr)
+    {
+        // the reactor threads of the context service
+        // the device instead of a thread of our own.
+        // They service other cameras as well, so they must
+        // not wait for room in a CAPOVERFLOW_BLOCK FIFO;
+        // frames arrive as soon as the stream is added.
+        setFifoMayBlock(false);
+
+        PlatformStreamHelper *helper = new PlatformStreamHelper(m_deviceHandle);
+        if (threadStartStreaming(helper))
+        {
+            if (m_reactor->add(this, helper))
+            {
+                m_reactorHelper = helper;
+                return;
+            }
+            threadStopStreaming(helper);
+        }
+        delete helper;
+        LOG(LOG_ERR, "Could not capture on the reactor, starting a capture thread\n");
+    }
+
+    setFifoMayBlock(true);
+
     m_helperThread = new std::thread(&captureThreadFunctionAsync, this,
-        m_deviceHandle, m_width*m_height*4);
+        m_deviceHandle, m_wakeFd, m_width*m_height*4);
 #endif
 
-    return true;
+    if (!m_threadPolicy.isDefault())
+    {
+        m_threadPolicy.apply(m_helperThread->native_handle());
+    }
 }
 
-/*
+void PlatformStream::stopCapture()
+{
+    m_quitThread = true;
 
-RGB formats .. https://lwn.net/Articles/218798/
+    // a capture thread or decode worker that waits for room
+    // in the FIFO (CAPOVERFLOW_BLOCK) would never see the
+    // quit request, so release it; its frame is dropped.
+    setFifoCancelled(true);
 
- -- V4L2 DEFINE --   FOURCC
-V4L2_PIX_FMT_RGB332  RGB1
-V4L2_PIX_FMT_RGB444  R444
-V4L2_PIX_FMT_RGB555  RGB0
-V4L2_PIX_FMT_RGB565  RGBP
-V4L2_PIX_FMT_RGB555X RGBQ
-V4L2_PIX_FMT_RGB565X RGBR
-V4L2_PIX_FMT_BGR24   BGR3
-V4L2_PIX_FMT_RGB24   RGB3
-V4L2_PIX_FMT_BGR32   BGR4
-V4L2_PIX_FMT_RGB32   RGB4
-V4L2_PIX_FMT_SBGGR8  BA81
+    if (m_helperThread != nullptr)
+    {
+        // wake up the capture thread if it waits for a frame
+        const uint64_t one = 1;
+        if (write(m_wakeFd, &one, sizeof(one)) != sizeof(one))
+        {
+            LOG(LOG_ERR, "stopCapture: could not wake the capture thread (errno %d)\n", errno);
+        }
 
-*/
+        m_helperThread->join();
+        
+        delete m_helperThread;           
+        
+        m_helperThread = nullptr;
+
+        // reset the eventfd for the next capture thread
+        uint64_t count;
+        if (read(m_wakeFd, &count, sizeof(count)) != sizeof(count))
+        {
+            LOG(LOG_ERR, "stopCapture: could not reset the wake-up eventfd (errno %d)\n", errno);
+        }
+    }
+
+    if (m_reactorHelper != nullptr)
+    {
+        m_reactor->remove(this);
+        threadStopStreaming(m_reactorHelper);
+        delete m_reactorHelper;
+        m_reactorHelper = nullptr;
+    }
+
+    // frames still waiting to be decoded are dropped
+    if (m_decodePool != nullptr)
+    {
+        releaseFifoRoom(m_decodePool->cancel(this));
+        m_pooledFrames = false;
+    }
+}
+
+void PlatformStream::restartCapture()
+{
+    if ((!m_isOpen) || ((m_helperThread == nullptr) && (m_reactorHelper == nullptr)))
+    {
+        return;
+    }
+
+    stopCapture();
+    startCapture();
+}
+
+CapResult PlatformStream::setIOMode(uint32_t mode)
+{
+    if (mode > CAPIO_USERPTR)
+    {
+        LOG(LOG_ERR, "setIOMode: invalid mode %d\n", mode);
+        return CAPRESULT_ERR;
+    }
 
-//#define FRAMEDUMP
+    if (mode != m_ioMode.exchange(mode))
+    {
+        restartCapture();
+    }
+    return CAPRESULT_OK;
+}
 
-void PlatformStream::threadSubmitBuffer(void *ptr, size_t bytes)
+bool PlatformStream::threadStartStreaming(PlatformStreamHelper *helper)
 {
-    if (ptr != nullptr) 
+    const uint32_t nBuffers = getBufferCount();
+
+    // let the driver capture into the frame ring if requested,
+    // otherwise or if the driver does not support it, use
+    // the buffers of the driver.
+    const bool userPtr = (getRequestedIOMode() == CAPIO_USERPTR) &&
+        threadQueueUserBuffers(helper, nBuffers);
+
+    if (!userPtr)
     {
-        switch(m_fmt.fmt.pix.pixelformat)
+        if (!helper->createAndMapBuffers(nBuffers))
         {
-        case V4L2_PIX_FMT_RGB24:
-            Stream::submitBuffer((uint8_t*)ptr, bytes);
-            break;
-        case V4L2_PIX_FMT_YUYV:
-            // here we implement our own ::submitBuffer replacement
-            // so we can decode the 16-bit YUYV frames and copy the 24-bit
-            // RGB pixels into m_frameBuffer
-            m_bufferMutex.lock();
-            YUYV2RGB((const uint8_t*)ptr, &m_frameBuffer[0], bytes);
-            m_newFrame = true;
-            m_frames++;
-            m_bufferMutex.unlock();
-            break;            
-        case 0x47504A4D:    // MJPG
-            #ifdef FRAMEDUMP
-            {
-                static int32_t fcnt = 0;
-                char fname[100];
-                if (fcnt < 10)
-                {
-                    sprintf(fname,"frame_%d.dat", fcnt++);
-                    FILE *fout = fopen(fname, "wb");
-                    fwrite(ptr, 1, bytes, fout);
-                    fclose(fout);
-                }
-            }
-            #endif        
+            return false;
+        }
+        threadBuffersCreated(helper->m_buffers.size());
+        
+        if (!helper->queueAllBuffers())
+        {
+            return false;
+        }
+    }
+    
+    if (!helper->streamOn())
+    {
+        if (userPtr)
+        {
+            helper->unmapAndDeleteBuffers();
+            threadReleaseUserBuffers();
+        }
+        return false;
+    }
+    return true;
+}
+
+bool PlatformStream::threadServiceDevice(PlatformStreamHelper *helper)
+{
+    // ****************************************
+    // read the frame
+    // ****************************************
+    v4l2_buffer buf;
+    CLEAR(buf);
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = helper->m_memory;
+
+    if (xioctl(helper->m_fd, VIDIOC_DQBUF, &buf) == -1)
+    {
+        switch (errno) 
+        {
+        case EAGAIN:
+            LOG(LOG_DEBUG, "VIDIOC_DQBUF returned EAGAIN\n");
+            return true;
+
+        case EIO:
+            /* Could ignore EIO, see spec. */
+
+            /* fall through */
+
+        default:
+            LOG(LOG_ERR, "VIDIOC_DQBUF error\n");
+        }
+        return false;
+    }
 
-            // here we implement our own ::submitBuffer replacement
-            // so we can decode the MJEG frames and copy the 24-bit
-            // RGB pixels into m_frameBuffer
-            m_bufferMutex.lock();
-            if (m_mjpegHelper.decompressFrame((uint8_t*)ptr, bytes, &m_frameBuffer[0], m_width, m_height))
+    // in CAPQUEUE_NEWEST mode, take all the frames that are
+    // waiting and only process the last one. The device is
+    // non-blocking, so DQBUF fails with EAGAIN when the driver
+    // has no more frames.
+    while(getQueuePolicy() == CAPQUEUE_NEWEST)
+    {
+        v4l2_buffer next;
+        CLEAR(next);
+        next.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        next.memory = helper->m_memory;
+        if (xioctl(helper->m_fd, VIDIOC_DQBUF, &next) == -1)
+        {
+            if (errno != EAGAIN)
             {
-                m_newFrame = true; 
-                m_frames++;
+                LOG(LOG_ERR, "VIDIOC_DQBUF error\n");
+                return false;
             }
-            m_bufferMutex.unlock();
             break;
-        default:
-            LOG(LOG_DEBUG, "ThreadSubmitBuffer: unsupported format %s (%08X)\n", fourCCToString(m_fmt.fmt.pix.pixelformat).c_str(),
-                m_fmt.fmt.pix.pixelformat);
-            break;
-        }        
+        }
+
+        if (!threadRequeueStaleBuffer(helper, buf))
+        {
+            return false;
+        }
+        buf = next;
+    }
+
+    if (helper->m_memory == V4L2_MEMORY_USERPTR)
+    {
+        return threadSubmitUserBuffer(helper, buf);
+    }
+
+    if (!threadSubmitBuffer(helper->getBufferPointer(buf.index), buf.bytesused, &buf))
+    {
+        // kept for DMABUF export, it is re-queued 
+        // when it is no longer needed
+        return true;
+    }
+
+    // re-queue the buffer
+    if (xioctl(helper->m_fd, VIDIOC_QBUF, &buf) == -1)
+    {
+        LOG(LOG_ERR, "VIDIOC_QBUF error\n");
+        return false;
+    }
+    return true;
+}
+
+void PlatformStream::threadStopStreaming(PlatformStreamHelper *helper)
+{
+    // the frame slots can only be given back when
+    // the driver no longer captures into them.
+    if (helper->m_memory == V4L2_MEMORY_USERPTR)
+    {
+        helper->streamOff();
+        helper->unmapAndDeleteBuffers();
+        threadReleaseUserBuffers();
+    }
+}
+
+CapResult PlatformStream::setCaptureQueue(uint32_t bufferCount, uint32_t policy)
+{
+    if (bufferCount == 0)
+    {
+        bufferCount = CAPQUEUE_DEFAULTBUFFERS;
+    }
+
+    if ((bufferCount < 2) || (bufferCount > CAPQUEUE_MAXBUFFERS) || (policy > CAPQUEUE_NEWEST))
+    {
+        LOG(LOG_ERR, "setCaptureQueue: invalid buffer count (%d) or policy (%d)\n", bufferCount, policy);
+        return CAPRESULT_ERR;
+    }
+
+    // the capture thread picks up the policy with the next frame
+    m_queuePolicy = policy;
+    if (bufferCount != m_bufferCount.exchange(bufferCount))
+    {
+        // the driver buffers can only be re-allocated while the
+        // device is not streaming. stopCapture releases a capture
+        // thread that waits for room in a CAPOVERFLOW_BLOCK FIFO.
+        restartCapture();
+    }
+    return CAPRESULT_OK;
+}
+
+bool PlatformStream::threadRequeueStaleBuffer(PlatformStreamHelper *helper, v4l2_buffer &buf)
+{
+    trackDeviceSequence(buf.sequence);
+    countStaleFrame();
+
+    if (helper->m_memory == V4L2_MEMORY_USERPTR)
+    {
+        // the slot has not been published, so the
+        // driver can capture into it again.
+        if (buf.index >= m_userSlots.size())
+        {
+            return false;
+        }
+        FrameSlot *slot = m_userSlots[buf.index];
+        return helper->queueUserBuffer(buf.index, &slot->m_data[0], slot->m_data.size());
+    }
+
+    if (xioctl(helper->m_fd, VIDIOC_QBUF, &buf) == -1)
+    {
+        LOG(LOG_ERR, "threadRequeueStaleBuffer: VIDIOC_QBUF failed (errno=%d)\n", errno);
+        return false;
+    }
+    return true;
+}
+
+CapResult PlatformStream::setThreadPolicy(uint32_t policy, int32_t priority, uint64_t cpuMask)
+{
+    ThreadPolicy threadPolicy;
+    threadPolicy.policy   = policy;
+    threadPolicy.priority = priority;
+    threadPolicy.cpuMask  = cpuMask;
+    if (!threadPolicy.isValid())
+    {
+        LOG(LOG_ERR, "setThreadPolicy: invalid policy (%d) or priority (%d)\n", policy, priority);
+        return CAPRESULT_ERR;
+    }
+
+    // also used when capturing is restarted
+    m_threadPolicy = threadPolicy;
+    if (m_helperThread != nullptr)
+    {
+        return threadPolicy.apply(m_helperThread->native_handle()) ? CAPRESULT_OK : CAPRESULT_ERR;
+    }
+
+    if (m_reactorHelper != nullptr)
+    {
+        LOG(LOG_INFO, "setThreadPolicy: the stream is serviced by the reactor threads, see setDefaultThreadPolicy\n");
+    }
+    return CAPRESULT_OK;
+}
+
+bool PlatformStream::isPassthrough(uint32_t format, uint32_t scale) const
+{
+    if (format == CAPFORMAT_NATIVE)
+    {
+        return true;
+    }
+
+    if (scale != 1)
+    {
+        return false;
+    }
+
+    switch(m_fmt.fmt.pix.pixelformat)
+    {
+    case V4L2_PIX_FMT_RGB24:
+        return (format == CAPFORMAT_RGB24);
+    case V4L2_PIX_FMT_GREY:
+        return (format == CAPFORMAT_GRAY8);
+    default:
+        return false;
+    }
+}
+
+bool PlatformStream::threadQueueUserBuffers(PlatformStreamHelper *helper, uint32_t nBuffers)
+{
+    if (!helper->createUserBuffers(nBuffers))
+    {
+        return false;
+    }
+
+    // user pointer buffers cannot be exported as DMABUFs
+    threadBuffersCreated(0);
+
+    // every buffer in the driver occupies a frame slot
+    const uint32_t count = helper->m_buffers.size();
+    bool ok = reserveDriverSlots(count);
+    m_userSlots.assign(count, nullptr);
+    for(uint32_t i=0; ok && (i<count); i++)
+    {
+        FrameSlot *slot = reserveFrame();
+        if (slot != nullptr)
+        {
+            m_userSlots[i] = slot;
+            ok = helper->queueUserBuffer(i, &slot->m_data[0], slot->m_data.size());
+        }
+        else
+        {
+            ok = false;
+        }
+    }
+
+    if (!ok)
+    {
+        LOG(LOG_INFO, "User pointer I/O failed, falling back to mmap buffers\n");
+        helper->unmapAndDeleteBuffers();
+        threadReleaseUserBuffers();
+        return false;
+    }
+
+    m_activeIOMode = CAPIO_USERPTR;
+    return true;
+}
+
+bool PlatformStream::threadSubmitUserBuffer(PlatformStreamHelper *helper, const v4l2_buffer &buf)
+{
+    if (buf.index >= m_userSlots.size())
+    {
+        return false;
+    }
+
+    FrameSlot *slot = m_userSlots[buf.index];
+
+    // frames that must be converted are decoded
+    // into another slot, as in mmap mode.
+    if (!isPassthrough(m_outputFormat, m_outputScale))
+    {
+        threadSubmitBuffer(&slot->m_data[0], buf.bytesused, &buf);
+        return helper->queueUserBuffer(buf.index, &slot->m_data[0], slot->m_data.size());
+    }
+
+    trackDeviceSequence(buf.sequence);
+
+    // the driver needs a slot in place of the one that is
+    // published. If there is none, the frame is dropped
+    // and the slot is captured into again.
+    FrameSlot *next = nullptr;
+    if (!skipFrame())
+    {
+        next = reserveFrame();
+    }
+
+    if ((next != nullptr) && (!beginFrame(slot)))
+    {
+        m_frameRing.cancelWrite(next);
+        next = nullptr;
+    }
+
+    const uint32_t fourCC = m_fmt.fmt.pix.pixelformat;
+    const uint32_t stride = (fourCC == 0x47504A4D) ? 0 : m_fmt.fmt.pix.bytesperline;
+    if ((next != nullptr) && ((!isPassthrough(slot->m_format, slot->m_scale)) ||
+        ((slot->m_format != CAPFORMAT_NATIVE) && (buf.bytesused < stride*m_height))))
+    {
+        // short frame, or the output format changed after the check above
+        LOG(LOG_VERBOSE, "threadSubmitUserBuffer: dropping frame\n");
+        m_libraryDropped++;
+        m_frameRing.cancelWrite(next);
+        next = nullptr;
+    }
+
+    if (next == nullptr)
+    {
+        return helper->queueUserBuffer(buf.index, &slot->m_data[0], slot->m_data.size());
+    }
+
+    setFrameInfo(slot, &buf);
+    slot->m_stride    = stride;
+    slot->m_bytes     = (slot->m_format == CAPFORMAT_NATIVE) ? buf.bytesused : stride*m_height;
+    slot->m_rawFourCC = fourCC;
+    exportFrame(slot, commitFrame(slot));
+
+    m_userSlots[buf.index] = next;
+    return helper->queueUserBuffer(buf.index, &next->m_data[0], next->m_data.size());
+}
+
+void PlatformStream::threadReleaseUserBuffers()
+{
+    for(uint32_t i=0; i<m_userSlots.size(); i++)
+    {
+        if (m_userSlots[i] != nullptr)
+        {
+            m_frameRing.cancelWrite(m_userSlots[i]);
+        }
+    }
+    m_userSlots.clear();
+    reserveDriverSlots(0);
+    m_activeIOMode = CAPIO_MMAP;
+}
+
+/*
+
+RGB formats .. https://lwn.net/Articles/218798/
+
+ -- V4L2 DEFINE --   FOURCC
+V4L2_PIX_FMT_RGB332  RGB1
+V4L2_PIX_FMT_RGB444  R444
+V4L2_PIX_FMT_RGB555  RGB0
+V4L2_PIX_FMT_RGB565  RGBP
+V4L2_PIX_FMT_RGB555X RGBQ
+V4L2_PIX_FMT_RGB565X RGBR
+V4L2_PIX_FMT_BGR24   BGR3
+V4L2_PIX_FMT_RGB24   RGB3
+V4L2_PIX_FMT_BGR32   BGR4
+V4L2_PIX_FMT_RGB32   RGB4
+V4L2_PIX_FMT_SBGGR8  BA81
+
+*/
+
+void PlatformStream::setFrameInfo(FrameSlot *slot, const v4l2_buffer *buf)
+{
+    if (buf == nullptr)
+    {
+        return;
+    }
+
+    // only use the driver timestamp when it is on the
+    // monotonic clock. Otherwise, keep the arrival time
+    // set by beginFrame.
+    if ((buf->flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC)
+    {
+        slot->m_info.captureTimestamp = static_cast<uint64_t>(buf->timestamp.tv_sec)*1000000ULL
+            + buf->timestamp.tv_usec;
+    }
+    slot->m_info.deviceSequence = buf->sequence;
+    slot->m_info.flags = buf->flags;
+}
+
+bool PlatformStream::threadSubmitBuffer(void *ptr, size_t bytes, const v4l2_buffer *buf)
+{
+    if (buf != nullptr)
+    {
+        trackDeviceSequence(buf->sequence);
+    }
+
+    // skipped frames go straight back to the driver
+    if ((ptr == nullptr) || skipFrame())
+    {
+        return true;
+    }
+
+    const uint32_t fourCC = m_fmt.fmt.pix.pixelformat;
+    switch(fourCC)
+    {
+    case V4L2_PIX_FMT_RGB24:
+    case V4L2_PIX_FMT_YUYV:
+    case V4L2_PIX_FMT_GREY:
+        break;
+    case 0x47504A4D:    // MJPG
+        break;
+    default:
+        LOG(LOG_DEBUG, "ThreadSubmitBuffer: unsupported format %s (%08X)\n", fourCCToString(fourCC).c_str(),
+            fourCC);
+        return true;
+    }
+
+    // frames that are decoded go to the decode pool, if 
+    // the context has one, so the buffer can be handed 
+    // back to the driver right away. Frames that are only
+    // copied or that are kept for DMABUF export are still
+    // handled here.
+    if (useDecodePool(buf))
+    {
+        // the overflow policy of the FIFO is applied here, so a
+        // CAPOVERFLOW_BLOCK stream holds up its own capture thread
+        // rather than a worker that decodes for other streams.
+        if (!reserveFifoRoom())
+        {
+            return true;
+        }
+
+        m_pooledFrames = true;
+        const uint32_t dropped = m_decodePool->submit(this, ptr, bytes, *buf, getTimestamp());
+        for(uint32_t i=0; i<dropped; i++)
+        {
+            countStaleFrame();
+        }
+        releaseFifoRoom(dropped);
+        return true;
+    }
+
+    // frames still in the decode pool are published first,
+    // so frames stay in order when the output format or
+    // decode mode changes.
+    if (m_pooledFrames)
+    {
+        m_decodePool->flush(this);
+        m_pooledFrames = false;
+    }
+
+    FrameSlot *slot = threadDecodeFrame((const uint8_t*)ptr, bytes, buf, 0, nullptr);
+    if (slot == nullptr)
+    {
+        return true;
+    }
+
+    exportFrame(slot, commitFrame(slot));
+    return (buf == nullptr) || (buf->memory != V4L2_MEMORY_MMAP) || (!holdDmaBuf(slot, buf));
+}
+
+bool PlatformStream::useDecodePool(const v4l2_buffer *buf)
+{
+    if ((m_decodePool == nullptr) || (buf == nullptr) || (buf->memory != V4L2_MEMORY_MMAP))
+    {
+        return false;
+    }
+
+    if (isLazyDecode() || (getOutputFormat() == CAPFORMAT_NATIVE))
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_dmaMutex);
+    return !m_dmaEnabled;
+}
+
+void PlatformStream::threadDecodeJob(DecodeJob *job, MJPEGHelper *mjpeg)
+{
+    job->m_started = getTimestamp();
+    job->m_slot = threadDecodeFrame(job->m_payload.data(), job->m_bytes, &job->m_buf, 
+        job->m_arrival, mjpeg);
+    job->m_decoded = getTimestamp();
+}
+
+void PlatformStream::threadPublishJob(DecodeJob *job)
+{
+    if (job->m_slot == nullptr)
+    {
+        // the frame was dropped, see threadDecodeFrame
+        releaseFifoRoom(1);
+        return;
+    }
+
+    // the time spent waiting for a worker and
+    // for the frames that arrived earlier
+    const uint64_t now = getTimestamp();
+    uint64_t delay = (job->m_started > job->m_arrival) ? job->m_started - job->m_arrival : 0;
+    delay += (now > job->m_decoded) ? now - job->m_decoded : 0;
+    countPipelineDelay(delay);
+
+    exportFrame(job->m_slot, commitFrame(job->m_slot, true));
+    job->m_slot = nullptr;
+}
+
+FrameSlot* PlatformStream::threadDecodeFrame(const uint8_t *ptr, size_t bytes, const v4l2_buffer *buf,
+    uint64_t arrival, MJPEGHelper *mjpeg)
+{
+    const uint32_t fourCC = m_fmt.fmt.pix.pixelformat;
+
+    // here we implement our own ::submitBuffer replacement
+    // so we can decode the frames directly into a 24-bit
+    // RGB frame slot. The slot is not visible to readers
+    // until it is committed. A frame from the decode pool
+    // was admitted to the FIFO by the capture thread.
+    FrameSlot *slot = (arrival != 0) ? beginReservedFrame() : beginFrame();
+    if (slot == nullptr)
+    {
+        return nullptr;
+    }
+
+    // a frame from the decode pool arrived earlier
+    // than beginFrame was called
+    if (arrival != 0)
+    {
+        slot->m_info.captureTimestamp = arrival;
+    }
+    setFrameInfo(slot, buf);
+
+    // in lazy mode, only keep the payload. It is decoded
+    // by decodePayload when the frame is read.
+    bool ok = true;
+    if (isLazyDecode() && (fourCC != V4L2_PIX_FMT_RGB24) && (slot->m_format != CAPFORMAT_NATIVE))
+    {
+        storePayload(slot, ptr, bytes, fourCC);
+    }
+    else if (slot->m_format == CAPFORMAT_NATIVE)
+    {
+        const size_t maxBytes = m_frameRing.getSlotBytes();
+        slot->m_bytes  = (bytes < maxBytes) ? bytes : maxBytes;
+        slot->m_stride = (fourCC == 0x47504A4D) ? 0 : m_fmt.fmt.pix.bytesperline;
+        slot->m_rawFourCC = fourCC;
+        memcpy(&slot->m_data[0], ptr, slot->m_bytes);
+    }
+    else
+    {
+        // keep the JPEG bitstream for Cap_captureRawFrame,
+        // it is small compared to the decoded frame.
+        if (fourCC == 0x47504A4D)
+        {
+            storePayload(slot, ptr, bytes, fourCC);
+        }
+        ok = decodeBuffer(ptr, bytes, fourCC, slot->m_format, slot->m_scale,
+            &slot->m_data[0], slot->m_stride, mjpeg);
+        slot->m_decoded.store(true, std::memory_order_relaxed);
+    }
+
+    if (!ok)
+    {
+        abortFrame(slot);
+        return nullptr;
+    }
+    return slot;
+}
+
+void PlatformStream::threadBuffersCreated(uint32_t count)
+{
+    std::lock_guard<std::mutex> lock(m_dmaMutex);
+
+    // the buffers of a previous capture thread are gone
+    for(uint32_t i=0; i<m_dmaBuffers.size(); i++)
+    {
+        if (m_dmaBuffers[i].fd >= 0)
+        {
+            ::close(m_dmaBuffers[i].fd);
+        }
+    }
+
+    DmaBuffer dma;
+    memset(&dma, 0, sizeof(dma));
+    dma.fd = -1;
+    m_dmaBuffers.assign(count, dma);
+    m_dmaLatest = -1;
+}
+
+bool PlatformStream::holdDmaBuf(const FrameSlot *slot, const v4l2_buffer *buf)
+{
+    std::lock_guard<std::mutex> lock(m_dmaMutex);
+    if ((!m_dmaEnabled) || (buf->index >= m_dmaBuffers.size()))
+    {
+        return false;
+    }
+
+    DmaBuffer &dma = m_dmaBuffers[buf->index];
+    if (dma.fd < 0)
+    {
+        v4l2_exportbuffer expbuf;
+        CLEAR(expbuf);
+        expbuf.type  = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        expbuf.index = buf->index;
+        expbuf.flags = O_RDONLY | O_CLOEXEC;
+        if (xioctl(m_deviceHandle, VIDIOC_EXPBUF, &expbuf) == -1)
+        {
+            LOG(LOG_ERR, "VIDIOC_EXPBUF failed (errno=%d) - DMABUF export disabled\n", errno);
+            m_dmaEnabled = false;
+            return false;
+        }
+        dma.fd = expbuf.fd;
+    }
+
+    // the driver needs two buffers to keep capturing. Count the
+    // buffers that stay out of the queue if this one is kept.
+    uint32_t held = 1;
+    for(uint32_t i=0; i<m_dmaBuffers.size(); i++)
+    {
+        if (m_dmaBuffers[i].held && ((m_dmaBuffers[i].leases != 0) || (static_cast<int32_t>(i) != m_dmaLatest)))
+        {
+            held++;
+        }
+    }
+
+    if ((held + 2) > m_dmaBuffers.size())
+    {
+        LOG(LOG_VERBOSE, "holdDmaBuf: too many buffers are leased - frame not exported\n");
+        return false;
+    }
+
+    if ((m_dmaLatest >= 0) && (m_dmaBuffers[m_dmaLatest].leases == 0))
+    {
+        requeueDmaBuf(m_dmaLatest);
+    }
+
+    dma.held   = true;
+    dma.bytes  = buf->bytesused;
+    dma.length = buf->length;
+    dma.info   = slot->m_info;
+    m_dmaLatest = buf->index;
+    return true;
+}
+
+void PlatformStream::requeueDmaBuf(uint32_t index)
+{
+    v4l2_buffer buf;
+    CLEAR(buf);
+    buf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = V4L2_MEMORY_MMAP;
+    buf.index  = index;
+
+    // V4L2 allows queueing from another thread while the
+    // capture thread waits in select or VIDIOC_DQBUF.
+    if (xioctl(m_deviceHandle, VIDIOC_QBUF, &buf) == -1)
+    {
+        LOG(LOG_ERR, "requeueDmaBuf: VIDIOC_QBUF failed (errno=%d)\n", errno);
+    }
+    m_dmaBuffers[index].held = false;
+}
+
+CapResult PlatformStream::setDmaBufExport(bool enable)
+{
+    std::lock_guard<std::mutex> lock(m_dmaMutex);
+    if (!enable)
+    {
+        // leased buffers are re-queued when they are released
+        if ((m_dmaLatest >= 0) && (m_dmaBuffers[m_dmaLatest].leases == 0))
+        {
+            requeueDmaBuf(m_dmaLatest);
+        }
+        m_dmaLatest = -1;
+        m_dmaEnabled = false;
+        return CAPRESULT_OK;
+    }
+
+    if (!m_isOpen)
+    {
+        LOG(LOG_ERR, "setDmaBufExport: stream is not open\n");
+        return CAPRESULT_ERR;
+    }
+
+    // the buffers are exported by the capture thread when they
+    // are first kept. Cameras that only support read() have 
+    // no buffers, so no frame is exported.
+    m_dmaEnabled = true;
+    return CAPRESULT_OK;
+}
+
+CapResult PlatformStream::acquireDmaBuf(CapDmaBufLease *lease)
+{
+    if (lease == nullptr)
+    {
+        return CAPRESULT_ERR;
+    }
+
+    std::lock_guard<std::mutex> lock(m_dmaMutex);
+    if (m_dmaLatest < 0)
+    {
+        memset(lease, 0, sizeof(CapDmaBufLease));
+        lease->fd = -1;
+        return CAPRESULT_NOFRAME;
+    }
+
+    DmaBuffer &dma = m_dmaBuffers[m_dmaLatest];
+    dma.leases++;
+
+    lease->fd     = dma.fd;
+    lease->bytes  = dma.bytes;
+    lease->length = dma.length;
+    lease->width  = m_fmt.fmt.pix.width;
+    lease->height = m_fmt.fmt.pix.height;
+    lease->stride = (m_fmt.fmt.pix.pixelformat == 0x47504A4D) ? 0 : m_fmt.fmt.pix.bytesperline;
+    lease->fourCC = m_fmt.fmt.pix.pixelformat;
+    lease->buffer = m_dmaLatest;
+    lease->info   = dma.info;
+    return CAPRESULT_OK;
+}
+
+bool PlatformStream::releaseDmaBuf(const CapDmaBufLease *lease)
+{
+    if (lease == nullptr)
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_dmaMutex);
+    if ((lease->buffer >= m_dmaBuffers.size()) || (m_dmaBuffers[lease->buffer].leases == 0) ||
+        (m_dmaBuffers[lease->buffer].info.sequence != lease->info.sequence))
+    {
+        LOG(LOG_ERR, "releaseDmaBuf: invalid lease\n");
+        return false;
+    }
+
+    DmaBuffer &dma = m_dmaBuffers[lease->buffer];
+    dma.leases--;
+    if ((dma.leases == 0) && dma.held && (static_cast<int32_t>(lease->buffer) != m_dmaLatest))
+    {
+        requeueDmaBuf(lease->buffer);
+    }
+    return true;
+}
+
+
+void PlatformStream::exportFrame(FrameSlot *slot, uint32_t sequence)
+{
+    std::lock_guard<std::mutex> lock(m_shmMutex);
+    if (m_shmExport == nullptr)
+    {
+        return;
+    }
+
+    // frames are published in ticket order and acquireWrite
+    // skips the latest slot, but a pin keeps the slot from
+    // being re-used by any producer while we read from it.
+    if (!m_frameRing.pin(slot, sequence))
+    {
+        return;
+    }
+
+    uint8_t *dst = m_shmExport->beginWrite(sequence);
+    bool ok = true;
+    if (!slot->m_decoded.load(std::memory_order_acquire))
+    {
+        // decode straight into shared memory
+        ok = decodePayload(slot, dst, slot->m_stride);
+    }
+    else
+    {
+        memcpy(dst, &slot->m_data[0], slot->m_bytes);
+    }
+
+    if (ok)
+    {
+        m_shmExport->endWrite(slot);
+    }
+    else
+    {
+        m_shmExport->cancelWrite();
+    }
+    m_frameRing.releaseRead(slot->m_index, sequence);
+}
+
+bool PlatformStream::setSharedMemoryExport(const char *name, uint32_t slots)
+{
+    std::lock_guard<std::mutex> lock(m_shmMutex);
+    delete m_shmExport;
+    m_shmExport = nullptr;
+
+    if (name == nullptr)
+    {
+        return true;
+    }
+
+    if (!m_isOpen)
+    {
+        LOG(LOG_ERR, "setSharedMemoryExport: stream is not open\n");
+        return false;
+    }
+
+    // each slot can hold a frame in any output format
+    SharedMemoryExport *shmExport = new SharedMemoryExport();
+    if (!shmExport->create(name, slots, m_frameRing.getSlotBytes()))
+    {
+        delete shmExport;
+        return false;
+    }
+
+    m_shmExport = shmExport;
+    return true;
+}
+
+bool PlatformStream::decodePayload(const FrameSlot *slot, uint8_t *dst, uint32_t stride)
+{
+    return decodeBuffer(&slot->m_raw[0], slot->m_rawBytes, slot->m_rawFourCC, slot->m_format,
+        slot->m_scale, dst, stride);
+}
+
+bool PlatformStream::decodePayloadRegion(const FrameSlot *slot, const CapROI &roi, uint32_t stride)
+{
+    uint8_t *dst = static_cast<uint8_t*>(roi.buffer);
+    switch(slot->m_rawFourCC)
+    {
+    case V4L2_PIX_FMT_YUYV:
+        {
+            const uint32_t srcStride = (m_fmt.fmt.pix.bytesperline != 0) ? m_fmt.fmt.pix.bytesperline : m_width*2;
+            if (slot->m_rawBytes < srcStride*m_height)
+            {
+                return false;
+            }
+            return convertYUYVRegion(&slot->m_raw[0], srcStride, roi.x, roi.y, roi.width, roi.height,
+                dst, stride, slot->m_format, slot->m_scale);
+        }
+    case 0x47504A4D:    // MJPG
+        if (MJPEGHelper::supportsPartialDecode())
+        {
+            std::lock_guard<std::mutex> lock(m_mjpegMutex);
+            return m_mjpegHelper.decompressRegion(&slot->m_raw[0], slot->m_rawBytes, 
+                roi.x, roi.y, roi.width, roi.height, dst, stride, slot->m_format, slot->m_scale);
+        }
+        return false;
+    default:
+        return false;
+    }
+}
+
+bool PlatformStream::decodeBuffer(const uint8_t *ptr, size_t bytes, uint32_t fourCC, 
+    uint32_t format, uint32_t scale, uint8_t *dst, uint32_t dstStride, MJPEGHelper *mjpeg)
+{
+    uint32_t srcStride = m_fmt.fmt.pix.bytesperline;
+
+    switch(fourCC)
+    {
+    case V4L2_PIX_FMT_RGB24:
+        if (srcStride == 0) srcStride = m_width*3;
+        if (bytes < srcStride*m_height)
+        {
+            LOG(LOG_VERBOSE, "decodeBuffer: short RGB frame (%d bytes)\n", bytes);
+            return false;
+        }
+        if (scale != 1)
+        {
+            return false;
+        }
+        return convertRGB24(ptr, srcStride, m_width, m_height, dst, dstStride, format);
+    case V4L2_PIX_FMT_YUYV:
+        if (srcStride == 0) srcStride = m_width*2;
+        if (bytes < srcStride*m_height)
+        {
+            LOG(LOG_VERBOSE, "decodeBuffer: short YUYV frame (%d bytes)\n", bytes);
+            return false;
+        }
+        return convertYUYV(ptr, srcStride, getScaledSize(m_width, scale), getScaledSize(m_height, scale),
+            dst, dstStride, format, scale);
+    case V4L2_PIX_FMT_GREY:
+        if (srcStride == 0) srcStride = m_width;
+        if ((bytes < srcStride*m_height) || (format != CAPFORMAT_GRAY8) || (scale != 1))
+        {
+            return false;
+        }
+        for(uint32_t y=0; y<m_height; y++)
+        {
+            memcpy(dst + y*dstStride, ptr + y*srcStride, m_width);
+        }
+        return true;
+    case 0x47504A4D:    // MJPG
+        if (mjpeg != nullptr)
+        {
+            return mjpeg->decompressFrame(ptr, bytes, dst, m_width, m_height,
+                dstStride, format, scale);
+        }
+        else
+        {
+            // the decompressor is shared between the capture
+            // thread and readers decoding lazily.
+            std::lock_guard<std::mutex> lock(m_mjpegMutex);
+            return m_mjpegHelper.decompressFrame(ptr, bytes, dst, m_width, m_height,
+                dstStride, format, scale);
+        }
+    default:
+        return false;
+    }
+}
+
+bool PlatformStream::supportsOutputFormat(uint32_t format)
+{
+    if (!m_isOpen)
+    {
+        return false;
+    }
+
+    switch(m_fmt.fmt.pix.pixelformat)
+    {
+    case V4L2_PIX_FMT_RGB24:
+        return (format != CAPFORMAT_NV12) && (format != CAPFORMAT_I420);
+    case V4L2_PIX_FMT_YUYV:
+    case 0x47504A4D:    // MJPG
+        return true;
+    case V4L2_PIX_FMT_GREY:
+        return (format == CAPFORMAT_GRAY8) || (format == CAPFORMAT_NATIVE);
+    default:
+        return (format == CAPFORMAT_NATIVE);
+    }
+}
+
+bool PlatformStream::supportsOutputScale(uint32_t denom)
+{
+    if (!m_isOpen)
+    {
+        return false;
+    }
+
+    switch(m_fmt.fmt.pix.pixelformat)
+    {
+    case V4L2_PIX_FMT_YUYV:
+    case 0x47504A4D:    // MJPG
+        return true;
+    default:
+        return (denom == 1);
     }
 }
 
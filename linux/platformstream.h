@@ -35,10 +35,15 @@
 #include <vector>
 #include <mutex>
 #include <thread>
+#include <atomic>
 #include <linux/videodev2.h>
 #include "../common/logging.h"
 #include "../common/stream.h"
 #include "mjpeghelper.h"
+#include "shmexport.h"
+#include "capturereactor.h"
+#include "decodepool.h"
+#include "threadpolicy.h"
 
 
 class Context;          // pre-declaration
@@ -50,7 +55,7 @@ class PlatformStream;  // pre-declaration
 class PlatformStreamHelper
 {
 public:
-    PlatformStreamHelper(int fd) : m_fd(fd)
+    PlatformStreamHelper(int fd) : m_fd(fd), m_memory(V4L2_MEMORY_MMAP)
     {
         LOG(LOG_DEBUG, "PlatformStreamHelper created.\n");
     }
@@ -71,6 +76,14 @@ public:
     /** create a number of memory mapped buffers */
     bool createAndMapBuffers(uint32_t nBuffers);
 
+    /** request a number of buffers that are supplied by the
+        caller, see queueUserBuffer. Returns false if the driver
+        does not support V4L2_MEMORY_USERPTR. */
+    bool createUserBuffers(uint32_t nBuffers);
+
+    /** queue a caller-supplied buffer for use by V4L2 */
+    bool queueUserBuffer(uint32_t index, void *ptr, size_t length);
+
     /** queue all the buffer for use by V4L2 */
     bool queueAllBuffers();
 
@@ -102,6 +115,7 @@ public:
 
     std::vector<bufferInfo> m_buffers;
     int m_fd; 
+    uint32_t m_memory;  ///< V4L2_MEMORY_MMAP or V4L2_MEMORY_USERPTR
 };
 
 
@@ -143,15 +157,217 @@ public:
 
     /** public submit buffer so the capture thread/function
         can access it. In additon, this function handles any 
-        conversion to RGB output buffers, if necessary */
-    void threadSubmitBuffer(void *ptr, size_t bytes);
+        conversion to RGB output buffers, if necessary.
+        'buf' holds the V4L2 metadata of the frame and can be
+        NULL when the frame was obtained with read().
+        Returns false if the buffer is kept for DMABUF export,
+        in which case the capture thread must not re-queue it. */
+    bool threadSubmitBuffer(void *ptr, size_t bytes, const v4l2_buffer *buf);
+
+    /** called by a worker of the decode pool to decode a frame 
+        queued by threadSubmitBuffer into job->m_slot, using the
+        worker's own decompressor. Several jobs of the stream can
+        be decoded at the same time. */
+    void threadDecodeJob(DecodeJob *job, MJPEGHelper *mjpeg);
+
+    /** called by the decode pool to publish a frame decoded by
+        threadDecodeJob. The pool calls this for one job of the
+        stream at a time, in the order the frames arrived. */
+    void threadPublishJob(DecodeJob *job);
+
+    /** called by the capture thread to create and queue the
+        V4L2 buffers and start streaming. Returns false if this
+        fails. */
+    bool threadStartStreaming(PlatformStreamHelper *helper);
+
+    /** called by the capture thread or the capture reactor when
+        the device has a frame: dequeue and process it and hand 
+        the buffer back to the driver. Returns false if capturing
+        cannot continue. */
+    bool threadServiceDevice(PlatformStreamHelper *helper);
+
+    /** called by the capture thread when it stops, to give back 
+        the buffers that must be released before the helper is
+        deleted */
+    void threadStopStreaming(PlatformStreamHelper *helper);
+
+    /** called by the capture thread when it has created
+        the V4L2 buffers */
+    void threadBuffersCreated(uint32_t count);
+
+    /** Return the I/O mode selected with setIOMode */
+    uint32_t getRequestedIOMode() const
+    {
+        return m_ioMode;
+    }
+
+    /** called by the capture thread to let the driver capture
+        into frame slots. Returns false if the driver does not
+        support this, in which case it must use mmap buffers. */
+    bool threadQueueUserBuffers(PlatformStreamHelper *helper, uint32_t nBuffers);
+
+    /** called by the capture thread for a buffer dequeued in
+        user pointer mode. The frame slot is published without
+        copying if possible, and a slot is queued in its place.
+        Returns false if the buffer could not be queued again. */
+    bool threadSubmitUserBuffer(PlatformStreamHelper *helper, const v4l2_buffer &buf);
+
+    /** called by the capture thread to give back the slots 
+        queued by threadQueueUserBuffers, after streaming has
+        stopped */
+    void threadReleaseUserBuffers();
+
+    /** Return the number of driver buffers selected with setCaptureQueue */
+    uint32_t getBufferCount() const
+    {
+        return m_bufferCount;
+    }
+
+    /** Return the CAPQUEUE_xxx policy selected with setCaptureQueue */
+    uint32_t getQueuePolicy() const
+    {
+        return m_queuePolicy;
+    }
+
+    /** called by the capture thread for a buffer that is skipped
+        because a newer one is waiting. The buffer is handed back
+        to the driver without being processed. Returns false if
+        the buffer could not be queued again. */
+    bool threadRequeueStaleBuffer(PlatformStreamHelper *helper, v4l2_buffer &buf);
+
+    /** Select mmap or user pointer I/O, see Cap_setIOMode */
+    virtual CapResult setIOMode(uint32_t mode) override;
+
+    /** Return the I/O mode the capture thread uses */
+    virtual uint32_t getIOMode() override
+    {
+        return m_activeIOMode;
+    }
+
+    /** Set the number of V4L2 buffers and the queue policy, see Cap_setCaptureQueue */
+    virtual CapResult setCaptureQueue(uint32_t bufferCount, uint32_t policy) override;
+
+    /** Set the policy of the capture thread, see Cap_setThreadPolicy */
+    virtual CapResult setThreadPolicy(uint32_t policy, int32_t priority, uint64_t cpuMask) override;
+
+    /** Export the camera buffers as DMABUFs */
+    virtual CapResult setDmaBufExport(bool enable) override;
+
+    /** Lease the DMABUF of the most recent frame */
+    virtual CapResult acquireDmaBuf(CapDmaBufLease *lease) override;
+
+    /** Return a DMABUF leased by acquireDmaBuf */
+    virtual bool releaseDmaBuf(const CapDmaBufLease *lease) override;
 
 protected:
+    /** The output formats depend on the camera format */
+    virtual bool supportsOutputFormat(uint32_t format) override;
+
+    /** YUYV frames are subsampled, MJPEG frames use DCT scaling */
+    virtual bool supportsOutputScale(uint32_t denom) override;
+
+    /** Export frames to a POSIX shared memory ring */
+    virtual bool setSharedMemoryExport(const char *name, uint32_t slots) override;
+
+    /** Write a committed frame to the shared memory ring, if any.
+        'sequence' is the frame's sequence number from commitFrame. */
+    void exportFrame(FrameSlot *slot, uint32_t sequence);
+
+    /** Decode a payload stored by threadSubmitBuffer in lazy mode */
+    virtual bool decodePayload(const FrameSlot *slot, uint8_t *dst, uint32_t stride) override;
+
+    /** Decode only a region of a payload stored in lazy mode */
+    virtual bool decodePayloadRegion(const FrameSlot *slot, const CapROI &roi, uint32_t stride) override;
+
+    /** Convert a camera buffer with the given FOURCC into 'dst' 
+        in the given output format (not CAPFORMAT_NATIVE), with
+        rows 'dstStride' bytes apart. For MJPEG, the stride is 
+        passed straight to the decompressor. The output is
+        1/scale of the camera resolution, see setOutputScale.
+        MJPEG is decoded with 'mjpeg' if it is not nullptr,
+        otherwise with m_mjpegHelper.
+        Returns false if the buffer could not be decoded. */
+    bool decodeBuffer(const uint8_t *ptr, size_t bytes, uint32_t fourCC, 
+        uint32_t format, uint32_t scale, uint8_t *dst, uint32_t dstStride,
+        MJPEGHelper *mjpeg = nullptr);
+
+    /** Start capturing, on the capture reactor of the
+        context if it has one, otherwise on a capture thread */
+    void startCapture();
+
+    /** Stop capturing and wait until the device is no
+        longer serviced */
+    void stopCapture();
+
+    /** Stop and start capturing, e.g. to change the I/O mode */
+    void restartCapture();
+
+    /** Returns true if a camera frame is published as it is in
+        the given output format and scale */
+    bool isPassthrough(uint32_t format, uint32_t scale) const;
+
+    /** Returns true if threadSubmitBuffer hands the frame in
+        'buf' to the decode pool instead of decoding it */
+    bool useDecodePool(const v4l2_buffer *buf);
+
+    /** Decode or copy a camera frame into a new frame slot, which
+        the caller must publish with commitFrame. 'arrival' is the
+        time a frame of the decode pool was dequeued, which the
+        capture thread admitted with reserveFifoRoom, or 0 if the
+        frame was dequeued just now. MJPEG frames are decoded with
+        'mjpeg', or with the stream's own decompressor if it is
+        nullptr. Returns nullptr if the frame was dropped. */
+    FrameSlot* threadDecodeFrame(const uint8_t *ptr, size_t bytes, const v4l2_buffer *buf,
+        uint64_t arrival, MJPEGHelper *mjpeg);
+
+    /** Copy the V4L2 timestamp, sequence number and flags to the frame slot */
+    void setFrameInfo(FrameSlot *slot, const v4l2_buffer *buf);
+
+    /** Keep the V4L2 buffer of a committed frame for DMABUF export
+        and hand the previous one back to the driver, unless it is
+        leased. Returns false if the buffer is not kept. */
+    bool holdDmaBuf(const FrameSlot *slot, const v4l2_buffer *buf);
+
+    /** Hand a buffer kept by holdDmaBuf back to the driver.
+        m_dmaMutex must be held. */
+    void requeueDmaBuf(uint32_t index);
+
+    /** State of a V4L2 buffer for DMABUF export */
+    struct DmaBuffer
+    {
+        int             fd;         ///< DMABUF file descriptor or -1 if not exported yet
+        uint32_t        bytes;      ///< number of valid bytes
+        uint32_t        length;     ///< size of the buffer
+        uint32_t        leases;     ///< number of leases held by the application
+        bool            held;       ///< true if the buffer is not queued in the driver
+        CapFrameInfo    info;       ///< metadata of the frame in the buffer
+    };
+
     int         m_deviceHandle;     ///< V4L2 device handle
     v4l2_format m_fmt;              ///< V4L2 frame format
     bool        m_quitThread;       ///< if true, captureThreadFunction should return
+    int         m_wakeFd;           ///< eventfd signalled by stopCapture to wake the capture thread
     std::thread *m_helperThread;    ///< helper object threading control
+    CaptureReactor *m_reactor;      ///< capture reactor of the context or nullptr
+    PlatformStreamHelper *m_reactorHelper;  ///< V4L2 buffers while capturing on m_reactor, or nullptr
+    DecodePool *m_decodePool;       ///< decode pool of the context or nullptr
+    bool        m_pooledFrames;     ///< true if the capture thread has handed frames to m_decodePool
     MJPEGHelper m_mjpegHelper;      ///< helper to convert MJPEG stream to RGB
+    std::mutex  m_mjpegMutex;       ///< protects m_mjpegHelper
+    SharedMemoryExport *m_shmExport;///< shared memory export or nullptr
+    std::mutex  m_shmMutex;         ///< protects m_shmExport
+
+    std::mutex  m_dmaMutex;         ///< protects the DMABUF export state below
+    bool        m_dmaEnabled;       ///< if true, buffers are kept for DMABUF export
+    int32_t     m_dmaLatest;        ///< index of the buffer with the most recent frame or -1
+    std::vector<DmaBuffer> m_dmaBuffers;    ///< DMABUF state by V4L2 buffer index
+
+    std::atomic<uint32_t>   m_ioMode;       ///< requested CAPIO_xxx mode
+    std::atomic<uint32_t>   m_activeIOMode; ///< CAPIO_xxx mode used by the capture thread
+    std::vector<FrameSlot*> m_userSlots;    ///< slots queued in user pointer mode, by V4L2 buffer index
+    std::atomic<uint32_t>   m_bufferCount;  ///< number of V4L2 buffers to request
+    std::atomic<uint32_t>   m_queuePolicy;  ///< CAPQUEUE_xxx
+    ThreadPolicy            m_threadPolicy; ///< policy of the capture thread
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,211 @@
+/*
+
+    OpenPnp-Capture: a video capture subsystem.
+
+    Linux platform code, export of frames to POSIX shared memory
+
+    Copyright (c) 2017 Jason von Nieda, Niels Moseley.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+*/
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <errno.h>
+#include "shmexport.h"
+#include "../common/framering.h"
+#include "../common/logging.h"
+
+// the header and the slots start on a page boundary,
+// the frame data on a cache line boundary.
+static const size_t c_pageBytes = 4096;
+static const uint32_t c_slotDataOffset = 64;
+
+static size_t roundUp(size_t value, size_t multiple)
+{
+    return ((value + multiple - 1) / multiple) * multiple;
+}
+
+SharedMemoryExport::SharedMemoryExport() :
+    m_fd(-1),
+    m_mapBytes(0),
+    m_header(nullptr),
+    m_writeSlot(nullptr),
+    m_writeSequence(0)
+{
+}
+
+SharedMemoryExport::~SharedMemoryExport()
+{
+    close();
+}
+
+bool SharedMemoryExport::create(const char *name, uint32_t slots, size_t maxFrameBytes)
+{
+    close();
+
+    const size_t slotBytes = roundUp(c_slotDataOffset + maxFrameBytes, c_pageBytes);
+    const size_t headerBytes = roundUp(sizeof(CapShmHeader), c_pageBytes);
+    if ((slots < 2) || (maxFrameBytes == 0) || (slotBytes > 0xFFFFFFFF))
+    {
+        LOG(LOG_ERR, "SharedMemoryExport: invalid size (%d slots of %d bytes)\n", slots, maxFrameBytes);
+        return false;
+    }
+
+    // replace a stale object left by a producer that crashed
+    shm_unlink(name);
+    m_fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (m_fd < 0)
+    {
+        LOG(LOG_ERR, "SharedMemoryExport: shm_open(%s) failed (errno %d)\n", name, errno);
+        return false;
+    }
+    m_name = name;
+
+    m_mapBytes = headerBytes + slots*slotBytes;
+    if (ftruncate(m_fd, m_mapBytes) != 0)
+    {
+        LOG(LOG_ERR, "SharedMemoryExport: could not allocate %d bytes (errno %d)\n", m_mapBytes, errno);
+        close();
+        return false;
+    }
+
+    void *ptr = mmap(nullptr, m_mapBytes, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    if (ptr == MAP_FAILED)
+    {
+        LOG(LOG_ERR, "SharedMemoryExport: mmap failed (errno %d)\n", errno);
+        close();
+        return false;
+    }
+
+    // the object is zero-filled by ftruncate, so all
+    // slots start out empty with an even generation.
+    m_header = static_cast<CapShmHeader*>(ptr);
+    m_header->version        = CAPSHM_VERSION;
+    m_header->headerBytes    = headerBytes;
+    m_header->slotCount      = slots;
+    m_header->slotBytes      = slotBytes;
+    m_header->slotDataOffset = c_slotDataOffset;
+    m_header->maxFrameBytes  = maxFrameBytes;
+    m_header->producerPid    = getpid();
+
+    // readers check the magic number last
+    __atomic_store_n(&m_header->magic, CAPSHM_MAGIC, __ATOMIC_RELEASE);
+
+    LOG(LOG_INFO, "SharedMemoryExport: exporting %d slots of %d bytes as %s\n",
+        slots, maxFrameBytes, name);
+    return true;
+}
+
+void SharedMemoryExport::close()
+{
+    if (m_header != nullptr)
+    {
+        __atomic_store_n(&m_header->closed, 1, __ATOMIC_SEQ_CST);
+        syscall(SYS_futex, &m_header->latest, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+        munmap(m_header, m_mapBytes);
+        m_header = nullptr;
+    }
+
+    if (m_fd >= 0)
+    {
+        ::close(m_fd);
+        shm_unlink(m_name.c_str());
+        m_fd = -1;
+    }
+
+    m_mapBytes = 0;
+    m_writeSlot = nullptr;
+}
+
+CapShmSlotHeader* SharedMemoryExport::getSlot(uint32_t index) const
+{
+    uint8_t *base = reinterpret_cast<uint8_t*>(m_header);
+    return reinterpret_cast<CapShmSlotHeader*>(base + m_header->headerBytes +
+        static_cast<size_t>(index)*m_header->slotBytes);
+}
+
+uint8_t* SharedMemoryExport::beginWrite(uint32_t sequence)
+{
+    if (m_header == nullptr)
+    {
+        return nullptr;
+    }
+
+    m_writeSequence = sequence;
+    m_writeSlot = getSlot(sequence % m_header->slotCount);
+
+    // an odd generation tells readers the slot is changing.
+    // The fence keeps the frame data writes after it.
+    const uint32_t generation = __atomic_load_n(&m_writeSlot->generation, __ATOMIC_RELAXED);
+    __atomic_store_n(&m_writeSlot->generation, generation | 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    return reinterpret_cast<uint8_t*>(m_writeSlot) + m_header->slotDataOffset;
+}
+
+void SharedMemoryExport::endWrite(const FrameSlot *slot)
+{
+    if (m_writeSlot == nullptr)
+    {
+        return;
+    }
+
+    m_writeSlot->sequence          = m_writeSequence;
+    m_writeSlot->captureTimestamp  = slot->m_info.captureTimestamp;
+    m_writeSlot->deliveryTimestamp = slot->m_info.deliveryTimestamp;
+    m_writeSlot->width             = slot->m_width;
+    m_writeSlot->height            = slot->m_height;
+    m_writeSlot->stride            = slot->m_stride;
+    m_writeSlot->format            = slot->m_format;
+    m_writeSlot->bytes             = (slot->m_bytes < m_header->maxFrameBytes) ?
+        slot->m_bytes : m_header->maxFrameBytes;
+
+    const uint32_t generation = __atomic_load_n(&m_writeSlot->generation, __ATOMIC_RELAXED);
+    __atomic_store_n(&m_writeSlot->generation, generation + 1, __ATOMIC_RELEASE);
+    m_writeSlot = nullptr;
+
+    // ring the doorbell. A reader increments 'waiters' before
+    // it checks 'latest' and goes to sleep, so either it sees
+    // the new frame or we see the reader.
+    __atomic_store_n(&m_header->latest, m_writeSequence, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&m_header->waiters, __ATOMIC_SEQ_CST) != 0)
+    {
+        syscall(SYS_futex, &m_header->latest, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+    }
+}
+
+void SharedMemoryExport::cancelWrite()
+{
+    if (m_writeSlot == nullptr)
+    {
+        return;
+    }
+
+    m_writeSlot->sequence = 0;
+    const uint32_t generation = __atomic_load_n(&m_writeSlot->generation, __ATOMIC_RELAXED);
+    __atomic_store_n(&m_writeSlot->generation, generation + 1, __ATOMIC_RELEASE);
+    m_writeSlot = nullptr;
+}
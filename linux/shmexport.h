@@ -0,0 +1,90 @@
+/*
+
+    OpenPnp-Capture: a video capture subsystem.
+
+    Linux platform code, export of frames to POSIX shared memory
+
+    Copyright (c) 2017 Jason von Nieda, Niels Moseley.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+*/
+
+#ifndef linux_shmexport_h
+#define linux_shmexport_h
+
+#include <stdint.h>
+#include <stdlib.h> // size_t
+#include <string>
+#include "openpnp-capture-shm.h"
+
+struct FrameSlot;   // pre-declaration
+
+/** Producer side of a shared memory frame ring,
+    see openpnp-capture-shm.h for the layout.
+    Only one thread may write frames. */
+class SharedMemoryExport
+{
+public:
+    SharedMemoryExport();
+    virtual ~SharedMemoryExport();
+
+    /** Create the shared memory object 'name' with 'slots' slots
+        of 'maxFrameBytes' bytes. An existing object with the same
+        name is replaced. Returns false if this fails. */
+    bool create(const char *name, uint32_t slots, size_t maxFrameBytes);
+
+    /** Tell the readers the export has stopped and remove
+        the shared memory object. Readers that are attached
+        keep their mapping. */
+    void close();
+
+    /** Get the buffer for the frame with a given sequence number and
+        mark its slot as being written. The buffer can hold
+        getMaxFrameBytes() bytes. Call endWrite or cancelWrite when
+        the frame data is complete. */
+    uint8_t* beginWrite(uint32_t sequence);
+
+    /** Publish the frame started by beginWrite, with the
+        geometry and metadata of a frame slot */
+    void endWrite(const FrameSlot *slot);
+
+    /** Give up on the frame started by beginWrite.
+        The slot does not hold a valid frame anymore. */
+    void cancelWrite();
+
+    /** Return the maximum number of frame data bytes per slot */
+    size_t getMaxFrameBytes() const
+    {
+        return (m_header != nullptr) ? m_header->maxFrameBytes : 0;
+    }
+
+protected:
+    /** Return the header of a slot */
+    CapShmSlotHeader* getSlot(uint32_t index) const;
+
+    std::string     m_name;         ///< name of the shared memory object
+    int             m_fd;           ///< shared memory file descriptor or -1
+    size_t          m_mapBytes;     ///< size of the mapping
+    CapShmHeader*   m_header;       ///< start of the mapping or nullptr
+    CapShmSlotHeader* m_writeSlot;  ///< slot being written, see beginWrite
+    uint32_t        m_writeSequence;///< sequence number of the frame being written
+};
+
+#endif
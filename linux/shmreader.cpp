@@ -0,0 +1,230 @@
+/*
+
+    OpenPnp-Capture: a video capture subsystem.
+
+    Reader of frames exported to POSIX shared memory,
+    built as the stand-alone openpnp-capture-shm library.
+
+    Copyright (c) 2017 Jason von Nieda, Niels Moseley.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+*/
+
+#define BUILD_OPENPNP_LIBRARY
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
+#include "openpnp-capture-shm.h"
+
+struct CapShmReader
+{
+    int             fd;         ///< shared memory file descriptor
+    size_t          mapBytes;   ///< size of the mapping
+    CapShmHeader*   header;     ///< start of the mapping
+};
+
+static const CapShmSlotHeader* getSlot(const CapShmReader *reader, uint32_t index)
+{
+    const uint8_t *base = reinterpret_cast<const uint8_t*>(reader->header);
+    return reinterpret_cast<const CapShmSlotHeader*>(base + reader->header->headerBytes +
+        static_cast<size_t>(index)*reader->header->slotBytes);
+}
+
+/** Read the metadata of the frame with a given sequence number.
+    Returns false if the slot does not hold it (anymore). */
+static bool readFrame(const CapShmReader *reader, uint32_t sequence, CapShmFrame *frame)
+{
+    const uint32_t index = sequence % reader->header->slotCount;
+    const CapShmSlotHeader *slot = getSlot(reader, index);
+
+    const uint32_t generation = __atomic_load_n(&slot->generation, __ATOMIC_ACQUIRE);
+    if (generation & 1)
+    {
+        return false;
+    }
+
+    frame->sequence          = slot->sequence;
+    frame->captureTimestamp  = slot->captureTimestamp;
+    frame->deliveryTimestamp = slot->deliveryTimestamp;
+    frame->width             = slot->width;
+    frame->height            = slot->height;
+    frame->stride            = slot->stride;
+    frame->format            = slot->format;
+    frame->bytes             = slot->bytes;
+    frame->data              = reinterpret_cast<const uint8_t*>(slot) + reader->header->slotDataOffset;
+    frame->slot              = index;
+    frame->generation        = generation;
+
+    // the metadata reads must complete before
+    // the generation is checked again
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&slot->generation, __ATOMIC_RELAXED) != generation)
+    {
+        return false;
+    }
+
+    return (frame->sequence == sequence) && (frame->bytes <= reader->header->maxFrameBytes);
+}
+
+static uint64_t getTimeMs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec)*1000 + ts.tv_nsec/1000000;
+}
+
+DLLPUBLIC CapShmReader* CapShm_open(const char *name)
+{
+    if (name == nullptr)
+    {
+        return nullptr;
+    }
+
+    // the reader writes to the 'waiters' word in the header
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0)
+    {
+        return nullptr;
+    }
+
+    struct stat st;
+    if ((fstat(fd, &st) != 0) || (static_cast<size_t>(st.st_size) < sizeof(CapShmHeader)))
+    {
+        ::close(fd);
+        return nullptr;
+    }
+
+    const size_t mapBytes = st.st_size;
+    void *ptr = mmap(nullptr, mapBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (ptr == MAP_FAILED)
+    {
+        ::close(fd);
+        return nullptr;
+    }
+
+    CapShmHeader *header = static_cast<CapShmHeader*>(ptr);
+    const uint64_t slotsEnd = static_cast<uint64_t>(header->headerBytes) +
+        static_cast<uint64_t>(header->slotCount)*header->slotBytes;
+    if ((__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != CAPSHM_MAGIC) ||
+        (header->version != CAPSHM_VERSION) || (header->slotCount == 0) ||
+        (header->slotDataOffset < sizeof(CapShmSlotHeader)) ||
+        ((header->slotDataOffset + static_cast<uint64_t>(header->maxFrameBytes)) > header->slotBytes) ||
+        (slotsEnd > mapBytes))
+    {
+        munmap(ptr, mapBytes);
+        ::close(fd);
+        return nullptr;
+    }
+
+    CapShmReader *reader = new CapShmReader();
+    reader->fd = fd;
+    reader->mapBytes = mapBytes;
+    reader->header = header;
+    return reader;
+}
+
+DLLPUBLIC void CapShm_close(CapShmReader *reader)
+{
+    if (reader == nullptr)
+    {
+        return;
+    }
+
+    munmap(reader->header, reader->mapBytes);
+    ::close(reader->fd);
+    delete reader;
+}
+
+DLLPUBLIC CapResult CapShm_waitFrame(CapShmReader *reader, uint32_t lastSequence,
+    uint32_t timeoutMs, CapShmFrame *frame)
+{
+    if ((reader == nullptr) || (frame == nullptr))
+    {
+        return CAPRESULT_ERR;
+    }
+
+    CapShmHeader *header = reader->header;
+    const uint64_t deadline = getTimeMs() + timeoutMs;
+    while(true)
+    {
+        if (__atomic_load_n(&header->closed, __ATOMIC_ACQUIRE) != 0)
+        {
+            return CAPRESULT_ERR;
+        }
+
+        // a frame that is overwritten while we read its
+        // metadata has been replaced by a newer one: retry.
+        const uint32_t latest = __atomic_load_n(&header->latest, __ATOMIC_ACQUIRE);
+        if ((latest != 0) && (latest != lastSequence))
+        {
+            if (readFrame(reader, latest, frame))
+            {
+                return CAPRESULT_OK;
+            }
+            continue;
+        }
+
+        const uint64_t now = getTimeMs();
+        if (now >= deadline)
+        {
+            // tell a stalled producer from one that is gone
+            if ((kill(header->producerPid, 0) != 0) && (errno == ESRCH))
+            {
+                return CAPRESULT_ERR;
+            }
+            return CAPRESULT_TIMEOUT;
+        }
+
+        const uint64_t remaining = deadline - now;
+        struct timespec timeout;
+        timeout.tv_sec  = remaining / 1000;
+        timeout.tv_nsec = (remaining % 1000) * 1000000;
+
+        // sleep until 'latest' changes. The producer only rings
+        // the doorbell when it sees a waiter, see SharedMemoryExport.
+        __atomic_fetch_add(&header->waiters, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&header->latest, __ATOMIC_SEQ_CST) == latest)
+        {
+            syscall(SYS_futex, &header->latest, FUTEX_WAIT, latest, &timeout, nullptr, 0);
+        }
+        __atomic_fetch_sub(&header->waiters, 1, __ATOMIC_SEQ_CST);
+    }
+}
+
+DLLPUBLIC uint32_t CapShm_isFrameValid(CapShmReader *reader, const CapShmFrame *frame)
+{
+    if ((reader == nullptr) || (frame == nullptr) || (frame->slot >= reader->header->slotCount))
+    {
+        return 0;
+    }
+
+    // the frame data reads must complete before
+    // the generation is checked
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    const CapShmSlotHeader *slot = getSlot(reader, frame->slot);
+    return (__atomic_load_n(&slot->generation, __ATOMIC_RELAXED) == frame->generation) ? 1 : 0;
+}
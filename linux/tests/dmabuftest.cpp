@@ -0,0 +1,260 @@
+/*
+
+    openpnp capture DMABUF export test
+
+    Exports the camera buffers of a stream as DMABUFs and
+    checks them against the frames the library publishes.
+    Needs a camera that supports VIDIOC_EXPBUF, e.g. the
+    vivid test driver:
+
+        modprobe vivid
+        openpnp-capture-dmabuftest [device ID] [format ID]
+
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/dma-buf.h>
+#include <vector>
+#include <set>
+
+#include "openpnp-capture.h"
+
+static const uint32_t c_buffers = 4;        // driver buffers, see Cap_setCaptureQueue
+static const uint32_t c_timeout = 2000;     // milliseconds to wait for a frame
+static const uint32_t c_compares = 10;      // frames to compare byte for byte
+
+static uint32_t g_failures = 0;
+
+#define CHECK(x) checkResult((x), #x, __LINE__)
+
+static void checkResult(bool ok, const char *what, int line)
+{
+    if (!ok)
+    {
+        fprintf(stderr, "FAILED (line %d): %s\n", line, what);
+        g_failures++;
+    }
+}
+
+/** Wait until a buffer newer than frame 'sequence' is
+    exported and lease it. Returns false on a timeout. */
+static bool acquireNewer(CapContext ctx, CapStream stream, uint32_t sequence, CapDmaBufLease *lease)
+{
+    for(uint32_t i=0; i<10; i++)
+    {
+        if (Cap_acquireDmaBuf(ctx, stream, lease) == CAPRESULT_OK)
+        {
+            if (lease->info.sequence > sequence)
+            {
+                return true;
+            }
+            Cap_releaseDmaBuf(ctx, stream, lease);
+        }
+        Cap_waitForNewFrame(ctx, stream, c_timeout/10);
+    }
+    return false;
+}
+
+/** Compare the contents of a leased DMABUF with a frame */
+static bool compareLease(const CapDmaBufLease &lease, const uint8_t *frame, uint32_t bytes)
+{
+    if ((lease.bytes != bytes) || (lease.bytes > lease.length))
+    {
+        fprintf(stderr, "DMABUF holds %d bytes, the frame %d bytes\n", lease.bytes, bytes);
+        return false;
+    }
+
+    void *map = mmap(nullptr, lease.length, PROT_READ, MAP_SHARED, lease.fd, 0);
+    if (map == MAP_FAILED)
+    {
+        fprintf(stderr, "Could not mmap the DMABUF (errno %d)\n", errno);
+        return false;
+    }
+
+    // let the exporter make the buffer coherent for the CPU
+    struct dma_buf_sync sync;
+    sync.flags = DMA_BUF_SYNC_START | DMA_BUF_SYNC_READ;
+    ioctl(lease.fd, DMA_BUF_IOCTL_SYNC, &sync);
+
+    const bool same = (memcmp(map, frame, bytes) == 0);
+
+    sync.flags = DMA_BUF_SYNC_END | DMA_BUF_SYNC_READ;
+    ioctl(lease.fd, DMA_BUF_IOCTL_SYNC, &sync);
+
+    munmap(map, lease.length);
+    return same;
+}
+
+/** Return the inode of the file an fd refers to, or 0 if the fd is closed */
+static ino_t getInode(int fd)
+{
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        return 0;
+    }
+    return st.st_ino;
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t deviceID       = 0;
+    uint32_t deviceFormatID = 0;
+
+    printf("OpenPNP Capture DMABUF test\n");
+    printf("%s\n", Cap_getLibraryVersion());
+
+    if (argc >= 2)
+    {
+        deviceID = atoi(argv[1]);
+    }
+
+    if (argc >= 3)
+    {
+        deviceFormatID = atoi(argv[2]);
+    }
+
+    CapContext ctx = Cap_createContext();
+    CapStream stream = Cap_openStream(ctx, deviceID, deviceFormatID);
+    if (Cap_isOpenStream(ctx, stream) != 1)
+    {
+        fprintf(stderr, "Could not open device %d, format %d\n", deviceID, deviceFormatID);
+        Cap_releaseContext(ctx);
+        return 1;
+    }
+
+    // a fixed number of driver buffers, so the number
+    // of buffers that can be leased is known
+    CHECK(Cap_setCaptureQueue(ctx, stream, c_buffers, CAPQUEUE_ALL) == CAPRESULT_OK);
+    CHECK(Cap_setOutputFormat(ctx, stream, CAPFORMAT_NATIVE) == CAPRESULT_OK);
+    CHECK(Cap_setDmaBufExport(ctx, stream, 1) == CAPRESULT_OK);
+
+    CapDmaBufLease lease;
+    if (!acquireNewer(ctx, stream, 0, &lease))
+    {
+        fprintf(stderr, "No buffer was exported, does the driver support VIDIOC_EXPBUF?\n");
+        Cap_closeStream(ctx, stream);
+        Cap_releaseContext(ctx);
+        return 1;
+    }
+    Cap_releaseDmaBuf(ctx, stream, &lease);
+
+    // the DMABUF holds the same bytes as the frame that
+    // was published from it. A new frame can be published
+    // between the two calls, so only frames with the same
+    // sequence number are compared.
+    printf("Comparing frames ...\n");
+    std::vector<uint8_t> frame(Cap_getOutputFrameBytes(ctx, stream));
+    uint32_t compared = 0;
+    uint32_t sequence = 0;
+    for(uint32_t tries=0; (compared < c_compares) && (tries < 10*c_compares); tries++)
+    {
+        if (!acquireNewer(ctx, stream, sequence, &lease))
+        {
+            break;
+        }
+        sequence = lease.info.sequence;
+
+        CapFrameInfo info;
+        if ((Cap_captureFrameEx(ctx, stream, &frame[0], frame.size(), &info) == CAPRESULT_OK) &&
+            (info.sequence == lease.info.sequence))
+        {
+            CHECK(info.format == CAPFORMAT_NATIVE);
+            CHECK(compareLease(lease, &frame[0], info.bytes));
+            compared++;
+        }
+        CHECK(Cap_releaseDmaBuf(ctx, stream, &lease) == CAPRESULT_OK);
+    }
+    printf("  %d frame(s) compared\n", compared);
+    CHECK(compared != 0);
+
+    // a lease can only be returned once
+    CHECK(Cap_releaseDmaBuf(ctx, stream, &lease) == CAPRESULT_ERR);
+
+    // hold on to every buffer that is exported: the driver
+    // keeps at least two, so capturing goes on but the
+    // export stops once the application holds too many.
+    printf("Holding buffers ...\n");
+    std::vector<CapDmaBufLease> leases;
+    std::set<uint32_t> buffers;
+    sequence = 0;
+    for(uint32_t i=0; i<c_buffers; i++)
+    {
+        if (!acquireNewer(ctx, stream, sequence, &lease))
+        {
+            break;
+        }
+        sequence = lease.info.sequence;
+        leases.push_back(lease);
+        buffers.insert(lease.buffer);
+    }
+    printf("  %d buffer(s) leased\n", static_cast<uint32_t>(buffers.size()));
+    CHECK(buffers.size() == leases.size());
+    CHECK(buffers.size() >= 2);
+    CHECK(buffers.size() <= c_buffers - 2);
+
+    const uint32_t frames = Cap_getStreamFrameCount(ctx, stream);
+    for(uint32_t i=0; i<5; i++)
+    {
+        Cap_waitForNewFrame(ctx, stream, c_timeout);
+    }
+    CHECK(Cap_getStreamFrameCount(ctx, stream) > frames);
+
+    // releasing a buffer that is no longer the newest hands
+    // it back to the driver, so the export goes on.
+    printf("Releasing buffers ...\n");
+    if (leases.size() >= 2)
+    {
+        CHECK(leases.front().info.sequence < leases.back().info.sequence);
+        CHECK(Cap_releaseDmaBuf(ctx, stream, &leases.front()) == CAPRESULT_OK);
+        CHECK(acquireNewer(ctx, stream, leases.back().info.sequence, &lease));
+        CHECK(lease.buffer != leases.back().buffer);
+        CHECK(Cap_releaseDmaBuf(ctx, stream, &lease) == CAPRESULT_OK);
+        leases.erase(leases.begin());
+    }
+
+    for(uint32_t i=0; i<leases.size(); i++)
+    {
+        CHECK(Cap_releaseDmaBuf(ctx, stream, &leases[i]) == CAPRESULT_OK);
+    }
+
+    // restarting the capture closes the exported file
+    // descriptors; a dup() keeps the buffer alive.
+    printf("Restarting ...\n");
+    CHECK(acquireNewer(ctx, stream, 0, &lease));
+    const int fd = lease.fd;
+    const int copy = dup(fd);
+    const ino_t inode = getInode(copy);
+    CHECK(inode != 0);
+    CHECK(Cap_releaseDmaBuf(ctx, stream, &lease) == CAPRESULT_OK);
+
+    CHECK(Cap_setCaptureQueue(ctx, stream, c_buffers + 1, CAPQUEUE_ALL) == CAPRESULT_OK);
+
+    // the fd number can be re-used by a new export,
+    // but not for the buffer that was closed.
+    CHECK(getInode(fd) != inode);
+    CHECK(getInode(copy) == inode);
+    close(copy);
+
+    CHECK(acquireNewer(ctx, stream, 0, &lease));
+    CHECK(Cap_releaseDmaBuf(ctx, stream, &lease) == CAPRESULT_OK);
+
+    Cap_closeStream(ctx, stream);
+    Cap_releaseContext(ctx);
+
+    if (g_failures != 0)
+    {
+        printf("%d check(s) failed\n", g_failures);
+        return 1;
+    }
+
+    printf("All checks passed\n");
+    return 0;
+}
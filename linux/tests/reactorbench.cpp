@@ -0,0 +1,220 @@
+/*
+
+    openpnp capture reactor benchmark
+
+    Opens all cameras, once with a capture thread per
+    stream and once with shared reactor threads, and
+    compares the frame rate, CPU time, context switches
+    and thread count of the two. With decode threads,
+    a third run decodes on them instead, see 
+    Cap_setDecodeThreads.
+
+    usage: openpnp-capture-reactorbench [seconds] [reactor threads] [format ID] [decode threads]
+
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <vector>
+#include <chrono>
+
+#include "openpnp-capture.h"
+
+struct Measurement
+{
+    double   seconds;           // wall clock time
+    double   cpuSeconds;        // user + system time of the process
+    long     contextSwitches;   // voluntary + involuntary
+    uint32_t threads;           // threads of the process while capturing
+    uint32_t frames;            // frames captured by all streams
+    uint32_t dropped;           // frames dropped by the driver or the library
+    uint64_t pipelineDelay;     // average time frames waited in the decode threads, in microseconds
+};
+
+static uint32_t getThreadCount()
+{
+    uint32_t threads = 0;
+    FILE *fin = fopen("/proc/self/status", "r");
+    if (fin == nullptr)
+    {
+        return 0;
+    }
+
+    char line[256];
+    while(fgets(line, sizeof(line), fin) != nullptr)
+    {
+        if (strncmp(line, "Threads:", 8) == 0)
+        {
+            threads = atoi(line + 8);
+            break;
+        }
+    }
+    fclose(fin);
+    return threads;
+}
+
+static double getSeconds(const timeval &tv)
+{
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static bool runBenchmark(uint32_t reactorThreads, uint32_t decodeThreads, uint32_t seconds, 
+    uint32_t formatID, Measurement &m)
+{
+    CapContext ctx = Cap_createContext();
+    if (Cap_setReactorThreads(ctx, reactorThreads) != CAPRESULT_OK)
+    {
+        fprintf(stderr, "Cap_setReactorThreads(%d) failed\n", reactorThreads);
+        Cap_releaseContext(ctx);
+        return false;
+    }
+
+    if (Cap_setDecodeThreads(ctx, decodeThreads) != CAPRESULT_OK)
+    {
+        fprintf(stderr, "Cap_setDecodeThreads(%d) failed\n", decodeThreads);
+        Cap_releaseContext(ctx);
+        return false;
+    }
+
+    std::vector<CapStream> streams;
+    const uint32_t deviceCount = Cap_getDeviceCount(ctx);
+    for(uint32_t i=0; i<deviceCount; i++)
+    {
+        CapStream stream = Cap_openStream(ctx, i, formatID);
+        if (stream >= 0)
+        {
+            streams.push_back(stream);
+        }
+    }
+
+    if (streams.empty())
+    {
+        fprintf(stderr, "No camera could be opened with format %d\n", formatID);
+        Cap_releaseContext(ctx);
+        return false;
+    }
+
+    // let the cameras settle
+    usleep(1000000);
+
+    std::vector<uint32_t> startFrames;
+    for(uint32_t i=0; i<streams.size(); i++)
+    {
+        startFrames.push_back(Cap_getStreamFrameCount(ctx, streams[i]));
+        Cap_resetLatencyStats(ctx, streams[i]);
+    }
+
+    rusage start, end;
+    getrusage(RUSAGE_SELF, &start);
+    auto tstart = std::chrono::steady_clock::now();
+
+    usleep(seconds * 1000000);
+
+    auto tend = std::chrono::steady_clock::now();
+    getrusage(RUSAGE_SELF, &end);
+    m.threads = getThreadCount();
+
+    m.frames = 0;
+    m.dropped = 0;
+    m.pipelineDelay = 0;
+    for(uint32_t i=0; i<streams.size(); i++)
+    {
+        m.frames += Cap_getStreamFrameCount(ctx, streams[i]) - startFrames[i];
+
+        CapLatencyStats stats;
+        if (Cap_getLatencyStats(ctx, streams[i], &stats) == CAPRESULT_OK)
+        {
+            m.pipelineDelay += stats.averagePipelineDelay / streams.size();
+        }
+
+        CapFrameLease lease;
+        if (Cap_acquireFrame(ctx, streams[i], &lease) == CAPRESULT_OK)
+        {
+            m.dropped += lease.info.deviceDropped + lease.info.libraryDropped;
+            Cap_releaseFrame(ctx, streams[i], &lease);
+        }
+    }
+
+    m.seconds = std::chrono::duration<double>(tend - tstart).count();
+    m.cpuSeconds = getSeconds(end.ru_utime) + getSeconds(end.ru_stime)
+        - getSeconds(start.ru_utime) - getSeconds(start.ru_stime);
+    m.contextSwitches = (end.ru_nvcsw + end.ru_nivcsw) - (start.ru_nvcsw + start.ru_nivcsw);
+
+    printf("%s%s: %d camera(s)\n", (reactorThreads == 0) ? "thread per stream" : "reactor",
+        (decodeThreads == 0) ? "" : " + decode threads", static_cast<uint32_t>(streams.size()));
+
+    Cap_releaseContext(ctx);
+    return true;
+}
+
+static void printMeasurement(const char *name, const Measurement &m)
+{
+    printf("%-20s %8d %10.1f %10.1f %12.0f %10d %10.1f\n", name, m.threads,
+        m.frames / m.seconds, 100.0 * m.cpuSeconds / m.seconds,
+        m.contextSwitches / m.seconds, m.dropped, m.pipelineDelay / 1000.0);
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t seconds = 10;
+    uint32_t reactorThreads = 1;
+    uint32_t formatID = 0;
+    uint32_t decodeThreads = 0;
+
+    if (argc >= 2)
+    {
+        seconds = atoi(argv[1]);
+    }
+
+    if (argc >= 3)
+    {
+        reactorThreads = atoi(argv[2]);
+    }
+
+    if (argc >= 4)
+    {
+        formatID = atoi(argv[3]);
+    }
+
+    if (argc >= 5)
+    {
+        decodeThreads = atoi(argv[4]);
+    }
+
+    printf("OpenPNP Capture reactor benchmark\n");
+    printf("%s\n", Cap_getLibraryVersion());
+
+    Cap_setLogLevel(3);
+
+    if (reactorThreads == 0)
+    {
+        fprintf(stderr, "The number of reactor threads must be at least 1\n");
+        return 1;
+    }
+
+    Measurement threaded, reactor, decoded;
+    if (!runBenchmark(0, 0, seconds, formatID, threaded) ||
+        !runBenchmark(reactorThreads, 0, seconds, formatID, reactor))
+    {
+        return 1;
+    }
+
+    if ((decodeThreads != 0) && 
+        !runBenchmark(reactorThreads, decodeThreads, seconds, formatID, decoded))
+    {
+        return 1;
+    }
+
+    printf("\n%-20s %8s %10s %10s %12s %10s %10s\n", "mode", "threads", "frames/s", "CPU %", 
+        "switches/s", "dropped", "delay ms");
+    printMeasurement("thread per stream", threaded);
+    printMeasurement("reactor", reactor);
+    if (decodeThreads != 0)
+    {
+        printMeasurement("decode threads", decoded);
+    }
+    return 0;
+}
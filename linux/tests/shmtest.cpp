@@ -0,0 +1,199 @@
+/*
+
+    openpnp capture shared memory export test
+
+    Drives the producer side of the shared memory frame
+    ring (SharedMemoryExport) with synthetic frames and
+    reads them back through the openpnp-capture-shm reader
+    library. No camera is needed.
+
+    usage: openpnp-capture-shmtest
+
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <thread>
+#include <chrono>
+
+#include "openpnp-capture.h"
+#include "openpnp-capture-shm.h"
+#include "../shmexport.h"
+#include "../../common/framering.h"
+
+static const char *c_name = "/openpnp-capture-shmtest";
+static const uint32_t c_slots = 3;
+static const uint32_t c_width = 32;
+static const uint32_t c_height = 8;
+static const uint32_t c_frameBytes = c_width*c_height*3;
+
+static uint32_t g_failures = 0;
+
+#define CHECK(x) checkResult((x), #x, __LINE__)
+
+static void checkResult(bool ok, const char *what, int line)
+{
+    if (!ok)
+    {
+        fprintf(stderr, "FAILED (line %d): %s\n", line, what);
+        g_failures++;
+    }
+}
+
+static double getMilliseconds(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+/** Write a frame filled with the low byte of its sequence number */
+static void writeFrame(SharedMemoryExport &shm, uint32_t sequence)
+{
+    FrameSlot slot;
+    slot.m_width  = c_width;
+    slot.m_height = c_height;
+    slot.m_stride = c_width*3;
+    slot.m_format = CAPFORMAT_RGB24;
+    slot.m_bytes  = c_frameBytes;
+    slot.m_info.captureTimestamp  = 1000ULL*sequence;
+    slot.m_info.deliveryTimestamp = 1000ULL*sequence + 1;
+
+    uint8_t *data = shm.beginWrite(sequence);
+    CHECK(data != nullptr);
+    if (data != nullptr)
+    {
+        memset(data, sequence & 0xFF, c_frameBytes);
+        shm.endWrite(&slot);
+    }
+}
+
+/** Returns true if a frame holds what writeFrame wrote */
+static bool checkFrame(const CapShmFrame &frame, uint32_t sequence)
+{
+    if ((frame.sequence != sequence) || (frame.bytes != c_frameBytes) ||
+        (frame.width != c_width) || (frame.height != c_height) ||
+        (frame.stride != c_width*3) || (frame.format != CAPFORMAT_RGB24) ||
+        (frame.captureTimestamp != 1000ULL*sequence) || (frame.slot != sequence % c_slots))
+    {
+        return false;
+    }
+
+    for(uint32_t i=0; i<frame.bytes; i++)
+    {
+        if (frame.data[i] != (sequence & 0xFF))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main()
+{
+    printf("OpenPNP Capture shared memory test\n");
+
+    SharedMemoryExport shm;
+    if (!shm.create(c_name, c_slots, c_frameBytes))
+    {
+        fprintf(stderr, "Could not create %s\n", c_name);
+        return 1;
+    }
+
+    CapShmReader *reader = CapShm_open(c_name);
+    if (reader == nullptr)
+    {
+        fprintf(stderr, "Could not open %s\n", c_name);
+        return 1;
+    }
+
+    // no frame yet: the wait times out
+    printf("Timeout ...\n");
+    CapShmFrame frame;
+    auto start = std::chrono::steady_clock::now();
+    CHECK(CapShm_waitFrame(reader, 0, 50, &frame) == CAPRESULT_TIMEOUT);
+    CHECK(getMilliseconds(start) >= 45.0);
+
+    // every frame is read back, also when the
+    // sequence numbers wrap around the slots
+    printf("Wrap-around ...\n");
+    uint32_t last = 0;
+    for(uint32_t sequence=1; sequence<=4*c_slots+1; sequence++)
+    {
+        writeFrame(shm, sequence);
+        CHECK(CapShm_waitFrame(reader, last, 100, &frame) == CAPRESULT_OK);
+        CHECK(checkFrame(frame, sequence));
+        CHECK(CapShm_isFrameValid(reader, &frame) == 1);
+        last = frame.sequence;
+    }
+
+    // a frame that was already read: the wait times out
+    CHECK(CapShm_waitFrame(reader, last, 20, &frame) == CAPRESULT_TIMEOUT);
+
+    // the reader always gets the most recent frame
+    writeFrame(shm, last + 1);
+    writeFrame(shm, last + 2);
+    CHECK(CapShm_waitFrame(reader, last, 100, &frame) == CAPRESULT_OK);
+    CHECK(checkFrame(frame, last + 2));
+    last = frame.sequence;
+
+    // a frame stays valid until its slot is written again
+    printf("Overwrite detection ...\n");
+    for(uint32_t i=1; i<c_slots; i++)
+    {
+        writeFrame(shm, last + i);
+        CHECK(CapShm_isFrameValid(reader, &frame) == 1);
+    }
+    writeFrame(shm, last + c_slots);
+    CHECK(CapShm_isFrameValid(reader, &frame) == 0);
+    last += c_slots;
+
+    // a slot that is being written is not valid
+    CHECK(CapShm_waitFrame(reader, 0, 100, &frame) == CAPRESULT_OK);
+    CHECK(checkFrame(frame, last));
+    CHECK(shm.beginWrite(last + c_slots) != nullptr);
+    CHECK(CapShm_isFrameValid(reader, &frame) == 0);
+    shm.cancelWrite();
+    CHECK(CapShm_isFrameValid(reader, &frame) == 0);
+
+    // a waiting reader is woken by the doorbell
+    printf("Doorbell ...\n");
+    const uint32_t next = last + 1;
+    std::thread producer([&shm, next]
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        writeFrame(shm, next);
+    });
+    start = std::chrono::steady_clock::now();
+    CHECK(CapShm_waitFrame(reader, last, 5000, &frame) == CAPRESULT_OK);
+    CHECK(getMilliseconds(start) < 1000.0);
+    CHECK(checkFrame(frame, next));
+    producer.join();
+    last = next;
+
+    // closing the export wakes a waiting reader
+    printf("Close ...\n");
+    std::thread closer([&shm]
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        shm.close();
+    });
+    start = std::chrono::steady_clock::now();
+    CHECK(CapShm_waitFrame(reader, last, 5000, &frame) == CAPRESULT_ERR);
+    CHECK(getMilliseconds(start) < 1000.0);
+    closer.join();
+    CHECK(CapShm_waitFrame(reader, 0, 0, &frame) == CAPRESULT_ERR);
+
+    CapShm_close(reader);
+
+    // the object is removed when the export is closed
+    CHECK(CapShm_open(c_name) == nullptr);
+
+    if (g_failures != 0)
+    {
+        printf("%d check(s) failed\n", g_failures);
+        return 1;
+    }
+
+    printf("All checks passed\n");
+    return 0;
+}
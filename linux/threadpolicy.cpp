@@ -0,0 +1,121 @@
+/*
+
+    OpenPnp-Capture: a video capture subsystem.
+
+    Linux platform code, scheduling policy and
+    CPU affinity of the library's threads
+
+    Copyright (c) 2017 Jason von Nieda, Niels Moseley.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+*/
+
+#include <sched.h>
+#include <sys/mman.h>
+#include <string.h>
+#include <errno.h>
+#include "threadpolicy.h"
+#include "../common/logging.h"
+
+static int getSchedulerPolicy(uint32_t policy)
+{
+    switch(policy & ~CAPTHREAD_LOCKMEMORY)
+    {
+    case CAPTHREAD_FIFO:
+        return SCHED_FIFO;
+    case CAPTHREAD_RR:
+        return SCHED_RR;
+    default:
+        return SCHED_OTHER;
+    }
+}
+
+bool ThreadPolicy::isValid() const
+{
+    const uint32_t base = policy & ~CAPTHREAD_LOCKMEMORY;
+    if (base > CAPTHREAD_RR)
+    {
+        return false;
+    }
+
+    if (base == CAPTHREAD_NORMAL)
+    {
+        return true;
+    }
+
+    const int sched = getSchedulerPolicy(policy);
+    return (priority >= sched_get_priority_min(sched)) &&
+           (priority <= sched_get_priority_max(sched));
+}
+
+bool ThreadPolicy::apply(pthread_t thread) const
+{
+    bool ok = true;
+
+    sched_param param;
+    memset(&param, 0, sizeof(param));
+    const int sched = getSchedulerPolicy(policy);
+    if (sched != SCHED_OTHER)
+    {
+        param.sched_priority = priority;
+    }
+
+    int err = pthread_setschedparam(thread, sched, &param);
+    if (err != 0)
+    {
+        // real-time scheduling needs CAP_SYS_NICE or an RLIMIT_RTPRIO
+        LOG(LOG_WARNING, "ThreadPolicy: could not set scheduling policy %d, priority %d (errno %d)\n",
+            sched, param.sched_priority, err);
+        ok = false;
+    }
+
+    // only the first 64 CPUs can be selected,
+    // a mask of 0 allows all of them.
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    for(uint32_t i=0; i<CPU_SETSIZE; i++)
+    {
+        if ((cpuMask == 0) || ((i < 64) && ((cpuMask >> i) & 1)))
+        {
+            CPU_SET(i, &cpus);
+        }
+    }
+
+    err = pthread_setaffinity_np(thread, sizeof(cpus), &cpus);
+    if (err != 0)
+    {
+        LOG(LOG_WARNING, "ThreadPolicy: could not set the CPU affinity (errno %d)\n", err);
+        ok = false;
+    }
+
+    // locks all pages of the process, current and future,
+    // so frame buffers never page fault. It is not undone
+    // when the flag is cleared.
+    if ((policy & CAPTHREAD_LOCKMEMORY) != 0)
+    {
+        if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+        {
+            LOG(LOG_WARNING, "ThreadPolicy: could not lock the memory of the process (errno %d)\n", errno);
+            ok = false;
+        }
+    }
+
+    return ok;
+}
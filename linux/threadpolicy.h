@@ -0,0 +1,65 @@
+/*
+
+    OpenPnp-Capture: a video capture subsystem.
+
+    Linux platform code, scheduling policy and
+    CPU affinity of the library's threads
+
+    Copyright (c) 2017 Jason von Nieda, Niels Moseley.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+*/
+
+#ifndef linux_threadpolicy_h
+#define linux_threadpolicy_h
+
+#include <stdint.h>
+#include <pthread.h>
+#include "openpnp-capture.h"
+
+/** Scheduling policy, priority and CPU affinity
+    of a library thread, see Cap_setThreadPolicy */
+struct ThreadPolicy
+{
+    ThreadPolicy() : policy(CAPTHREAD_NORMAL), priority(0), cpuMask(0) {}
+
+    /** Returns true if this is the policy threads are created with,
+        in which case it does not have to be applied */
+    bool isDefault() const
+    {
+        return (policy == CAPTHREAD_NORMAL) && (cpuMask == 0);
+    }
+
+    /** Returns true if the policy can be applied: a known
+        CAPTHREAD_xxx policy and a priority in its range */
+    bool isValid() const;
+
+    /** Apply the policy to a running thread. Every part that
+        fails, typically for lack of privileges, is logged and
+        the rest is still applied. Returns false if any part
+        failed. */
+    bool apply(pthread_t thread) const;
+
+    uint32_t    policy;     ///< CAPTHREAD_xxx, optionally with CAPTHREAD_LOCKMEMORY
+    int32_t     priority;   ///< real-time priority, ignored for CAPTHREAD_NORMAL
+    uint64_t    cpuMask;    ///< CPUs the thread may run on, 0 for all CPUs
+};
+
+#endif
@@ -28,6 +28,8 @@
     
 */
 
+#include <memory.h>
+#include "openpnp-capture.h"
 #include "yuvconverters.h"
 
 static inline uint8_t clamp(int16_t v)
@@ -74,3 +76,274 @@ void YUYV2RGB(const uint8_t *yuv, uint8_t *rgb, uint32_t bytes)
         bytes -= 4;
     }
 }
+
+/*
+    Convert a single YUYV pixel into a packed RGB-like pixel
+    using the same arithmetic as YUYV2RGB. 'rOfs' and 'bOfs' are 
+    the offsets of the red and blue bytes within a pixel of
+    'pixelBytes' bytes. A fourth byte, if any, is set to 255.
+*/
+template<uint32_t rOfs, uint32_t bOfs, uint32_t pixelBytes>
+static inline void YUYVPixelToPacked(int16_t y, int16_t cr, int16_t cb, uint8_t *dst)
+{
+    int16_t yy = 19*(y - 16); 
+    dst[rOfs] = clamp((yy                 + 32*(cb - 128)) >> 4);
+    dst[1]    = clamp((yy - 13*(cr - 128) -  6*(cb - 128)) >> 4);
+    dst[bOfs] = clamp((yy + 26*(cr - 128)                ) >> 4);
+    if (pixelBytes == 4) dst[3] = 255;
+}
+
+/*
+    Convert 'width' pixels of a YUYV row, starting at pixel 'x',
+    into packed pixels. 'x' does not need to be even. When 'step'
+    is larger than one, only every step-th pixel is converted
+    and 'x' is in units of output pixels.
+*/
+template<uint32_t rOfs, uint32_t bOfs, uint32_t pixelBytes>
+static void YUYVRowToPacked(const uint8_t *yuv, uint8_t *dst, uint32_t x, uint32_t width, uint32_t step)
+{
+    if (step != 1)
+    {
+        for(uint32_t i=0; i<width; i++)
+        {
+            const uint32_t px = (x+i)*step;
+            const uint8_t *pair = yuv + (px/2)*4;
+            YUYVPixelToPacked<rOfs, bOfs, pixelBytes>(pair[(px & 1)*2], pair[1], pair[3], dst);
+            dst += pixelBytes;
+        }
+        return;
+    }
+
+    yuv += (x/2)*4;
+    if ((x & 1) && (width != 0))
+    {
+        // second pixel of a YUYV pair
+        YUYVPixelToPacked<rOfs, bOfs, pixelBytes>(yuv[2], yuv[1], yuv[3], dst);
+        dst += pixelBytes;
+        yuv += 4;
+        width--;
+    }
+
+    while(width >= 2)
+    {
+        YUYVPixelToPacked<rOfs, bOfs, pixelBytes>(yuv[0], yuv[1], yuv[3], dst);
+        YUYVPixelToPacked<rOfs, bOfs, pixelBytes>(yuv[2], yuv[1], yuv[3], dst + pixelBytes);
+        dst += 2*pixelBytes;
+        yuv += 4;
+        width -= 2;
+    }
+
+    if (width != 0)
+    {
+        YUYVPixelToPacked<rOfs, bOfs, pixelBytes>(yuv[0], yuv[1], yuv[3], dst);
+    }
+}
+
+template<uint32_t rOfs, uint32_t bOfs, uint32_t pixelBytes>
+static void YUYVToPacked(const uint8_t *yuv, uint32_t yuvStride, uint32_t x, uint32_t width, uint32_t height,
+    uint8_t *dst, uint32_t dstStride, uint32_t step)
+{
+    for(uint32_t y=0; y<height; y++)
+    {
+        YUYVRowToPacked<rOfs, bOfs, pixelBytes>(yuv, dst, x, width, step);
+        yuv += yuvStride*step;
+        dst += dstStride;
+    }
+}
+
+static void YUYVToGray(const uint8_t *yuv, uint32_t yuvStride, uint32_t x, uint32_t width, uint32_t height,
+    uint8_t *dst, uint32_t dstStride, uint32_t step)
+{
+    if (step == 1)
+    {
+        // the luma bytes are copied as they are. Two pixels
+        // per iteration lets the compiler vectorize the loop.
+        for(uint32_t y=0; y<height; y++)
+        {
+            const uint8_t *src = yuv + y*yuvStride + x*2;
+            uint8_t *row = dst + y*dstStride;
+            uint32_t i = 0;
+            for(; (i+1)<width; i+=2)
+            {
+                row[i]   = src[2*i];
+                row[i+1] = src[2*i+2];
+            }
+            if (i < width)
+            {
+                row[i] = src[2*i];
+            }
+        }
+        return;
+    }
+
+    const uint32_t srcStep = 2*step;
+    for(uint32_t y=0; y<height; y++)
+    {
+        const uint8_t *src = yuv + y*step*yuvStride + x*srcStep;
+        uint8_t *row = dst + y*dstStride;
+        for(uint32_t i=0; i<width; i++)
+        {
+            row[i] = src[i*srcStep];
+        }
+    }
+}
+
+/*
+    Convert YUYV to 4:2:0 planar or semi-planar YUV. The chroma
+    of two consecutive rows is averaged. 'uvStep' is 1 for
+    separate U and V planes and 2 for an interleaved UV plane.
+    When 'step' is larger than one, the frame is subsampled and
+    the chroma is taken from the top-left pixel of each block.
+*/
+static void YUYVTo420(const uint8_t *yuv, uint32_t yuvStride, uint32_t width, uint32_t height,
+    uint8_t *yPlane, uint32_t yStride, uint8_t *uPlane, uint8_t *vPlane, uint32_t uvStride, uint32_t uvStep,
+    uint32_t step)
+{
+    const uint32_t chromaWidth = (width+1)/2;
+    const uint32_t srcStep = 2*step;
+    for(uint32_t y=0; y<height; y+=2)
+    {
+        const uint8_t *row0 = yuv + y*step*yuvStride;
+        const uint8_t *row1 = ((y+1) < height) ? row0 + step*yuvStride : row0;
+        uint8_t *y0 = yPlane + y*yStride;
+        uint8_t *y1 = y0 + yStride;
+        for(uint32_t x=0; x<width; x++)
+        {
+            y0[x] = row0[x*srcStep];
+        }
+        if ((y+1) < height)
+        {
+            for(uint32_t x=0; x<width; x++)
+            {
+                y1[x] = row1[x*srcStep];
+            }
+        }
+
+        const uint8_t *chroma0 = row0;
+        const uint8_t *chroma1 = (step == 1) ? row1 : row0;
+        uint8_t *u = uPlane + (y/2)*uvStride;
+        uint8_t *v = vPlane + (y/2)*uvStride;
+        for(uint32_t x=0; x<chromaWidth; x++)
+        {
+            const uint32_t ofs = x*step*4;
+            *u = (chroma0[ofs+1] + chroma1[ofs+1] + 1) >> 1;
+            *v = (chroma0[ofs+3] + chroma1[ofs+3] + 1) >> 1;
+            u += uvStep;
+            v += uvStep;
+        }
+    }
+}
+
+bool convertYUYV(const uint8_t *yuv, uint32_t yuvStride, uint32_t width, uint32_t height,
+    uint8_t *dst, uint32_t dstStride, uint32_t format, uint32_t step)
+{
+    switch(format)
+    {
+    case CAPFORMAT_RGB24:
+    case CAPFORMAT_BGR24:
+    case CAPFORMAT_RGBA32:
+    case CAPFORMAT_BGRA32:
+    case CAPFORMAT_GRAY8:
+        return convertYUYVRegion(yuv, yuvStride, 0, 0, width, height, dst, dstStride, format, step);
+    case CAPFORMAT_NV12:
+        {
+            uint8_t *uv = dst + dstStride*height;
+            YUYVTo420(yuv, yuvStride, width, height, dst, dstStride, uv, uv+1, dstStride, 2, step);
+        }
+        return true;
+    case CAPFORMAT_I420:
+        {
+            const uint32_t uvStride = (dstStride+1)/2;
+            uint8_t *u = dst + dstStride*height;
+            uint8_t *v = u + uvStride*((height+1)/2);
+            YUYVTo420(yuv, yuvStride, width, height, dst, dstStride, u, v, uvStride, 1, step);
+        }
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool convertYUYVRegion(const uint8_t *yuv, uint32_t yuvStride, uint32_t x, uint32_t y,
+    uint32_t width, uint32_t height, uint8_t *dst, uint32_t dstStride, uint32_t format, uint32_t step)
+{
+    yuv += y*step*yuvStride;
+    switch(format)
+    {
+    case CAPFORMAT_RGB24:
+        YUYVToPacked<0,2,3>(yuv, yuvStride, x, width, height, dst, dstStride, step);
+        return true;
+    case CAPFORMAT_BGR24:
+        YUYVToPacked<2,0,3>(yuv, yuvStride, x, width, height, dst, dstStride, step);
+        return true;
+    case CAPFORMAT_RGBA32:
+        YUYVToPacked<0,2,4>(yuv, yuvStride, x, width, height, dst, dstStride, step);
+        return true;
+    case CAPFORMAT_BGRA32:
+        YUYVToPacked<2,0,4>(yuv, yuvStride, x, width, height, dst, dstStride, step);
+        return true;
+    case CAPFORMAT_GRAY8:
+        YUYVToGray(yuv, yuvStride, x, width, height, dst, dstStride, step);
+        return true;
+    default:
+        return false;
+    }
+}
+
+template<uint32_t rOfs, uint32_t bOfs, uint32_t pixelBytes>
+static void RGBToPacked(const uint8_t *rgb, uint32_t rgbStride, uint32_t width, uint32_t height,
+    uint8_t *dst, uint32_t dstStride)
+{
+    for(uint32_t y=0; y<height; y++)
+    {
+        const uint8_t *src = rgb + y*rgbStride;
+        uint8_t *row = dst + y*dstStride;
+        for(uint32_t x=0; x<width; x++)
+        {
+            row[rOfs] = src[0];
+            row[1]    = src[1];
+            row[bOfs] = src[2];
+            if (pixelBytes == 4) row[3] = 255;
+            src += 3;
+            row += pixelBytes;
+        }
+    }
+}
+
+bool convertRGB24(const uint8_t *rgb, uint32_t rgbStride, uint32_t width, uint32_t height,
+    uint8_t *dst, uint32_t dstStride, uint32_t format)
+{
+    switch(format)
+    {
+    case CAPFORMAT_RGB24:
+        for(uint32_t y=0; y<height; y++)
+        {
+            memcpy(dst + y*dstStride, rgb + y*rgbStride, width*3);
+        }
+        return true;
+    case CAPFORMAT_BGR24:
+        RGBToPacked<2,0,3>(rgb, rgbStride, width, height, dst, dstStride);
+        return true;
+    case CAPFORMAT_RGBA32:
+        RGBToPacked<0,2,4>(rgb, rgbStride, width, height, dst, dstStride);
+        return true;
+    case CAPFORMAT_BGRA32:
+        RGBToPacked<2,0,4>(rgb, rgbStride, width, height, dst, dstStride);
+        return true;
+    case CAPFORMAT_GRAY8:
+        for(uint32_t y=0; y<height; y++)
+        {
+            const uint8_t *src = rgb + y*rgbStride;
+            uint8_t *row = dst + y*dstStride;
+            for(uint32_t x=0; x<width; x++)
+            {
+                // BT.601 luma
+                row[x] = (77*src[0] + 150*src[1] + 29*src[2] + 128) >> 8;
+                src += 3;
+            }
+        }
+        return true;
+    default:
+        return false;
+    }
+}
@@ -35,4 +35,29 @@
 
 void YUYV2RGB(const uint8_t *yuv, uint8_t *rgb, uint32_t bytes);
 
+/** Convert a YUYV frame with rows of 'yuvStride' bytes into
+    a frame in the given output format (CAPFORMAT_xxx) with
+    rows of 'dstStride' bytes. CAPFORMAT_NATIVE is not handled.
+    'width' and 'height' are the output dimensions; when 'step'
+    is larger than one, every step-th pixel of every step-th
+    row is converted, which scales the frame down by 'step'.
+    Returns false if the format is not supported. */
+bool convertYUYV(const uint8_t *yuv, uint32_t yuvStride, uint32_t width, uint32_t height,
+    uint8_t *dst, uint32_t dstStride, uint32_t format, uint32_t step = 1);
+
+/** Convert a region of a YUYV frame into a packed or gray 
+    output format. Only the pixels inside the region are read.
+    The region is given in output pixels of a frame scaled
+    down by 'step', see convertYUYV.
+    Returns false if the format is not supported. */
+bool convertYUYVRegion(const uint8_t *yuv, uint32_t yuvStride, uint32_t x, uint32_t y,
+    uint32_t width, uint32_t height, uint8_t *dst, uint32_t dstStride, uint32_t format, uint32_t step = 1);
+
+/** Convert an RGB24 frame with rows of 'rgbStride' bytes into
+    a frame in the given packed or gray output format with
+    rows of 'dstStride' bytes.
+    Returns false if the format is not supported. */
+bool convertRGB24(const uint8_t *rgb, uint32_t rgbStride, uint32_t width, uint32_t height,
+    uint8_t *dst, uint32_t dstStride, uint32_t format);
+
 #endif
\ No newline at end of file
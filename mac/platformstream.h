@@ -109,7 +109,7 @@ protected:
     AVCaptureDevice*    m_device;       ///< note: we do not own the objecgt itself!
     dispatch_queue_t    m_queue;
 
-    std::vector<uint8_t> m_tmpBuffer;   ///< intermediate buffer for 32->24 bit conversion
+    FrameBuffer m_tmpBuffer;            ///< intermediate buffer for 32->24 bit conversion
 
     UVCCtrl             *m_uvc;         ///< UVC USB control object, can be NULL!
 
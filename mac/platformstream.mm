@@ -223,7 +223,7 @@ bool PlatformStream::open(Context *owner, deviceInfo *device, uint32_t width, ui
     m_width = width;
     m_height = height;
     m_owner = owner;
-    m_frameBuffer.resize(m_width*m_height*3);
+    allocateFrames(m_width*m_height*3);
     m_tmpBuffer.resize(m_width*m_height*3);
 
     AVCaptureVideoDataOutput* output = [AVCaptureVideoDataOutput new];
@@ -375,6 +375,11 @@ void PlatformStream::callback(const uint8_t *ptr, uint32_t bytes)
     // here we get 32-bit ARGB buffers, which we need to
     // convert to 24-bit RGB buffers
     
+    if (skipFrame())
+    {
+        return;
+    }
+
     if (m_tmpBuffer.size() != (m_width*m_height*3))
     {
         // error: temporary buffer is not the right size!
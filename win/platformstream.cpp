@@ -162,7 +162,7 @@ void PlatformStream::close()
     m_owner = nullptr;
     m_width = 0;
     m_height = 0;
-    m_frameBuffer.resize(0);
+    m_frameRing.clear();
     m_isOpen = false;    
 }
 
@@ -483,7 +483,7 @@ bool PlatformStream::open(Context *owner, deviceInfo *device, uint32_t width, ui
 
             //FIXME: for now, just set the frame buffer size to
             //       width*height*3 for 24 RGB raw images
-            m_frameBuffer.resize(m_width*m_height*3);                  
+            allocateFrames(m_width*m_height*3);
         }
         CoTaskMemFree( info->pbFormat );        
     }
@@ -855,13 +855,6 @@ bool PlatformStream::getAutoProperty(uint32_t propID, bool &enabled)
 
 void PlatformStream::submitBuffer(const uint8_t *ptr, size_t bytes)
 {
-    m_bufferMutex.lock();
-    
-    if (m_frameBuffer.size() == 0)
-    {
-        LOG(LOG_ERR,"Stream::m_frameBuffer size is 0 - cant store frame buffers!\n");
-    }
-
     // Generate warning every 100 frames if the frame buffer is not
     // the expected size. 
     
@@ -871,15 +864,37 @@ void PlatformStream::submitBuffer(const uint8_t *ptr, size_t bytes)
         LOG(LOG_WARNING, "Warning: captureFrame received incorrect buffer size (got %d want %d)\n", bytes, wantSize);
     }
 
-    if (bytes <= m_frameBuffer.size())
+    if (skipFrame())
+    {
+        return;
+    }
+
+    if (bytes <= m_frameRing.getSlotBytes())
     {
+        FrameSlot *slot = beginFrame();
+        if (slot == nullptr)
+        {
+            return;
+        }
+
         // The Win32 API delivers upside-down BGR frames.
         // Conversion to regular RGB frames is done by
-        // byte-reversing the buffer
-            
+        // byte-reversing the buffer. BGR frames only
+        // need to be flipped.
+
+        if (slot->m_format == CAPFORMAT_BGR24)
+        {
+            for(size_t y=0; y<m_height; y++)
+            {
+                memcpy(&slot->m_data[(y*m_width)*3], ptr + (m_width*3)*(m_height-y-1), m_width*3);
+            }
+            commitFrame(slot);
+            return;
+        }
+
         for(size_t y=0; y<m_height; y++)
         {
-            uint8_t *dst = &m_frameBuffer[(y*m_width)*3];
+            uint8_t *dst = &slot->m_data[(y*m_width)*3];
             const uint8_t *src = ptr + (m_width*3)*(m_height-y-1);
             for(uint32_t x=0; x<m_width; x++)
             {
@@ -892,14 +907,16 @@ void PlatformStream::submitBuffer(const uint8_t *ptr, size_t bytes)
             }
         }
 
-        m_newFrame = true; 
-        m_frames++;        
+        commitFrame(slot);
     }
-
-    m_bufferMutex.unlock();
 }
 
 
+bool PlatformStream::supportsOutputFormat(uint32_t format)
+{
+    return (format == CAPFORMAT_RGB24) || (format == CAPFORMAT_BGR24);
+}
+
 HRESULT PlatformStream::AddToRot(IUnknown *pUnkGraph, DWORD *pdwRegister)
 {
     IMoniker * pMoniker = NULL;
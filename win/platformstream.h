@@ -169,6 +169,9 @@ protected:
     /** A re-implementation of Stream::submitBuffer with BGR to RGB conversion */
     virtual void submitBuffer(const uint8_t *ptr, size_t bytes) override;
 
+    /** DirectShow delivers BGR frames, so both RGB24 and BGR24 are supported */
+    virtual bool supportsOutputFormat(uint32_t format) override;
+
     /** Add the Direct show filter graph to the object list so
         GraphEdt.exe can see it - for debugging purposes only.
         See: https://msdn.microsoft.com/en-us/library/windows/desktop/dd390650(v=vs.85).aspx    